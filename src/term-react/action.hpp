@@ -4,6 +4,12 @@
 #include <boost/preprocessor/variadic.hpp>
 
 namespace termreact {
+
+// dispatches are processed lane by lane, highest first. Immediate and Normal ones are processed
+// right away (or at the end of the current chunk), Background ones wait for flushBackground()
+// and are then reduced together into a single state update
+enum class DispatchPriority { Immediate, Normal, Background };
+
 namespace details {
 
 template <typename T, T> class EnumValue;
@@ -18,12 +24,13 @@ enum class BuiltinAction {
   InitStore,
   UpdateWindowWidth,
   UpdateWindowHeight,
-  rescanFocusable,
-  stopFocusableScanning,
-  registerFocusable,
+  // both at once, (width, height)
+  UpdateWindowSize,
   unregisterFocusable,
   selectFocus,
-  nextFocus
+  nextFocus,
+  prevFocus,
+  moveFocus
 };
 
 }
@@ -1,8 +1,42 @@
 #pragma once
 #include <string>
+#include <limits>
+#include <algorithm>
+#include <utility>
 
 namespace termreact {
 
+namespace details {
+class MouseTarget;
+}
+
+struct Rect {
+  int x, y;
+  int width, height;
+
+  bool contains(int px, int py) const {
+    return px >= x && px < x + width && py >= y && py < y + height;
+  }
+
+  bool contains(const Rect& rect) const {
+    return rect.x >= x && rect.y >= y && rect.x + rect.width <= x + width && rect.y + rect.height <= y + height;
+  }
+
+  bool empty() const { return width <= 0 || height <= 0; }
+
+  // an empty rect when they don't overlap
+  Rect intersect(const Rect& rect) const {
+    int x0 = std::max(x, rect.x), y0 = std::max(y, rect.y);
+    int x1 = std::min(x + width, rect.x + rect.width), y1 = std::min(y + height, rect.y + rect.height);
+    return Rect{x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0)};
+  }
+
+  bool operator==(const Rect& rect) const {
+    return x == rect.x && y == rect.y && width == rect.width && height == rect.height;
+  }
+  bool operator!=(const Rect& rect) const { return !(*this == rect); }
+};
+
 class CanvasSlice;
 
 class Canvas {
@@ -26,37 +60,112 @@ public:
     }
   }
 
+  // writeString() leaving out what doesn't fit in the columns [from, to) in full
+  virtual void writeStringClipped(int x, int y, std::string str, uint16_t fg, uint16_t bg, int from, int to) {
+    for (int i = std::max(from - x, 0); i < static_cast<int>(str.size()) && x + i < to; ++i) {
+      setCell(x + i, y, str[i], fg, bg);
+    }
+  }
+
   CanvasSlice slice(int x, int y, int w, int h);
   virtual void present() = 0;
+
+  // the content of the area moved up by dy rows (down if negative) since the last present.
+  // lets a canvas keeping the screen's state scroll it instead of repainting every row,
+  // the area still has to be drawn in full afterwards
+  virtual void scroll(int, int, int, int, int) {}
+
+  // make target receive mouse events happening inside rect until the next clear().
+  // rect is in screen coordinates, e.g. the one returned by CanvasSlice::getRect().
+  // targets registered later are considered on top of earlier ones.
+  void addMouseTarget(const Rect& rect, details::MouseTarget* target) { addMouseTarget(rect, rect, target); }
+  // only where rect and visible overlap, events still have their position relative to rect
+  virtual void addMouseTarget(const Rect&, const Rect&, details::MouseTarget*) {}
+
+  // layers, for what's drawn over the rest: popups, overlays, or a busy area seldom updated.
+  // what's drawn in the canvas returned goes to a buffer kept for owner, in screen coordinates,
+  // composited over the screen at present in z order (then in the order they're begun), over the
+  // area given to endLayer(). redraw empties the buffer first, otherwise it keeps what was drawn in
+  // it before; it's set if the buffer had to be emptied anyway. a layer is only composited in the
+  // frames it's begun in. nullptr if the canvas has no layers
+  virtual Canvas* beginLayer(const void*, int, bool&) { return nullptr; }
+  virtual void endLayer(const void*, const Rect&) {}
+
+  // whether what's drawn in rect is certain to end up under a layer above z (0 for what isn't in
+  // a layer), so that drawing it can be skipped
+  virtual bool occluded(const Rect&, int = 0) const { return false; }
   virtual ~Canvas() {}
 };
 
+// a part of a canvas, in coordinates of its own. nothing it draws gets out of it, nor out of the
+// slice it was taken from
 class CanvasSlice : public Canvas {
 private:
   Canvas *target_;
   int x_, y_;
   int width_, height_;
-  
+  // what it can draw in, in screen coordinates
+  Rect clip_;
+
+  CanvasSlice(Canvas *target, int x, int y, int w, int h, const Rect& clip)
+  : target_{target}, x_{x}, y_{y}, width_{w}, height_{h}, clip_{clip} {}
+
 public:
   CanvasSlice() {}
 
   CanvasSlice(Canvas *target, int x, int y, int w, int h)
-  : target_{target}, x_{x}, y_{y}, width_{w}, height_{h} {}
+  : target_{target}, x_{x}, y_{y}, width_{w}, height_{h}, clip_{x, y, w, h} {}
  
-  // forward everything with only x and y modified
+  // forward everything with only x and y modified, and what's out of the clip left out
   int getWidth() const override { return width_; }
   int getHeight() const override { return height_; }
   void clear(uint16_t fg = 0, uint16_t bg = 0) override { target_->clear(fg, bg); }
   void setCell(int x, int y, uint32_t ch, uint16_t fg = 0, uint16_t bg = 0) override {
-    target_->setCell(x + x_, y + y_, ch, fg, bg);
+    if (clip_.contains(x + x_, y + y_)) target_->setCell(x + x_, y + y_, ch, fg, bg);
+  }
+  void writeString(int x, int y, std::string str, uint16_t fg = 0, uint16_t bg = 0) override {
+    x += x_;
+    y += y_;
+    if (y < clip_.y || y >= clip_.y + clip_.height || x >= clip_.x + clip_.width) return;
+    // the target may know better than one byte per cell, and a cell takes a byte at least
+    if (x >= clip_.x && x + 2 * static_cast<long>(str.size()) <= clip_.x + clip_.width) {
+      target_->writeString(x, y, std::move(str), fg, bg);
+    } else {
+      target_->writeStringClipped(x, y, std::move(str), fg, bg, clip_.x, clip_.x + clip_.width);
+    }
+  }
+  void writeStringClipped(int x, int y, std::string str, uint16_t fg, uint16_t bg, int from, int to) override {
+    if (y + y_ < clip_.y || y + y_ >= clip_.y + clip_.height) return;
+    target_->writeStringClipped(x + x_, y + y_, std::move(str), fg, bg,
+                                std::max(from + x_, clip_.x), std::min(to + x_, clip_.x + clip_.width));
   }
   void present() override { target_->present(); }
+  void scroll(int x, int y, int w, int h, int dy) override {
+    // never let it move anything outside this slice
+    auto area = clip_.intersect(Rect{x + x_, y + y_, w, h});
+    if (!area.empty()) target_->scroll(area.x, area.y, area.width, area.height, dy);
+  }
+  using Canvas::addMouseTarget;
+  void addMouseTarget(const Rect& rect, const Rect& visible, details::MouseTarget* target) override {
+    target_->addMouseTarget(rect, visible.intersect(clip_), target);
+  }
+  Canvas* beginLayer(const void *owner, int z, bool& redraw) override { return target_->beginLayer(owner, z, redraw); }
+  void endLayer(const void *owner, const Rect& rect) override { target_->endLayer(owner, rect); }
+  bool occluded(const Rect& rect, int z = 0) const override { return target_->occluded(rect, z); }
+  // the area covered by this slice, in screen coordinates
+  Rect getRect() const { return Rect{x_, y_, width_, height_}; }
+  // the part of it that can be drawn in, empty if it's out of sight
+  Rect getVisibleRect() const { return clip_; }
   CanvasSlice slice(int x, int y, int w, int h) {
-    return CanvasSlice{target_, x_ + x, y_ + y, w, h};
+    return CanvasSlice{target_, x_ + x, y_ + y, w, h, clip_.intersect(Rect{x_ + x, y_ + y, w, h})};
+  }
+  // the same area of another canvas in screen coordinates, such as a layer
+  CanvasSlice retarget(Canvas *target) const {
+    return CanvasSlice{target, x_, y_, width_, height_, clip_};
   }
 };
 
-CanvasSlice Canvas::slice(int x, int y, int w, int h) {
+inline CanvasSlice Canvas::slice(int x, int y, int w, int h) {
   return CanvasSlice{this, x, y, w, h};
 }
 
@@ -3,8 +3,9 @@
 #include <string>
 #include <typeinfo>
 #include <deque>
+#include <unordered_set>
 #include <vector>
-#include <functional>
+#include <memory>
 #include <algorithm>
 #include <boost/preprocessor/seq.hpp>
 #include <boost/preprocessor/tuple.hpp>
@@ -16,21 +17,115 @@
 namespace termreact {
 namespace details {
 
+class ComponentBase;
+
+// components waiting for their render_(), so that rendering a large tree can be spread over
+// several slices of the main loop instead of running to completion inside a store update.
+// only used while a provider activates it, otherwise components render right away.
+// each thread has its own current scheduler, so providers on different threads don't mix.
+// a queued component knows its scheduler, it may be unmounted while another one is current
+class RenderScheduler {
+private:
+  std::deque<ComponentBase*> queue_;
+  // the ones in queue_ still waiting, unmounted or already rendered ones are skipped
+  std::unordered_set<ComponentBase*> queued_;
+
+  static RenderScheduler*& current_() {
+    static thread_local RenderScheduler *current = nullptr;
+    return current;
+  }
+
+public:
+  static RenderScheduler* current() { return current_(); }
+
+  void activate() { current_() = this; }
+
+  // makes scheduler (nullptr for none) the current one, returns the previous
+  static RenderScheduler* select(RenderScheduler *scheduler) {
+    auto previous = current_();
+    current_() = scheduler;
+    return previous;
+  }
+
+  void deactivate();
+
+  ~RenderScheduler() { deactivate(); }
+
+  bool idle() const { return queued_.empty(); }
+
+  void schedule(ComponentBase *component);
+
+  void cancel(ComponentBase *component);
+
+  // render queued components, including the children they queue, until there are none left
+  // or should_yield() says so. returns whether the tree is completely rendered
+  template <typename ShouldYield>
+  bool run(ShouldYield&& should_yield);
+};
+
+// lazy children (see the lazy prop of end components) found in sight while presenting. mounting
+// them right then would dispatch in the middle of presenting the tree, so they wait for the provider
+// to mount them once it's done, and to present again. each thread has its own current one, like
+// RenderScheduler; without one they're mounted as soon as they're found. like there, a due
+// component knows where it's due
+class DeferredMounts {
+private:
+  std::deque<ComponentBase*> due_;
+
+  static DeferredMounts*& current_() {
+    static thread_local DeferredMounts *current = nullptr;
+    return current;
+  }
+
+public:
+  static DeferredMounts* current() { return current_(); }
+
+  // makes mounts (nullptr for none) the current one, returns the previous
+  static DeferredMounts* select(DeferredMounts *mounts) {
+    auto previous = current_();
+    current_() = mounts;
+    return previous;
+  }
+
+  ~DeferredMounts();
+
+  void add(ComponentBase *component);
+
+  // mounting one may unmount others
+  void cancel(ComponentBase *component);
+
+  // returns whether there were any
+  bool mount();
+};
+
 class ComponentBase {
 protected:
   // need to redraw? set by render() and clear by present()
   bool updated_;
+  // where it's waiting to be rendered or mounted, if anywhere
+  RenderScheduler *scheduled_in_ = nullptr;
+  DeferredMounts *due_in_ = nullptr;
 
   virtual void render_() = 0;
   virtual void present_(CanvasSlice, bool) = 0;
+  // components with children have to look at them too
+  virtual bool subtreeUpdated_() const { return updated_; }
+
+  void performRender_() {
+    render_();
+    updated_ = true;
+  }
 
 public:
-  virtual ~ComponentBase() {}
+  virtual ~ComponentBase() {
+    if (scheduled_in_) scheduled_in_->cancel(this);
+    if (due_in_) due_in_->cancel(this);
+  }
 
   // generate / update child components to reflect the current props & state
   void render() {
-    render_();
-    updated_ = true;
+    if (auto scheduler = RenderScheduler::current()) return scheduler->schedule(this);
+    performRender_();
   }
 
   // draw on canvas. Decide whether to actually draw something based on this->updated_ and parent_updated
@@ -39,10 +134,83 @@ public:
     updated_ = false;
   }
 
+  // whether anything in the subtree got rendered since it was last presented. walks it all,
+  // which is still cheaper than drawing it
+  bool subtreeUpdated() const { return subtreeUpdated_(); }
+
   // pass the pointer around and concrete component can convert it to the actual state type
   virtual void onStoreUpdate(const void* next_state) = 0;
+
+  friend class RenderScheduler;
+  friend class DeferredMounts;
 };
 
+inline void RenderScheduler::deactivate() {
+  if (current_() == this) current_() = nullptr;
+  for (auto component : queued_) component->scheduled_in_ = nullptr;
+  queue_.clear();
+  queued_.clear();
+}
+
+inline void RenderScheduler::schedule(ComponentBase *component) {
+  if (!queued_.insert(component).second) return;
+  queue_.push_back(component);
+  component->scheduled_in_ = this;
+}
+
+inline void RenderScheduler::cancel(ComponentBase *component) {
+  if (queued_.erase(component)) component->scheduled_in_ = nullptr;
+}
+
+template <typename ShouldYield>
+bool RenderScheduler::run(ShouldYield&& should_yield) {
+  while (!queue_.empty()) {
+    auto component = queue_.front();
+    queue_.pop_front();
+    if (!queued_.erase(component)) continue;
+    component->scheduled_in_ = nullptr;
+    component->performRender_();
+    if (should_yield()) break;
+  }
+  return idle();
+}
+
+inline DeferredMounts::~DeferredMounts() {
+  for (auto component : due_) component->due_in_ = nullptr;
+}
+
+inline void DeferredMounts::add(ComponentBase *component) {
+  // found in sight again before it got mounted
+  if (component->due_in_ == this) return;
+  due_.push_back(component);
+  component->due_in_ = this;
+}
+
+inline void DeferredMounts::cancel(ComponentBase *component) {
+  due_.erase(std::remove(due_.begin(), due_.end(), component), due_.end());
+  component->due_in_ = nullptr;
+}
+
+inline bool DeferredMounts::mount() {
+  if (due_.empty()) return false;
+  while (!due_.empty()) {
+    auto component = due_.front();
+    due_.pop_front();
+    component->due_in_ = nullptr;
+    component->render();
+  }
+  return true;
+}
+
+// end components able to tell where they'd draw from their props and canvas alone, with a
+// static CanvasSlice layout(const Properties&, CanvasSlice)
+template <typename T, typename = void>
+struct HasLayout : std::false_type {};
+
+template <typename T>
+struct HasLayout<T, decltype(void(T::layout(std::declval<const typename T::Properties&>(), std::declval<CanvasSlice>())))>
+  : std::true_type {};
+
 template <typename T> class ComponentAccessor;
 
 // base class for all non-endpoint components
@@ -63,12 +231,17 @@ protected:
     // only components handle present, so just forward the call
     node_->present(canvas, parent_updated || updated_);
   }
+
+  bool subtreeUpdated_() const override {
+    return updated_ || !node_ || node_->subtreeUpdated();
+  }
 public:
   ComponentNode(StoreT& store) : store_(store) {}
   
   void onStoreUpdate(const void *next_state) override {
     onStoreUpdate_(next_state);
-    node_->onStoreUpdate(next_state);
+    // may still be waiting for its first render
+    if (node_) node_->onStoreUpdate(next_state);
   }
   
   friend class details::ComponentAccessor<StoreType>;
@@ -77,7 +250,6 @@ public:
 class ComponentHolder;
 using Child = std::shared_ptr<ComponentHolder>;
 using Children = std::deque<Child>;
-using ChildrenCreator = std::function<void(bool*, Children*)>;
 
 template <typename T>
 void renderComponent(ComponentBase& component, typename T::Properties next_props) {
@@ -101,37 +273,23 @@ std::unique_ptr<ComponentBase> createComponent(typename ChildT::Properties next_
 // container for child component
 // child components are only rendered when we really need it
 class ComponentHolder : public ComponentBase {
-public:
-  // try to update component's props.
-  // if there is any change made, store the new props in ComponentHolderT::next_props and return true
-  // if no changes, return false
-  using Updater = std::function<bool(ComponentBase*, ComponentHolder*)>;
-
 private:
   // needs to be unique within, at least, same-level children
   const std::string id_;
   // comes from typeid(ComponentType).hash_code()
   std::size_t component_type_hash_;
-  std::vector<Updater> updaters_;
 
 protected:
   std::unique_ptr<ComponentBase> component_;
 
 public:
-  ComponentHolder(std::string id, std::size_t type_hash, Updater updater)
-    : id_{id}, component_type_hash_{type_hash}, updaters_{std::move(updater)} {}
-
-  bool calculateNextProps(ComponentBase *component) {
-    return std::accumulate(std::begin(updaters_), std::end(updaters_), false, 
-      [this, component] (bool updated, Updater updater) {
-        return updater(component, this) || updated;
-      }
-    );
-  }
+  ComponentHolder(std::string id, std::size_t type_hash)
+    : id_{std::move(id)}, component_type_hash_{type_hash} {}
 
-  void addPropsUpdater(Updater updater) {
-    updaters_.emplace_back(std::move(updater));
-  }
+  // try to update component's props.
+  // if there is any change made, store the new props in ComponentHolderT::next_props and return true
+  // if no changes, return false
+  virtual bool calculateNextProps(ComponentBase *component) = 0;
 
   static Children mergeChildren(Children next_children, const Children& prev_children) {
     for (auto& pc : next_children) {
@@ -181,17 +339,55 @@ public:
   }
 };
 
-template <typename ChildT, typename StoreT>
+// apply the attributes and build the children, in a single pass over the children creator
+template <typename T, typename PropsUpdater, typename ChildrenCreator>
+typename T::Properties updateProps(typename T::Properties prev_props,
+                                   const PropsUpdater& props_updater, const ChildrenCreator& children_creator) {
+  using Properties = typename T::Properties;
+  auto next_props = props_updater(std::move(prev_props));
+
+  Children next_children;
+  children_creator(next_children);
+  next_props.template update<Properties::Field::children>(
+    ComponentHolder::mergeChildren(std::move(next_children), next_props.template get<Properties::Field::children>())
+  );
+  return next_props;
+}
+
+// the attributes and the children creator are kept as they are, no type erasure,
+// and only evaluated when the parent decides the child needs its props
+template <typename ChildT, typename StoreT, typename PropsUpdater, typename ChildrenCreator>
 class ComponentHolderT : public ComponentHolder {
 private:
-  typename ChildT::Properties next_props_;
+  using Properties = typename ChildT::Properties;
+
+  Properties next_props_;
   StoreT& store_;
+  PropsUpdater props_updater_;
+  ChildrenCreator children_creator_;
+  // a lazy child is left unmounted until it's presented in sight
+  bool in_sight_ = false;
+
+  template <typename C = ChildT, std::enable_if_t<HasLayout<C>::value, int> = 0>
+  bool deferred_() const {
+    return !in_sight_ && next_props_ && next_props_.template get<C::Properties::Field::lazy>();
+  }
+  template <typename C = ChildT, std::enable_if_t<!HasLayout<C>::value, int> = 0>
+  bool deferred_() const { return false; }
+
+  template <typename C = ChildT, std::enable_if_t<HasLayout<C>::value, int> = 0>
+  bool inSight_(CanvasSlice canvas) const {
+    return !C::layout(next_props_, canvas).getVisibleRect().empty();
+  }
+  template <typename C = ChildT, std::enable_if_t<!HasLayout<C>::value, int> = 0>
+  bool inSight_(CanvasSlice) const { return true; }
 
 protected:
   void render_() override {
     // actually create the component in the first rendering
     if (!component_) {
       calculateNextProps(nullptr);
+      if (deferred_()) return;
       store_.startChunkDispatch();
       component_ = createComponent<ChildT>(std::move(next_props_), store_);
       store_.endChunkDispatch();
@@ -204,19 +400,38 @@ protected:
   }
 
   void present_(CanvasSlice canvas, bool parent_updated) override {
+    if (component_) return component_->present(canvas, parent_updated);
+    if (!deferred_() || !inSight_(canvas)) return;
+    in_sight_ = true;
+    if (auto mounts = DeferredMounts::current()) return mounts->add(this);
+    // presented by hand, nothing is going to mount it afterwards
+    render();
     if (component_) component_->present(canvas, parent_updated);
   }
 
-public:
-  ComponentHolderT(std::string id, StoreT& store, Updater updater)
-  : ComponentHolder{id, typeid(ChildT).hash_code(), std::move(updater)}, next_props_{TrivalConstruction_t{}}, store_{store} {}
+  // rendered along with its parent's children whether its props changed or not, only the
+  // component tells. a lazy child out of sight has nothing to draw yet
+  bool subtreeUpdated_() const override {
+    return component_ ? component_->subtreeUpdated() : !deferred_();
+  }
 
-  void setNextProps(typename ChildT::Properties next_props) {
-    next_props_ = std::move(next_props);
+public:
+  ComponentHolderT(std::string id, StoreT& store, PropsUpdater props_updater, ChildrenCreator children_creator)
+  : ComponentHolder{std::move(id), typeid(ChildT).hash_code()}, next_props_{TrivalConstruction_t{}}, store_{store},
+    props_updater_{std::move(props_updater)}, children_creator_{std::move(children_creator)} {}
+
+  bool calculateNextProps(ComponentBase *pc) override {
+    auto component = dynamic_cast<ChildT*>(pc);
+    auto next_props = updateProps<ChildT>(component ? component->getProps() : Properties{}, props_updater_, children_creator_);
+    if (!component || next_props != component->getProps()) {
+      next_props_ = std::move(next_props);
+      return true;
+    }
+    return false;
   }
   
   void onStoreUpdate(const void *next_state) override {
-    component_->onStoreUpdate(next_state);
+    if (component_) component_->onStoreUpdate(next_state);
   }
 };
 
@@ -237,63 +452,33 @@ public:
   T& getStore() const { return pc_->store_; }
 };
 
-// handler of component property update
-template <typename T>
-class ComponentRendererHelper {
-public:
-  using Properties = typename T::Properties;
-
-private:
-  const ChildrenCreator& children_creator_;
-  std::function<Properties(Properties)> props_updater_;
-
-public:
-  ComponentRendererHelper(const ChildrenCreator& children_creator, std::function<Properties(Properties)> props_updater)
-  : children_creator_{children_creator}, props_updater_{props_updater} {}
-
-  Properties updateProps(Properties prev_props) const {
-    auto next_props = props_updater_(std::move(prev_props));
-
-    bool trivial_creator = true;
-    children_creator_(&trivial_creator, nullptr);
-    if (!trivial_creator) {
-      Children next_children;
-      children_creator_(&trivial_creator, &next_children);
-      next_props.template update<Properties::Field::children>(
-        ComponentHolder::mergeChildren(std::move(next_children), next_props.template get<Properties::Field::children>())
-      );
-    }
-
-    return next_props;
-  }
-};
-
-// set or update a component's render result
+// set or update a component's render result, once given the children creator
 // should be only used in component.render()
-template <typename ChildT, typename StoreT>
+template <typename ChildT, typename StoreT, typename PropsUpdater>
 class ComponentRenderer {
 private:
-  using Properties = typename ComponentRendererHelper<ChildT>::Properties;
+  using Properties = typename ChildT::Properties;
 
-  ComponentRendererHelper<ChildT> helper_;
   ComponentAccessor<StoreT> parent_;
+  PropsUpdater props_updater_;
 
 public:
-  ComponentRenderer(ComponentNode<StoreT>* parent, ChildrenCreator& children_creator, std::function<Properties(Properties)> props_updater)
-  : helper_{children_creator, props_updater}, parent_{parent} {}
+  ComponentRenderer(ComponentNode<StoreT>* parent, PropsUpdater props_updater)
+  : parent_{parent}, props_updater_{std::move(props_updater)} {}
 
-  ~ComponentRenderer() {
+  template <typename ChildrenCreator>
+  void operator<<(const ChildrenCreator& children_creator) {
     if (typeid(ChildT).hash_code() != parent_.getType() || !parent_.getNode()) {
       // a different type component needed or no component existing at all
       parent_.setType(typeid(ChildT).hash_code());
       parent_.getStore().startChunkDispatch();
-      parent_.setNode(createComponent<ChildT>(helper_.updateProps(Properties{}), parent_.getStore()));
+      parent_.setNode(createComponent<ChildT>(updateProps<ChildT>(Properties{}, props_updater_, children_creator), parent_.getStore()));
       parent_.getStore().endChunkDispatch();
       return;
     }
 
     ChildT* target = dynamic_cast<ChildT*>(parent_.getNode().release());
-    auto next_props = helper_.updateProps(target->getProps());
+    auto next_props = updateProps<ChildT>(target->getProps(), props_updater_, children_creator);
     if (next_props != target->getProps()) {
       renderComponent<ChildT>(*target, std::move(next_props));
     }
@@ -301,65 +486,44 @@ public:
   }
 };
 
-// add child holders to a component rendered by ComponentRenderer
-template <typename ChildT, typename StoreT>
+template <typename ChildT, typename StoreT, typename PropsUpdater>
+ComponentRenderer<ChildT, StoreT, PropsUpdater> renderMainComponent(ComponentNode<StoreT>* parent, PropsUpdater props_updater) {
+  return ComponentRenderer<ChildT, StoreT, PropsUpdater>{parent, std::move(props_updater)};
+}
+
+// add a child holder to a component rendered by ComponentRenderer, once given its children creator.
+// children are appended as they are met, so they keep their order in the source
+template <typename ChildT, typename StoreT, typename PropsUpdater>
 class ChildRenderer {
 private:
-  using Properties = typename ComponentRendererHelper<ChildT>::Properties;
-
-  ChildrenCreator& children_creator_;
-  std::function<Properties(Properties)> props_updater_;
   std::string id_;
   Children& next_children_;
   StoreT& store_;
+  PropsUpdater props_updater_;
 
 public:
-  ChildRenderer(std::string id, Children& next_children, ChildrenCreator& children_creator,
-                std::function<Properties(Properties)> props_updater, StoreT& store)
-  : children_creator_{children_creator}, props_updater_{props_updater},
-    id_{id}, next_children_{next_children}, store_{store} {}
-
-  ~ChildRenderer() {
-    next_children_.emplace_front(new ComponentHolderT<ChildT, StoreT>{id_, store_,
-      [c{std::move(children_creator_)}, u{std::move(props_updater_)}]
-      (ComponentBase *pc, ComponentHolder *ph) {
-        ComponentRendererHelper<ChildT> helper{c, u};
-        auto component = dynamic_cast<ChildT*>(pc);
-        auto holder = dynamic_cast<ComponentHolderT<ChildT, StoreT>*>(ph);
-
-        auto next_props = helper.updateProps(component ? component->getProps() : Properties{});
-        if (!component || next_props != component->getProps()) {
-          holder->setNextProps(std::move(next_props));
-          return true;
-        }
-        return false;
-      }});
+  ChildRenderer(std::string id, Children& next_children, StoreT& store, PropsUpdater props_updater)
+  : id_{std::move(id)}, next_children_{next_children}, store_{store}, props_updater_{std::move(props_updater)} {}
+
+  template <typename ChildrenCreator>
+  void operator<<(ChildrenCreator children_creator) {
+    next_children_.emplace_back(std::make_shared<ComponentHolderT<ChildT, StoreT, PropsUpdater, ChildrenCreator>>(
+      std::move(id_), store_, std::move(props_updater_), std::move(children_creator)
+    ));
   }
 };
 
+template <typename ChildT, typename StoreT, typename PropsUpdater>
+ChildRenderer<ChildT, StoreT, PropsUpdater> renderChildComponent(std::string id, Children& next_children,
+                                                                 StoreT& store, PropsUpdater props_updater) {
+  return ChildRenderer<ChildT, StoreT, PropsUpdater>{std::move(id), next_children, store, std::move(props_updater)};
+}
+
 // similar to ChildRenderer, but only for forwarding existing
 // child holders, which is in most cases props.children
 template <typename VecT>
-class ArrayRenderer {
-private:
-  Children& next_children_;
-  VecT components_;
-
-public:
-  ArrayRenderer(Children& next_children, VecT components)
-  : next_children_{next_children}, components_{std::move(components)} {}
-
-  ~ArrayRenderer() {
-    for (auto it = std::rbegin(components_); it != std::rend(components_); ++it) {
-      next_children_.emplace_front(std::move(*it));
-    }
-  }
-};
-
-template <typename VecT>
-ArrayRenderer<VecT> createArrayRender(Children& next_children, VecT&& components) {
-  VecT copy_components{std::forward<VecT>(components)};
-  return ArrayRenderer<VecT>{next_children, std::move(copy_components)};
+void appendChildren(Children& next_children, const VecT& components) {
+  next_children.insert(std::end(next_children), std::begin(components), std::end(components));
 }
 
 }
@@ -375,10 +539,6 @@ using ComponentPointer = std::unique_ptr<details::ComponentBase>;
   private: \
     Properties props_
 
-#define __DETAILS_CHILDREN_CREATOR_NAME(C) BOOST_PP_CAT(__, BOOST_PP_CAT(__LINE__, CHILDREN_CREATOR__))
-#define __DETAILS_COMPONENT_RENDERER_NAME(C) BOOST_PP_CAT(__, BOOST_PP_CAT(__LINE__, COMPONENT_RENDERER__))
-#define __DETAILS_ARRAY_RENDERER_NAME BOOST_PP_CAT(__, BOOST_PP_CAT(__LINE__, ARRAY_RENDERER))
-
 #define __DETAILS_PROPS_UPDATER_OP(s, prefix, tuple) \
   props.template update<prefix::BOOST_PP_TUPLE_ELEM(0, tuple)>(BOOST_PP_TUPLE_ENUM(BOOST_PP_TUPLE_POP_FRONT(tuple)));
   //props.template update<prefix::BOOST_PP_TUPLE_ELEM(0, tuple)>(BOOST_PP_TUPLE_ELEM(1, tuple));
@@ -393,25 +553,18 @@ using ComponentPointer = std::unique_ptr<details::ComponentBase>;
     __DETAILS_PROPS_UPDATER, \
     __DETAILS_EMPTY_PROPS_UPDATER)(BOOST_PP_VARIADIC_SEQ_TO_SEQ(attr)) \
 
+// the block following these macros becomes the body of the children creator
 #define RENDER_MAIN_COMPONENT(C, attr) \
-  ::termreact::details::ChildrenCreator __DETAILS_CHILDREN_CREATOR_NAME(C); \
-  ::termreact::details::ComponentRenderer<C<StoreT>, StoreT> __DETAILS_COMPONENT_RENDERER_NAME(C) { \
-    this, __DETAILS_CHILDREN_CREATOR_NAME(C), attr \
-  }; \
-  __DETAILS_CHILDREN_CREATOR_NAME(C) = [this] (bool *trivial_creator, ::termreact::details::Children *next_children)
+  ::termreact::details::renderMainComponent<C<StoreT>>(this, attr) << \
+  [this] (::termreact::details::Children& next_children)
 
 #define RENDER_CHILD_COMPONENT(C, id, attr) \
-  if (*trivial_creator) { *trivial_creator = false; return; } \
-  ::termreact::details::ChildrenCreator __DETAILS_CHILDREN_CREATOR_NAME(C); \
-  ::termreact::details::ChildRenderer<C<StoreT>, StoreT> __DETAILS_COMPONENT_RENDERER_NAME(C) { \
-    id, *next_children, __DETAILS_CHILDREN_CREATOR_NAME(C), attr, \
-    ::termreact::details::ComponentAccessor<StoreT>{this}.getStore() \
-  }; \
-  __DETAILS_CHILDREN_CREATOR_NAME(C) = [this] (bool *trivial_creator, ::termreact::details::Children *next_children)
+  ::termreact::details::renderChildComponent<C<StoreT>>( \
+    id, next_children, ::termreact::details::ComponentAccessor<StoreT>{this}.getStore(), attr \
+  ) << [this] (::termreact::details::Children& next_children)
 
 #define RENDER_COMPONENT_ARRAY(arr) \
-  if (*trivial_creator) { *trivial_creator = false; return; } \
-  auto __DETAILS_ARRAY_RENDERER_NAME = ::termreact::details::createArrayRender(*next_children, arr)
+  ::termreact::details::appendChildren(next_children, arr)
 
 #define RENDER_COMPONENT(...) \
   BOOST_PP_IF(BOOST_PP_EQUAL(1, BOOST_PP_VARIADIC_SIZE(__VA_ARGS__)), RENDER_COMPONENT_ARRAY, \
@@ -419,7 +572,7 @@ using ComponentPointer = std::unique_ptr<details::ComponentBase>;
   BOOST_PP_IF(BOOST_PP_EQUAL(3, BOOST_PP_VARIADIC_SIZE(__VA_ARGS__)), RENDER_CHILD_COMPONENT, \
   BOOST_PP_EMPTY)))(__VA_ARGS__)
 
-#define NO_CHILDREN do { (void)trivial_creator; (void)next_children; } while(0);
+#define NO_CHILDREN do { (void)next_children; } while(0);
 
 #define CREATE_COMPONENT_CLASS(cname) \
   template <typename StoreT> class cname : public ::termreact::details::ComponentNode<StoreT>
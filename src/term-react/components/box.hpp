@@ -1,5 +1,4 @@
 #pragma once
-#include <functional>
 #include "../end-component.hpp"
 
 namespace termreact {
@@ -14,10 +13,10 @@ CREATE_END_COMPONENT_CLASS(Box) {
     (int, top, 0)
     (int, height, TERMREACT_FULL_HEIGHT)
     (int, width, TERMREACT_FULL_WIDTH)
-    (std::function<int(int, int)>, getLeft)
-    (std::function<int(int, int)>, getTop)
-    (std::function<int(int, int)>, getHeight)
-    (std::function<int(int, int)>, getWidth)
+    (Callback<int(int, int)>, getLeft)
+    (Callback<int(int, int)>, getTop)
+    (Callback<int(int, int)>, getHeight)
+    (Callback<int(int, int)>, getWidth)
     (uint32_t, border, TERMREACT_NO_BORDER)
     (uint32_t, border_top, TERMREACT_NO_BORDER)
     (uint32_t, border_bottom, TERMREACT_NO_BORDER)
@@ -35,22 +34,30 @@ public:
   END_COMPONENT_WILL_UNMOUNT(Box) {}
   END_COMPONENT_WILL_UPDATE(next_props) {}
 
-  CanvasSlice present(CanvasSlice canvas) {
+  // the part of canvas it draws in, known without drawing
+  static CanvasSlice layout(const Properties& props, CanvasSlice canvas) {
     auto width = canvas.getWidth();
-    if (PROPS(width) != TERMREACT_FULL_WIDTH) width = PROPS(width);
-    else if (PROPS(getWidth)) width = PROPS(getWidth)(canvas.getWidth(), canvas.getHeight());
+    if (PROPS(props, width) != TERMREACT_FULL_WIDTH) width = PROPS(props, width);
+    else if (PROPS(props, getWidth)) width = PROPS(props, getWidth)(canvas.getWidth(), canvas.getHeight());
 
     auto height = canvas.getHeight();
-    if (PROPS(height) != TERMREACT_FULL_HEIGHT) height = PROPS(height);
-    else if (PROPS(getHeight)) height = PROPS(getHeight)(canvas.getWidth(), canvas.getHeight());
+    if (PROPS(props, height) != TERMREACT_FULL_HEIGHT) height = PROPS(props, height);
+    else if (PROPS(props, getHeight)) height = PROPS(props, getHeight)(canvas.getWidth(), canvas.getHeight());
+
+    auto left = PROPS(props, left);
+    if (PROPS(props, getLeft)) left = PROPS(props, getLeft)(canvas.getWidth(), canvas.getHeight());
 
-    auto left = PROPS(left);
-    if (PROPS(getLeft)) left = PROPS(getLeft)(canvas.getWidth(), canvas.getHeight());
+    auto top = PROPS(props, top);
+    if (PROPS(props, getTop)) top = PROPS(props, getTop)(canvas.getWidth(), canvas.getHeight());
 
-    auto top = PROPS(top);
-    if (PROPS(getTop)) top = PROPS(getTop)(canvas.getWidth(), canvas.getHeight());
+    return canvas.slice(left, top, width, height);
+  }
 
-    auto canvas_slice = canvas.slice(left, top, width, height);
+  CanvasSlice present(CanvasSlice canvas) {
+    auto canvas_slice = layout(this->getProps(), canvas);
+    this->setPresentedRect(canvas_slice);
+    auto width = canvas_slice.getWidth();
+    auto height = canvas_slice.getHeight();
 
     auto border_left = PROPS(border_left) == TERMREACT_NO_BORDER ? PROPS(border) : PROPS(border_left);
     if (border_left != TERMREACT_NO_BORDER) {
@@ -1,6 +1,7 @@
 #pragma once
 #include "./component.hpp"
 #include "./event.hpp"
+#include "./hit-test.hpp"
 
 namespace termreact {
 namespace details {
@@ -11,9 +12,22 @@ class EndComponent : public ComponentBase {
 protected:
   using StoreType = StoreT;
   StoreType &store_;
+  // the area the component drew itself in during the last present, in screen coordinates
+  Rect presented_rect_;
+  // the canvas it was given and what self->present() gave the children, the last time it drew
+  Rect canvas_rect_{0, 0, 0, 0}, canvas_clip_{0, 0, 0, 0};
+  CanvasSlice children_canvas_;
+  // what's in its layer is out of date, see the layer prop
+  bool layer_stale_ = true;
 
   EndComponent(StoreType &store) : store_{store} {}
 
+  // components drawing in a part of the canvas they receive should report it here,
+  // otherwise the whole canvas is assumed
+  void setPresentedRect(const CanvasSlice& canvas) {
+    presented_rect_ = canvas.getRect();
+  }
+
   void render_() override {
     // endpoint components do not render new components,
     // so just render children passed to it
@@ -23,22 +37,112 @@ protected:
     }
   }
 
-  void present_(CanvasSlice canvas, bool parent_updated) override {
-    T* self = dynamic_cast<T*>(this);
-    bool should_redraw = parent_updated || updated_;
+  // keep the focus index in tree order, presenting visits every component in that order anyway
+  void placeFocusable_(T *self) {
+    if (self->getProps().template get<T::Properties::Field::focusable>()) {
+      store_.focusIndex().place(self, presented_rect_);
+    }
+  }
+
+  // out of the index, the focus goes to the one after it if it had it
+  void unregisterFocusable_() {
+    Focusable *focusable = static_cast<T*>(this);
+    auto& index = store_.focusIndex();
+    auto next = index.next(focusable);
+    index.remove(focusable);
+    store_.template dispatch<ACTION(BuiltinAction::unregisterFocusable)>(focusable, next);
+  }
+
+  bool sameCanvas_(const CanvasSlice& canvas) const {
+    return canvas.getRect() == canvas_rect_ && canvas.getVisibleRect() == canvas_clip_;
+  }
+
+  void keepCanvas_(const CanvasSlice& canvas) {
+    canvas_rect_ = canvas.getRect();
+    canvas_clip_ = canvas.getVisibleRect();
+  }
 
+  void draw_(T *self, CanvasSlice canvas, bool should_redraw) {
     // we are pure !
     if (should_redraw) {
       // parent may choose to return a wrapped canvas to alter children's behavior
-      CanvasSlice new_canvas = self->present(canvas);
-      for (auto& pc : self->getProps().template get<T::Properties::Field::children>()) {
-        pc->present(new_canvas, should_redraw);
+      presented_rect_ = canvas.getRect();
+      children_canvas_ = self->present(canvas);
+      placeFocusable_(self);
+      // register before children so they end up on top of their parent
+      if (self->getProps().template get<T::Properties::Field::onMouse>()) {
+        canvas.addMouseTarget(presented_rect_, self);
       }
     } else {
+      // where it was drawn last time still stands, and so does what it gave its children
+      placeFocusable_(self);
+      if (self->getProps().template get<T::Properties::Field::onMouse>()) {
+        canvas.addMouseTarget(presented_rect_, self);
+      }
+    }
+    for (auto& pc : self->getProps().template get<T::Properties::Field::children>()) {
+      pc->present(children_canvas_, should_redraw);
+    }
+  }
+
+  // draw the subtree in the buffer of its layer, unless nothing in it changed since the last time.
+  // returns false if the canvas has no layers
+  bool presentLayer_(T *self, CanvasSlice canvas, int z) {
+    bool redraw = layer_stale_ || !sameCanvas_(canvas) || subtreeUpdated_();
+    // a redraw stays in the canvas it's given, otherwise in what was composited last time.
+    // layers in this one's subtree are hidden along with it
+    if (canvas.occluded(redraw ? canvas.getVisibleRect() : presented_rect_, z)) {
+      layer_stale_ = true;
+      placeFocusable_(self);
+      return true;
+    }
+    Canvas *layer = canvas.beginLayer(self, z, redraw);
+    if (!layer) return false;
+    keepCanvas_(canvas);
+    layer_stale_ = false;
+    draw_(self, canvas.retarget(layer), redraw);
+    canvas.endLayer(self, presented_rect_.intersect(canvas.getVisibleRect()));
+    return true;
+  }
+
+  // where it's going to draw, before drawing
+  template <typename C = T, std::enable_if_t<HasLayout<C>::value, int> = 0>
+  CanvasSlice layout_(C *self, CanvasSlice canvas) { return C::layout(self->getProps(), canvas); }
+  template <typename C = T, std::enable_if_t<!HasLayout<C>::value, int> = 0>
+  CanvasSlice layout_(C*, CanvasSlice canvas) { return canvas; }
+
+  void present_(CanvasSlice canvas, bool parent_updated) override {
+    T* self = dynamic_cast<T*>(this);
+    // out of sight, and so are its children as they can't draw out of it
+    auto slice = layout_(self, canvas);
+    if (slice.getVisibleRect().empty()) {
+      presented_rect_ = slice.getRect();
+      placeFocusable_(self);
+      return;
+    }
+    if (int z = self->getProps().template get<T::Properties::Field::layer>()) {
+      if (presentLayer_(self, canvas, z)) return;
+    }
+    // certain to be drawn over by a layer: only the drawing is skipped, its children may be in
+    // layers of their own. what it gave them stands as long as neither it nor its canvas changed
+    if (!updated_ && sameCanvas_(canvas) && canvas.occluded(canvas.getVisibleRect())) {
+      placeFocusable_(self);
       for (auto& pc : self->getProps().template get<T::Properties::Field::children>()) {
-        pc->present(canvas, should_redraw);
+        pc->present(children_canvas_, parent_updated);
       }
+      return;
     }
+    keepCanvas_(canvas);
+    draw_(self, canvas, parent_updated || updated_);
+  }
+
+  bool subtreeUpdated_() const override {
+    if (updated_) return true;
+    T const* self = dynamic_cast<T const*>(this);
+    for (auto& pc : self->getProps().template get<T::Properties::Field::children>()) {
+      if (pc->subtreeUpdated()) return true;
+    }
+    return false;
   }
   
   // does nothing by default, custom component may override it to update its props
@@ -60,17 +164,16 @@ public:
 #define CREATE_END_COMPONENT_CLASS(cname) \
   template <typename StoreT> class cname : \
     public ::termreact::details::EndComponent<StoreT, cname<StoreT>>, \
-    public ::termreact::details::Focusable
+    public ::termreact::details::Focusable, \
+    public ::termreact::details::MouseTarget
 
 #define BASE_END_RENDERER ::termreact::details::EndComponent<std::decay_t<decltype(*this)>>::render_
 
 #define END_COMPONENT_WILL_MOUNT(cname) \
   cname(Properties props, StoreT& store): \
     ::termreact::details::EndComponent<StoreT, cname<StoreT>>{store}, props_{std::move(props)} { \
-      if (PROPS(focusable)) { \
-        DISPATCH(::termreact::details::BuiltinAction::rescanFocusable)(); \
-        DISPATCH(::termreact::details::BuiltinAction::stopFocusableScanning)(); \
-      } \
+      /* its position is settled the next time it gets presented */ \
+      if (PROPS(focusable)) this->store_.focusIndex().insert(this); \
     } \
   void onFocus() override { \
     auto &onFocus = PROPS(onFocus); \
@@ -84,16 +187,15 @@ public:
     auto &onKeyPress = PROPS(onKeyPress); \
     if (onKeyPress) onKeyPress(evt); \
   } \
+  void onMouse(MouseEvent evt) override { \
+    auto &onMouse = PROPS(onMouse); \
+    if (onMouse) onMouse(evt); \
+  } \
   void componentWillMount()
 
 #define END_COMPONENT_WILL_UNMOUNT(cname) \
   ~cname() { \
-    if (PROPS(focusable)) { \
-      DISPATCH(::termreact::details::BuiltinAction::unregisterFocusable)( \
-        STATE_FIELD(this->store_, focusables).build, \
-        static_cast<::termreact::details::Focusable*>(this) \
-      ); \
-    } \
+    if (PROPS(focusable)) this->unregisterFocusable_(); \
     customComponentWillUnmount_(); \
   } \
   void customComponentWillUnmount_()
@@ -102,16 +204,10 @@ public:
   void componentWillUpdate(const Properties &next_props) { \
     if ((PROPS(focusable) != PROPS(next_props, focusable))) { \
       if (PROPS(focusable)) { \
-        DISPATCH(::termreact::details::BuiltinAction::unregisterFocusable)( \
-          STATE_FIELD(this->store_, focusables).build, \
-          static_cast<::termreact::details::Focusable*>(this) \
-        ); \
+        this->unregisterFocusable_(); \
       } else if (PROPS(next_props, focusable)) { \
-        CHUNK_DISPATCH_BEGIN; \
-        DISPATCH(::termreact::details::BuiltinAction::rescanFocusable)(); \
-        DISPATCH(::termreact::details::BuiltinAction::stopFocusableScanning)(); \
-        CHUNK_DISPATCH_END; \
-        DISPATCH(::termreact::details::BuiltinAction::selectFocus)(); \
+        this->store_.focusIndex().insert(this); \
+        DISPATCH(::termreact::details::BuiltinAction::selectFocus)(std::cref(this->store_.focusIndex())); \
       } \
     } \
     customComponentWillUpdate_(next_props); \
@@ -121,24 +217,23 @@ public:
 #define ADD_END_COMPONENT_BUILTIN_PROPS_FIELDS(fields) \
   fields \
   (bool, focusable) \
-  (::std::function<void()>, onFocus) \
-  (::std::function<void()>, onLostFocus) \
-  (::termreact::EventHandler, onKeyPress)
+  /* draw in a layer of this z, see Canvas::beginLayer(). 0 for none */ \
+  (int, layer) \
+  /* only mounted once presented in sight, for components with a static layout() */ \
+  (bool, lazy) \
+  (::termreact::Callback<void()>, onFocus) \
+  (::termreact::Callback<void()>, onLostFocus) \
+  (::termreact::EventHandler, onKeyPress) \
+  (::termreact::MouseHandler, onMouse)
   
 #define DECL_END_PROPS(fields) \
   DECL_PROPS(ADD_END_COMPONENT_BUILTIN_PROPS_FIELDS(fields));
 
 #define MAP_STATE_TO_END_PROPS(updaters) void onStoreUpdate_(const void *next_state_p) override { \
     auto& next_state = *static_cast<const typename StoreT::StateType*>(next_state_p); \
+    (void)next_state; /* unused without updaters */ \
     Properties next_props = getProps(); \
     BOOST_PP_SEQ_FOR_EACH(MAP_STATE_TO_PROPS_OP, _, BOOST_PP_VARIADIC_SEQ_TO_SEQ(updaters)) \
-    /* response to focusable rescanning */ \
-    if (STATE_FIELD(next_state, focusables).rescanning && PROPS(next_props, focusable)) { \
-      DISPATCH(::termreact::details::BuiltinAction::registerFocusable)( \
-        STATE_FIELD(next_state, focusables).build, \
-        static_cast<::termreact::details::Focusable*>(this) \
-      ); \
-    } \
     if (next_props != getProps()) { \
       ::termreact::details::renderComponent<std::decay_t<decltype(*this)>>(*this, std::move(next_props)); \
     } \
@@ -1,10 +1,11 @@
 #pragma once
-#include <vector>
+#include <memory>
 #include <functional>
-#include <algorithm>
 #include "./action.hpp"
 #include "./reducer.hpp"
 #include "./component.hpp"
+#include "./utils/callback.hpp"
+#include "./focus-index.hpp"
 
 namespace termreact {
 
@@ -14,7 +15,17 @@ struct Event {
   uint32_t ch;
 };
 
-using EventHandler = std::function<void(Event)>;
+using EventHandler = Callback<void(Event)>;
+
+struct MouseEvent {
+  uint8_t mod;
+  // one of TB_KEY_MOUSE_*
+  uint16_t key;
+  // relative to the top-left corner of the component receiving the event
+  int x, y;
+};
+
+using MouseHandler = Callback<void(MouseEvent)>;
 
 namespace details {
 
@@ -25,73 +36,46 @@ public:
   virtual void onKeyPress(Event) = 0;
 };
 
+// only the focus is state. the index of focusables lives next to the state in the store (see
+// focusIndex()), focusables add and remove themselves as they mount and unmount, and the reducers
+// moving the focus get it as a payload to read from
 struct FocusableStore {
-  bool rescanning;
-  size_t build;
   Focusable *focus;
-  std::vector<Focusable*> focusables;
-};
 
-INIT_REDUCER(focusableReducer, () { return FocusableStore{ false, 0, nullptr, {} }; });
+  bool operator==(const FocusableStore& other) const { return focus == other.focus; }
+  bool operator!=(const FocusableStore& other) const { return !(*this == other); }
+};
 
-// rescan is triggered by adding new focusables, in which case we need to know the right place for them
-// the current focus should be reserved as it won't be deleted anyway
-REDUCER(focusableReducer, (BuiltinAction::rescanFocusable), (FocusableStore prev) {
-  return FocusableStore{ true, prev.build + 1, prev.focus, {} };
-});
+INIT_REDUCER(focusableReducer, () { return FocusableStore{ nullptr }; });
 
-// the paired action of rescan, also triggered by adding focusables.
-REDUCER(focusableReducer, (BuiltinAction::stopFocusableScanning), (FocusableStore prev) {
-  return FocusableStore{ false, prev.build, prev.focus, std::move(prev.focusables) };
+// select a new focus only when there's no previous one
+REDUCER(focusableReducer, (BuiltinAction::selectFocus), (FocusableStore prev, const FocusIndex& index) {
+  if (prev.focus != nullptr) return prev;
+  return FocusableStore{ index.first() };
 });
 
-// select a new focus only when there's no previous one
-REDUCER(focusableReducer, (BuiltinAction::selectFocus), (FocusableStore prev) {
-  auto new_focus = prev.focus;
-  if (new_focus == nullptr && prev.focusables.size() != 0) {
-    new_focus = prev.focusables[0];
-  }
-  return FocusableStore{ prev.rescanning, prev.build, new_focus, std::move(prev.focusables) };
+// triggered by removing a focusable, next is the one after it in the index before it was removed.
+// switch to next if the current focus is being removed
+REDUCER(focusableReducer, (BuiltinAction::unregisterFocusable),
+        (FocusableStore prev, Focusable *focusable, Focusable *next) {
+  if (focusable != prev.focus) return prev;
+  return FocusableStore{ next == focusable ? nullptr : next };
 });
 
-// focusables dispatch register action as the response to the scanning
-REDUCER(focusableReducer, (BuiltinAction::registerFocusable), (FocusableStore prev, size_t build, Focusable *focusable) {
-  if (build != prev.build) return prev;
-  auto focusables = std::move(prev.focusables);
-  focusables.push_back(focusable);
-  return FocusableStore{ prev.rescanning, prev.build, prev.focus, std::move(focusables) };
+REDUCER(focusableReducer, (BuiltinAction::nextFocus), (FocusableStore prev, const FocusIndex& index) {
+  return FocusableStore{ index.next(prev.focus) };
 });
 
-// triggered by removing a focusable. switch to next if the current focus is being removed.
-REDUCER(focusableReducer, (BuiltinAction::unregisterFocusable), (FocusableStore prev, size_t build, Focusable *focusable) {
-  if (build != prev.build) return prev;
-  auto focusables = std::move(prev.focusables);
-  auto new_focus = prev.focus;
-  auto cur = std::find(focusables.begin(), focusables.end(), focusable);
-  if (focusable == prev.focus) {
-    if ((cur + 1) == focusables.end()) {
-      if (focusables.size() == 1) {
-        new_focus = nullptr;
-      } else {
-        new_focus = focusables[0];
-      }
-    } else {
-      new_focus = *(cur + 1);
-    }
-  }     
-  focusables.erase(cur);
-  return FocusableStore{ prev.rescanning, prev.build, new_focus, std::move(focusables) };
+REDUCER(focusableReducer, (BuiltinAction::prevFocus), (FocusableStore prev, const FocusIndex& index) {
+  return FocusableStore{ index.prev(prev.focus) };
 });
 
-REDUCER(focusableReducer, (BuiltinAction::nextFocus), (FocusableStore prev) {
-  auto focus = prev.focus;
-  auto cur = std::find(prev.focusables.begin(), prev.focusables.end(), prev.focus);
-  if ((cur + 1) == prev.focusables.end()) {
-    focus = prev.focusables[0];
-  } else {
-    focus = *(cur + 1);
-  }
-  return FocusableStore{ prev.rescanning, prev.build, focus, std::move(prev.focusables) };
+// keep the focus if there is nothing in that direction
+REDUCER(focusableReducer, (BuiltinAction::moveFocus),
+        (FocusableStore prev, const FocusIndex& index, FocusDirection direction) {
+  auto focus = index.move(prev.focus, direction);
+  if (focus == nullptr) return prev;
+  return FocusableStore{ focus };
 });
 
 }
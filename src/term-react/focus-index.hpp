@@ -0,0 +1,217 @@
+#pragma once
+#include <set>
+#include <vector>
+#include <limits>
+#include <iterator>
+#include <utility>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+#include "./canvas.hpp"
+
+namespace termreact {
+
+enum class FocusDirection {
+  Left,
+  Right,
+  Up,
+  Down
+};
+
+namespace details {
+
+class Focusable;
+
+// focusables ordered the way they appear in the component tree, plus their
+// presented rectangles for directional navigation.
+// focusables enter and leave as they mount and unmount; their tree position
+// is refreshed while presenting, which visits the tree in order anyway, so
+// only the entries that actually moved get re-inserted.
+class FocusIndex {
+private:
+  // focusables mounted but not presented yet go after everything presented,
+  // in mount order, which is tree order within a freshly mounted subtree
+  static constexpr std::uint64_t unplaced_order_ = std::uint64_t{1} << 62;
+
+  // (tree order, focusable), the pointer only breaks ties between stale entries
+  using OrderKey = std::pair<std::uint64_t, Focusable*>;
+  // (doubled center coordinate along one axis, focusable)
+  using AxisKey = std::pair<int, Focusable*>;
+
+  struct Entry {
+    std::uint64_t order;
+    bool placed;
+    Rect rect;
+    // the present that placed it last
+    std::uint64_t present;
+  };
+
+  std::set<OrderKey> order_;
+  std::set<AxisKey> by_x_, by_y_;
+  std::unordered_map<Focusable*, Entry> entries_;
+  std::uint64_t next_unplaced_order_ = unplaced_order_;
+  std::uint64_t next_present_order_ = 0;
+  std::uint64_t present_ = 0;
+
+  static int centerX_(const Rect& rect) { return rect.x * 2 + rect.width; }
+  static int centerY_(const Rect& rect) { return rect.y * 2 + rect.height; }
+
+  void unplace_(Focusable *focusable, const Entry& entry) {
+    if (!entry.placed) return;
+    by_x_.erase(AxisKey{centerX_(entry.rect), focusable});
+    by_y_.erase(AxisKey{centerY_(entry.rect), focusable});
+  }
+
+  // walk away from the current focus along one axis, stopping once the distance
+  // along that axis alone can't beat the best candidate found so far
+  template <typename It>
+  static Focusable* closest_(It begin, It end, int origin, int cross_origin, bool (*in_direction)(int, int),
+                             int (*cross_center)(const Rect&), const std::unordered_map<Focusable*, Entry>& entries) {
+    Focusable *best = nullptr;
+    long best_score = std::numeric_limits<long>::max();
+    for (auto it = begin; it != end; ++it) {
+      long distance = std::abs(it->first - origin);
+      if (distance >= best_score) break;
+      if (!in_direction(it->first, origin)) continue;
+      long cross = std::abs(cross_center(entries.at(it->second).rect) - cross_origin);
+      // prefer staying in the same row / column
+      long score = distance + cross * 2;
+      if (score < best_score) {
+        best_score = score;
+        best = it->second;
+      }
+    }
+    return best;
+  }
+
+public:
+  bool contains(Focusable *focusable) const {
+    return entries_.count(focusable) != 0;
+  }
+
+  std::size_t size() const {
+    return entries_.size();
+  }
+
+  void insert(Focusable *focusable) {
+    if (contains(focusable)) return;
+    auto order = next_unplaced_order_++;
+    entries_.emplace(focusable, Entry{order, false, Rect{0, 0, 0, 0}, 0});
+    order_.emplace(order, focusable);
+  }
+
+  void remove(Focusable *focusable) {
+    auto it = entries_.find(focusable);
+    if (it == entries_.end()) return;
+    order_.erase(OrderKey{it->second.order, focusable});
+    unplace_(focusable, it->second);
+    entries_.erase(it);
+  }
+
+  // the tree is about to be presented from the root
+  void beginPresent() {
+    next_present_order_ = 0;
+    present_++;
+  }
+
+  // the tree has been presented. the focusables it didn't get to, in culled or occluded subtrees,
+  // still have orders from earlier presents that may have been handed out again since. they go
+  // back after everything presented, in the order they had, and out of the directional search
+  void endPresent() {
+    std::vector<Focusable*> stale;
+    for (auto& key : order_) {
+      if (key.first >= unplaced_order_) break;
+      if (entries_.at(key.second).present != present_) stale.push_back(key.second);
+    }
+    for (auto focusable : stale) {
+      auto& entry = entries_.at(focusable);
+      order_.erase(OrderKey{entry.order, focusable});
+      unplace_(focusable, entry);
+      entry.placed = false;
+      entry.order = next_unplaced_order_++;
+      order_.emplace(entry.order, focusable);
+    }
+  }
+
+  // record where a focusable has been presented. must be called in tree order
+  // for every focusable presented after beginPresent()
+  void place(Focusable *focusable, const Rect& rect) {
+    auto order = next_present_order_++;
+    auto it = entries_.find(focusable);
+    if (it == entries_.end()) return;
+    auto& entry = it->second;
+    entry.present = present_;
+
+    if (entry.order != order) {
+      order_.erase(OrderKey{entry.order, focusable});
+      order_.emplace(order, focusable);
+      entry.order = order;
+    }
+
+    if (!entry.placed || entry.rect.x != rect.x || entry.rect.y != rect.y ||
+        entry.rect.width != rect.width || entry.rect.height != rect.height) {
+      unplace_(focusable, entry);
+      entry.placed = true;
+      entry.rect = rect;
+      by_x_.emplace(centerX_(rect), focusable);
+      by_y_.emplace(centerY_(rect), focusable);
+    }
+  }
+
+  Focusable* first() const {
+    return order_.empty() ? nullptr : order_.begin()->second;
+  }
+
+  // the focusable after the given one in tree order, wrapping around.
+  // starts from the first one if the given one isn't known
+  Focusable* next(Focusable *focusable) const {
+    auto entry = entries_.find(focusable);
+    if (entry == entries_.end()) return first();
+    auto it = order_.upper_bound(OrderKey{entry->second.order, focusable});
+    if (it == order_.end()) it = order_.begin();
+    return it->second;
+  }
+
+  // the focusable before the given one in tree order, wrapping around
+  Focusable* prev(Focusable *focusable) const {
+    if (order_.empty()) return nullptr;
+    auto entry = entries_.find(focusable);
+    if (entry == entries_.end()) return std::prev(order_.end())->second;
+    auto it = order_.lower_bound(OrderKey{entry->second.order, focusable});
+    if (it == order_.begin()) it = order_.end();
+    return std::prev(it)->second;
+  }
+
+  // the presented focusable closest to the given one in a direction, or
+  // nullptr if there is none. focusables never presented are not considered
+  Focusable* move(Focusable *focusable, FocusDirection direction) const {
+    auto entry = entries_.find(focusable);
+    if (entry == entries_.end() || !entry->second.placed) return nullptr;
+    auto& rect = entry->second.rect;
+    auto forward = [] (int pos, int origin) { return pos > origin; };
+    auto backward = [] (int pos, int origin) { return pos < origin; };
+
+    switch (direction) {
+    case FocusDirection::Right: {
+      auto from = by_x_.upper_bound(AxisKey{centerX_(rect), nullptr});
+      return closest_(from, by_x_.end(), centerX_(rect), centerY_(rect), forward, centerY_, entries_);
+    }
+    case FocusDirection::Left: {
+      auto from = std::make_reverse_iterator(by_x_.lower_bound(AxisKey{centerX_(rect), nullptr}));
+      return closest_(from, by_x_.rend(), centerX_(rect), centerY_(rect), backward, centerY_, entries_);
+    }
+    case FocusDirection::Down: {
+      auto from = by_y_.upper_bound(AxisKey{centerY_(rect), nullptr});
+      return closest_(from, by_y_.end(), centerY_(rect), centerX_(rect), forward, centerX_, entries_);
+    }
+    case FocusDirection::Up: {
+      auto from = std::make_reverse_iterator(by_y_.lower_bound(AxisKey{centerY_(rect), nullptr}));
+      return closest_(from, by_y_.rend(), centerY_(rect), centerX_(rect), backward, centerX_, entries_);
+    }
+    }
+    return nullptr;
+  }
+};
+
+}
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <unordered_map>
+#include "./canvas.hpp"
+#include "./event.hpp"
+
+namespace termreact {
+namespace details {
+
+class HitTestIndex;
+
+// anything that can receive mouse events routed by a HitTestIndex
+class MouseTarget {
+private:
+  // the index this target is registered in, so it can leave before being destroyed
+  HitTestIndex *hit_test_index_ = nullptr;
+
+public:
+  virtual void onMouse(MouseEvent) = 0;
+  virtual ~MouseTarget();
+
+  friend class HitTestIndex;
+};
+
+// maps screen positions to the topmost mouse target covering it.
+// it's painted just like the canvas: every row keeps a list of disjoint segments,
+// each owned by the target painted last over it, so a query is a single
+// binary search in one row instead of a walk over the component tree.
+class HitTestIndex {
+private:
+  struct Segment {
+    int end;
+    MouseTarget *target;
+  };
+  // keyed by the first column of the segment
+  using Row = std::map<int, Segment>;
+
+  std::vector<Row> rows_;
+  // the last rectangle painted for each target, used to translate coordinates and to unregister
+  std::unordered_map<MouseTarget*, Rect> targets_;
+  // bumped whenever a target leaves, a repaint of the same targets can't be skipped then
+  unsigned long removals_ = 0;
+
+  // remove [begin, end) from a row, splitting segments crossing the boundaries
+  static void erase_(Row& row, int begin, int end) {
+    auto it = row.lower_bound(begin);
+    if (it != row.begin()) {
+      auto prev = std::prev(it);
+      if (prev->second.end > begin) {
+        if (prev->second.end > end) {
+          row.emplace(end, prev->second);
+        }
+        prev->second.end = begin;
+      }
+    }
+    while (it != row.end() && it->first < end) {
+      if (it->second.end > end) {
+        row.emplace(end, it->second);
+      }
+      it = row.erase(it);
+    }
+  }
+
+  void unpaint_(MouseTarget *target, const Rect& rect) {
+    int y_end = std::min<int>(rect.y + rect.height, rows_.size());
+    for (int y = std::max(rect.y, 0); y < y_end; ++y) {
+      auto& row = rows_[y];
+      auto it = row.upper_bound(rect.x);
+      if (it != row.begin()) --it;
+      while (it != row.end() && it->first < rect.x + rect.width) {
+        if (it->second.target == target) {
+          it = row.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+public:
+  HitTestIndex() = default;
+  HitTestIndex(const HitTestIndex&) = delete;
+  HitTestIndex& operator = (const HitTestIndex&) = delete;
+
+  ~HitTestIndex() {
+    clear();
+  }
+
+  void clear() {
+    for (auto& entry : targets_) {
+      entry.first->hit_test_index_ = nullptr;
+    }
+    targets_.clear();
+    for (auto& row : rows_) {
+      row.clear();
+    }
+  }
+
+  // register target on top of everything painted before
+  void paint(const Rect& rect, MouseTarget *target) {
+    paint(rect, rect, target);
+  }
+
+  // only the part of rect inside visible gets hit, rect is still what hitTest() reports
+  void paint(const Rect& rect, const Rect& visible, MouseTarget *target) {
+    auto registered = targets_.find(target);
+    if (registered != targets_.end()) {
+      unpaint_(target, registered->second);
+      registered->second = rect;
+    } else {
+      if (target->hit_test_index_ && target->hit_test_index_ != this) {
+        target->hit_test_index_->remove(target);
+      }
+      targets_.emplace(target, rect);
+      target->hit_test_index_ = this;
+    }
+
+    auto area = rect.intersect(visible);
+    if (area.empty()) return;
+    if (static_cast<int>(rows_.size()) < area.y + area.height) {
+      rows_.resize(area.y + area.height);
+    }
+    for (int y = std::max(area.y, 0); y < area.y + area.height; ++y) {
+      erase_(rows_[y], area.x, area.x + area.width);
+      rows_[y].emplace(area.x, Segment{area.x + area.width, target});
+    }
+  }
+
+  void remove(MouseTarget *target) {
+    auto registered = targets_.find(target);
+    if (registered == targets_.end()) return;
+    unpaint_(target, registered->second);
+    targets_.erase(registered);
+    target->hit_test_index_ = nullptr;
+    removals_++;
+  }
+
+  unsigned long removals() const {
+    return removals_;
+  }
+
+  // returns the topmost target at (x, y), or nullptr. rect receives the area it was registered with
+  MouseTarget* hitTest(int x, int y, Rect *rect = nullptr) const {
+    if (y < 0 || y >= static_cast<int>(rows_.size())) return nullptr;
+    auto& row = rows_[y];
+    auto it = row.upper_bound(x);
+    if (it == row.begin()) return nullptr;
+    --it;
+    if (x >= it->second.end) return nullptr;
+    if (rect) *rect = targets_.at(it->second.target);
+    return it->second.target;
+  }
+};
+
+inline MouseTarget::~MouseTarget() {
+  if (hit_test_index_) hit_test_index_->remove(this);
+}
+
+}
+}
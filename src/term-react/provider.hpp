@@ -68,13 +68,16 @@ public:
     );
 
     store.addListener([this] (const State&, const State& next_state) {
-      dynamic_cast<C<StoreT>*>(getRootElm_().get())->onStoreUpdate(static_cast<const void*>(&next_state));
+      // gone while the tree unmounts
+      if (auto root = dynamic_cast<C<StoreT>*>(getRootElm_().get())) {
+        root->onStoreUpdate(static_cast<const void*>(&next_state));
+      }
     }, false);
 
     store.startChunkDispatch();
     render_(details::createComponent<CT>(typename CT::Properties{}, store));
     store.endChunkDispatch();
-    store.template dispatch<ACTION(::termreact::details::BuiltinAction::selectFocus)>();
+    store.template dispatch<ACTION(::termreact::details::BuiltinAction::selectFocus)>(std::cref(store.focusIndex()));
   }
 };
 
@@ -0,0 +1,230 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "./termbox.hpp"
+
+// linux only, it's built on epoll
+
+namespace termreact {
+namespace details {
+
+// one terminal with its own store and component tree, driven through Termbox::step()
+class ReactorSession {
+private:
+  // the files of the terminal and the timer for its next step, all level triggered. the reactor
+  // waits on this one as a whole, so a session is only ever handled by one thread at a time
+  int epoll_fd_;
+  int timer_fd_;
+  // never contended, only there so that what a thread did to the session happens before
+  // what the next one does, as far as the language is concerned (epoll doesn't count)
+  std::mutex lock_;
+
+  virtual Termbox& termbox_() = 0;
+
+public:
+  std::uint64_t id;
+
+  ReactorSession() : epoll_fd_{-1}, timer_fd_{-1}, id{0} {}
+
+  virtual ~ReactorSession() {
+    if (timer_fd_ >= 0) ::close(timer_fd_);
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+  }
+
+  int epollFd() const { return epoll_fd_; }
+
+  // held while processing the session and arming it again
+  std::mutex& lock() { return lock_; }
+
+  void watch() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd_ < 0 || timer_fd_ < 0) throw std::runtime_error("can't create the files of a session");
+    int fds[4];
+    termbox_().eventFds(fds);
+    fds[3] = timer_fd_;
+    for (int fd : fds) {
+      epoll_event ev{};
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+  }
+
+  // steps the terminal and sets the timer for the next step. false once the session is over
+  bool process(std::chrono::microseconds frame_duration) {
+    std::uint64_t expirations;
+    while (::read(timer_fd_, &expirations, sizeof(expirations)) > 0) {}
+    if (!termbox_().step(frame_duration)) return false;
+
+    auto next = termbox_().nextStepIn().count();
+    itimerspec spec{};
+    // a zero timer is a disarmed one, due now is the smallest delay there is
+    spec.it_value.tv_sec = next / 1000000;
+    spec.it_value.tv_nsec = next > 0 ? (next % 1000000) * 1000 : 1;
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+    return true;
+  }
+
+  void notifyResize() { termbox_().notifyResize(); }
+};
+
+template <template <typename> class App, typename StoreT>
+class TermboxSession : public ReactorSession {
+private:
+  // freed last, after the Termbox has shut the terminal down
+  struct Context {
+    tb_context *context = tb_context_new();
+    ~Context() { tb_context_free(context); }
+  } context_;
+  StoreT store_;
+  Termbox termbox_impl_;
+
+  Termbox& termbox_() override { return termbox_impl_; }
+
+public:
+  template <typename... ExitPredicates>
+  TermboxSession(int fd, const std::function<void(StoreT&, Termbox&)>& setup, ExitPredicates&&... exit_predicates)
+  : context_{}, store_{}, termbox_impl_{store_, context_.context, fd} {
+    if (setup) setup(store_, termbox_impl_);
+    termbox_impl_.render<App>(store_, std::forward<ExitPredicates>(exit_predicates)...);
+  }
+};
+
+}
+
+// serves many terminals at once, each with a store and a component tree of its own, on a few
+// threads. a session ends when its app exits or its terminal goes away
+class Reactor {
+public:
+  using SessionId = std::uint64_t;
+
+private:
+  int epoll_fd_;
+  // readable once the reactor stops, wakes every worker up
+  int stop_fd_;
+  std::chrono::microseconds frame_duration_;
+  std::vector<std::thread> workers_;
+  std::mutex lock_;
+  std::unordered_map<SessionId, std::unique_ptr<details::ReactorSession>> sessions_;
+  SessionId next_id_;
+
+  void arm_(details::ReactorSession *session, int op) {
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = session;
+    epoll_ctl(epoll_fd_, op, session->epollFd(), &ev);
+  }
+
+  void close_(details::ReactorSession *session) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, session->epollFd(), nullptr);
+    std::unique_ptr<details::ReactorSession> closed;
+    {
+      std::lock_guard<std::mutex> guard{lock_};
+      auto it = sessions_.find(session->id);
+      closed = std::move(it->second);
+      sessions_.erase(it);
+    }
+    // shuts the terminal down outside of the lock
+  }
+
+  void work_() {
+    epoll_event ev;
+    while (true) {
+      int n = epoll_wait(epoll_fd_, &ev, 1, -1);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 || ev.data.ptr == nullptr) return;
+      auto session = static_cast<details::ReactorSession*>(ev.data.ptr);
+      std::unique_lock<std::mutex> guard{session->lock()};
+      bool alive;
+      try {
+        alive = session->process(frame_duration_);
+      } catch (...) {
+        alive = false;
+      }
+      // one shot, nobody else can have it until it's armed again
+      if (alive) {
+        arm_(session, EPOLL_CTL_MOD);
+      } else {
+        guard.unlock();
+        close_(session);
+      }
+    }
+  }
+
+public:
+  explicit Reactor(unsigned threads = std::thread::hardware_concurrency(),
+                   std::chrono::microseconds frame_duration = std::chrono::microseconds{16667})
+  : epoll_fd_{epoll_create1(EPOLL_CLOEXEC)}, stop_fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+    frame_duration_{frame_duration}, next_id_{1} {
+    if (epoll_fd_ < 0 || stop_fd_ < 0) throw std::runtime_error("can't create the reactor");
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &ev);
+    for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+      workers_.emplace_back([this] () { work_(); });
+    }
+  }
+
+  ~Reactor() {
+    std::uint64_t one = 1;
+    ssize_t r = ::write(stop_fd_, &one, sizeof(one));
+    (void)r;
+    for (auto& worker : workers_) worker.join();
+    sessions_.clear();
+    ::close(stop_fd_);
+    ::close(epoll_fd_);
+  }
+
+  Reactor(const Reactor&) = delete;
+  Reactor& operator=(const Reactor&) = delete;
+
+  // runs App on the tty fd, which the session closes when it ends. setup (may be nullptr) gets to configure
+  // the store and the Termbox before the first render, exit_predicates are the ones of Provider::render
+  template <template <typename> class App, typename StoreT, typename... ExitPredicates>
+  SessionId open(int fd, std::function<void(StoreT&, Termbox&)> setup, ExitPredicates&&... exit_predicates) {
+    std::unique_ptr<details::ReactorSession> session{
+      new details::TermboxSession<App, StoreT>{fd, setup, std::forward<ExitPredicates>(exit_predicates)...}
+    };
+    session->watch();
+    auto raw = session.get();
+    SessionId id;
+    {
+      std::lock_guard<std::mutex> guard{lock_};
+      id = raw->id = next_id_++;
+      sessions_.emplace(id, std::move(session));
+    }
+    arm_(raw, EPOLL_CTL_ADD);
+    return id;
+  }
+
+  // the tty of a session got resized (ptys we don't control get no SIGWINCH). false if it's over
+  bool notifyResize(SessionId id) {
+    std::lock_guard<std::mutex> guard{lock_};
+    auto it = sessions_.find(id);
+    if (it == sessions_.end()) return false;
+    it->second->notifyResize();
+    return true;
+  }
+
+  std::size_t sessions() {
+    std::lock_guard<std::mutex> guard{lock_};
+    return sessions_.size();
+  }
+};
+
+}
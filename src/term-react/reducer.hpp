@@ -11,6 +11,12 @@ template <typename T, T V> class EnumValue {};
 
 }
 
+// the first parameter is the previous value of the field, taken either
+//   - by value or const reference, returning the next value
+//   - by rvalue reference, returning the next value, e.g. (std::vector<int>&& prev) { prev.push_back(1); return std::move(prev); }
+//   - by mutable reference, updating it in place and returning nothing
+// the last two don't copy the field into the reducer and back, but the state always counts as changed
+// after them. it's still copied once per dispatch while listeners hold on to the previous state
 #define REDUCER(name, action_tags, ...) \
   template <typename...> struct name; \
   template <> struct name<ACTION(BOOST_PP_SEQ_ENUM(action_tags))> { \
@@ -33,11 +39,17 @@ INIT_REDUCER(windowWidthReducer, () { return -1; });
 REDUCER(windowWidthReducer, (BuiltinAction::UpdateWindowWidth), (int, int new_width) {
   return new_width;
 });
+REDUCER(windowWidthReducer, (BuiltinAction::UpdateWindowSize), (int, int new_width, int) {
+  return new_width;
+});
 
 INIT_REDUCER(windowHeightReducer, () { return -1; });
 REDUCER(windowHeightReducer, (BuiltinAction::UpdateWindowHeight), (int, int new_height) {
   return new_height;
 });
+REDUCER(windowHeightReducer, (BuiltinAction::UpdateWindowSize), (int, int, int new_height) {
+  return new_height;
+});
 
 }
 
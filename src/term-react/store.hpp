@@ -1,4 +1,7 @@
 #pragma once
+#include <tuple>
+#include <atomic>
+#include <utility>
 #include <vector>
 #include <deque>
 #include <functional>
@@ -7,29 +10,71 @@
 #include <boost/preprocessor/tuple.hpp>
 #include <boost/preprocessor/variadic.hpp>
 #include "./utils/immutable-struct.hpp"
-#include "./utils/apply-tuple.hpp"
+#include "./utils/mpsc-queue.hpp"
 #include "./action.hpp"
 #include "./reducer.hpp"
 #include "./event.hpp"
 
 namespace termreact {
+
 namespace details {
 
 using InitStore = EnumValue<BuiltinAction, BuiltinAction::InitStore>;
 
+// the type a reducer takes the previous value as
+template <typename F> struct ReducerPrev;
+template <typename R, typename P, typename... Ps>
+struct ReducerPrev<R(*)(P, Ps...)> { using type = P; };
+
+// how a reducer wants the previous value: a copy or const reference (and return the next value),
+// an rvalue (and return the next value), or a mutable reference (and update it in place)
+enum class ReducerForm { Value, RValue, InPlace };
+
+template <typename Reducer>
+constexpr ReducerForm reducerForm() {
+  using P = typename ReducerPrev<decltype(&Reducer::reduce)>::type;
+  return std::is_rvalue_reference<P>::value ? ReducerForm::RValue :
+    (std::is_lvalue_reference<P>::value && !std::is_const<std::remove_reference_t<P>>::value) ? ReducerForm::InPlace :
+    ReducerForm::Value;
+}
+
 template <typename Reducer, typename StateType, typename StateType::Field Field>
 struct UpdateStoreState {
 
-  template <typename...>
-  static void run(...) {}
+  // the field has no reducer for this action. takes the payload by reference too,
+  // passing it through an ellipsis would copy it for every such field
+  template <typename Tuple, typename R = Reducer, std::enable_if_t<!R::valid, int> = 0>
+  static void run(const StateType&, StateType&, const Tuple&) {}
+
+  // the payload stays in the dispatched tuple and is passed to every reducer as const lvalues,
+  // reducers taking it by const reference never copy it
+  template <typename... Ts, typename R = Reducer, std::enable_if_t<R::valid, int> = 0>
+  static void run(const StateType &state, StateType &next_state, const std::tuple<Ts...>& payload) {
+    reduce_(state, next_state, payload, std::index_sequence_for<Ts...>{},
+            std::integral_constant<ReducerForm, reducerForm<Reducer>()>{});
+  }
+
+private:
+  template <typename Tuple, std::size_t... I>
+  static void reduce_(const StateType &state, StateType &next_state, const Tuple& payload, std::index_sequence<I...>,
+                      std::integral_constant<ReducerForm, ReducerForm::Value>) {
+    next_state.template update<Field>(Reducer::reduce(state.template get<Field>(), std::get<I>(payload)...));
+  }
+
+  // the reducer gets next_state's own copy of the field, nothing is copied on the way in or out.
+  // that copy is only made if the tuple is still shared with the previous state kept for the
+  // listeners: once per dispatch, by the first field mutated or changed in it
+  template <typename Tuple, std::size_t... I>
+  static void reduce_(const StateType&, StateType &next_state, const Tuple& payload, std::index_sequence<I...>,
+                      std::integral_constant<ReducerForm, ReducerForm::RValue>) {
+    auto& field = next_state.template mutate<Field>();
+    field = Reducer::reduce(std::move(field), std::get<I>(payload)...);
+  }
 
-  template <typename Tuple, typename = std::enable_if_t<Reducer::valid>>
-  static void run(const StateType &state, StateType &next_state, Tuple t) {
-    next_state.template update<Field>(ApplyTuple<std::decay_t<decltype(state.template get<Field>())>>::apply(
-      Reducer::reduce,
-      t,
-      state.template get<Field>()
-    ));
+  template <typename Tuple, std::size_t... I>
+  static void reduce_(const StateType&, StateType &next_state, const Tuple& payload, std::index_sequence<I...>,
+                      std::integral_constant<ReducerForm, ReducerForm::InPlace>) {
+    Reducer::reduce(next_state.template mutate<Field>(), std::get<I>(payload)...);
   }
 
 };
@@ -75,42 +120,122 @@ struct UpdateStoreState {
     StateType state_; \
     int in_processing_dispatches_; \
     std::vector<Listener> listeners_; \
-    std::deque<std::function<void(const StateType&, StateType&)>> pending_dispatches_; \
+    using PendingDispatches = std::deque<std::function<void(const StateType&, StateType&)>>; \
+    /* indexed by DispatchPriority */ \
+    PendingDispatches pending_dispatches_[3]; \
+    /* dispatches posted from other threads, waiting for drainPosted() */ \
+    using PostedDispatch = std::pair<::termreact::DispatchPriority, PendingDispatches::value_type>; \
+    ::termreact::details::MpscQueue<PostedDispatch> posted_dispatches_; \
+    std::atomic<bool> post_wakeup_pending_; \
+    std::function<void()> post_wakeup_; \
+    /* kept out of the state, focusables and presenting update it in place */ \
+    ::termreact::details::FocusIndex focus_index_; \
+    template <typename... Vs, typename... Ts> \
+    static PendingDispatches::value_type makeDispatch_(Ts&&... payload) { \
+      return [t = std::make_tuple(std::forward<Ts>(payload)...)] (const StateType &state, StateType &next_state) { \
+        STATE_REDUCERS(STORE_ADD_BUILTIN_FIELDS(fields)) \
+      }; \
+    } \
+    PendingDispatches* nextLane_() { \
+      for (int i = 0; i < 2; i++) { \
+        if (!pending_dispatches_[i].empty()) return &pending_dispatches_[i]; \
+      } \
+      return nullptr; \
+    } \
     void doDispatch_() { \
       in_processing_dispatches_++; \
-      while (pending_dispatches_.size() != 0) { \
+      while (auto lane = nextLane_()) { \
+        /* nobody looks at the previous state then, the reducers get the only reference to it */ \
+        if (listeners_.empty()) { \
+          StateType next_state = std::move(state_); \
+          lane->front()(next_state, next_state); \
+          lane->pop_front(); \
+          state_ = std::move(next_state); \
+          continue; \
+        } \
         StateType next_state = state_; \
-        pending_dispatches_.front()(state_, next_state); \
+        lane->front()(state_, next_state); \
         if (next_state != state_) { \
           for (auto& listener : listeners_) { \
             listener(state_, next_state); \
           } \
         } \
-        pending_dispatches_.pop_front(); \
+        lane->pop_front(); \
         state_ = std::move(next_state); \
       } \
       in_processing_dispatches_--; \
     } \
   public: \
-    classname() : state_{STATE_INIT(STORE_ADD_BUILTIN_FIELDS(fields))}, in_processing_dispatches_{0} {} \
+    classname() : state_{STATE_INIT(STORE_ADD_BUILTIN_FIELDS(fields))}, in_processing_dispatches_{0}, post_wakeup_pending_{false} {} \
     template <StateType::Field F> \
     auto get() const { return state_.get<F>(); } \
-    /* We have to avoid moving payloads around since they will be passed through all the reducers */ \
+    /* the focusables in tree order, the focus itself is in the focusables field */ \
+    ::termreact::details::FocusIndex& focusIndex() { return focus_index_; } \
+    /* payloads are moved (or copied once if they are lvalues) into the pending dispatch and then */ \
+    /* shared by all the reducers. pass std::cref() to keep a reference to a payload instead */ \
+    template <typename... Vs, typename... Ts> \
+    void dispatch(Ts&&... payload) { \
+      dispatchAt<Vs...>(::termreact::DispatchPriority::Normal, std::forward<Ts>(payload)...); \
+    } \
     template <typename... Vs, typename... Ts> \
-    void dispatch(const Ts&... payload) { \
-      pending_dispatches_.emplace_back( \
-        [t = std::make_tuple(payload...)] (const StateType &state, StateType &next_state) { \
-          STATE_REDUCERS(STORE_ADD_BUILTIN_FIELDS(fields)) \
+    void dispatchAt(::termreact::DispatchPriority priority, Ts&&... payload) { \
+      pending_dispatches_[static_cast<int>(priority)].push_back(makeDispatch_<Vs...>(std::forward<Ts>(payload)...)); \
+      if (in_processing_dispatches_ == 0 && priority != ::termreact::DispatchPriority::Background) \
+        doDispatch_(); \
+    } \
+    /* reduce all the background dispatches so far into one update, listeners are called once */ \
+    void flushBackground() { \
+      auto& background = pending_dispatches_[static_cast<int>(::termreact::DispatchPriority::Background)]; \
+      if (background.empty()) return; \
+      /* each one reduces the state left by the previous one */ \
+      pending_dispatches_[static_cast<int>(::termreact::DispatchPriority::Normal)].emplace_back( \
+        [batch = std::move(background)] (const StateType&, StateType &next_state) { \
+          for (auto& d : batch) d(next_state, next_state); \
         }); \
+      background.clear(); \
       if (in_processing_dispatches_ == 0) \
         doDispatch_(); \
     } \
+    /* dispatch from any thread. the dispatch is queued until the dispatching thread calls */ \
+    /* drainPosted(), which the wakeup set by setPostWakeup() is expected to trigger */ \
+    template <typename... Vs, typename... Ts> \
+    void postDispatch(Ts&&... payload) { \
+      postDispatchAt<Vs...>(::termreact::DispatchPriority::Normal, std::forward<Ts>(payload)...); \
+    } \
+    template <typename... Vs, typename... Ts> \
+    void postDispatchAt(::termreact::DispatchPriority priority, Ts&&... payload) { \
+      posted_dispatches_.push(PostedDispatch{priority, makeDispatch_<Vs...>(std::forward<Ts>(payload)...)}); \
+      /* one wakeup until the next drain */ \
+      if (!post_wakeup_pending_.exchange(true) && post_wakeup_) post_wakeup_(); \
+    } \
+    /* must be set before any thread posts */ \
+    void setPostWakeup(std::function<void()> wakeup) { post_wakeup_ = std::move(wakeup); } \
+    /* move up to max_batch posted dispatches into their lanes and process them as one chunk. */ \
+    /* wakes up again if some are left. returns how many were taken */ \
+    std::size_t drainPosted(std::size_t max_batch = static_cast<std::size_t>(-1)) { \
+      post_wakeup_pending_.store(false); \
+      std::size_t n = 0; \
+      PostedDispatch posted; \
+      startChunkDispatch(); \
+      while (n < max_batch && posted_dispatches_.pop(posted)) { \
+        pending_dispatches_[static_cast<int>(posted.first)].push_back(std::move(posted.second)); \
+        n++; \
+      } \
+      endChunkDispatch(); \
+      if (n == max_batch && !posted_dispatches_.empty() && \
+          !post_wakeup_pending_.exchange(true) && post_wakeup_) post_wakeup_(); \
+      return n; \
+    } \
+    std::size_t pendingDispatches(::termreact::DispatchPriority priority) const { \
+      return pending_dispatches_[static_cast<int>(priority)].size(); \
+    } \
     /* to commit continuous dispatches (prevent any nested dispatches from */ \
     /*   being inserted into the queue in between them), put them in a chunk dispatch block*/ \
     void startChunkDispatch() { in_processing_dispatches_++; } \
     void endChunkDispatch() { if (--in_processing_dispatches_ == 0) doDispatch_(); } \
     void clearChunkDispatch() { \
-      pending_dispatches_.clear(); \
+      pending_dispatches_[static_cast<int>(::termreact::DispatchPriority::Immediate)].clear(); \
+      pending_dispatches_[static_cast<int>(::termreact::DispatchPriority::Normal)].clear(); \
       in_processing_dispatches_--; \
     } \
     void addListener(Listener listener, bool immediate_call = true) { \
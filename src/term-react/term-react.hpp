@@ -5,6 +5,8 @@
 #include "./component.hpp"
 #include "./end-component.hpp"
 #include "./event.hpp"
+#include "./focus-index.hpp"
+#include "./hit-test.hpp"
 #include "./provider.hpp"
 #include "./reducer.hpp"
 #include "./store.hpp"
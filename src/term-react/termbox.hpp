@@ -1,22 +1,197 @@
 #pragma once
 #include <memory>
+#include <string>
+#include <vector>
+#include <utility>
 #include <chrono>
+#include <cstdint>
+#include <algorithm>
 #include <unordered_map>
 #include <functional>
+#include <stdexcept>
+#include <poll.h>
 #include "./provider.hpp"
 #include "./termbox/termbox.h"
 #include "./canvas.hpp"
 #include "./component.hpp"
 #include "./event.hpp"
+#include "./hit-test.hpp"
 
 namespace termreact {
 
 class Termbox;
+class TermboxCanvas;
+
+namespace details {
+
+// the offscreen buffer of a layer, the size of the screen. grapheme clusters of more than one
+// codepoint are kept aside and written with tb_change_cluster() when it's composited
+class TermboxLayer : public Canvas {
+private:
+  TermboxCanvas *screen_;
+  const void *owner_;
+  int width_ = 0, height_ = 0;
+  std::vector<tb_cell> cells_;
+  // a cell showing one has TB_CLUSTER | its index for ch
+  std::vector<std::string> clusters_;
+  // painted over the screen's once composited, so they're on top of whatever is under the layer
+  struct LayerMouseTarget {
+    Rect rect, visible;
+    MouseTarget *target;
+  };
+  std::vector<LayerMouseTarget> mouse_targets_;
+  int z_ = 0;
+  // what's composited, in screen coordinates
+  Rect rect_{0, 0, 0, 0};
+  // the frame it was last begun in, and when in that frame
+  std::uint64_t frame_ = 0;
+  std::size_t order_ = 0;
+
+public:
+  TermboxLayer(TermboxCanvas *screen, const void *owner) : screen_{screen}, owner_{owner} {}
+
+  int getWidth() const override { return width_; }
+  int getHeight() const override { return height_; }
+
+  void clear(uint16_t fg = TB_DEFAULT, uint16_t bg = TB_DEFAULT) override {
+    std::fill(cells_.begin(), cells_.end(), tb_cell{' ', fg, bg});
+    clusters_.clear();
+  }
+
+  void setCell(int x, int y, uint32_t ch, uint16_t fg = TB_DEFAULT, uint16_t bg = TB_DEFAULT) override {
+    if (static_cast<unsigned>(x) >= static_cast<unsigned>(width_) ||
+        static_cast<unsigned>(y) >= static_cast<unsigned>(height_)) return;
+    cells_[y * width_ + x] = tb_cell{ch, fg, bg};
+  }
+
+  void writeString(int x, int y, std::string str, uint16_t fg = TB_DEFAULT, uint16_t bg = TB_DEFAULT) override {
+    writeStringClipped(x, y, std::move(str), fg, bg, 0, width_);
+  }
+
+  void writeStringClipped(int x, int y, std::string str, uint16_t fg, uint16_t bg, int from, int to) override {
+    int i = 0, len = static_cast<int>(str.size());
+    while (i < len && x < to) {
+      int width;
+      int n = tb_utf8_cluster_length(str.data() + i, len - i, &width);
+      // a wide one cut in two is left out
+      if (x >= from && x + width <= to) {
+        if (n == 1) {
+          setCell(x, y, static_cast<unsigned char>(str[i]), fg, bg);
+        } else {
+          setCell(x, y, TB_CLUSTER | static_cast<uint32_t>(clusters_.size()), fg, bg);
+          clusters_.emplace_back(str, i, n);
+        }
+      }
+      x += width;
+      i += n;
+    }
+  }
+
+  // nothing to present on its own, it's composited by the screen's present()
+  void present() override {}
+
+  using Canvas::addMouseTarget;
+  void addMouseTarget(const Rect& rect, const Rect& visible, MouseTarget *target) override {
+    mouse_targets_.push_back(LayerMouseTarget{rect, visible, target});
+  }
+
+  Canvas* beginLayer(const void *owner, int z, bool& redraw) override;
+  void endLayer(const void *owner, const Rect& rect) override;
+  // what isn't in a layer of its own is composited along with this one
+  bool occluded(const Rect& rect, int z = 0) const override;
+
+  friend class ::termreact::TermboxCanvas;
+};
+
+}
+
 class TermboxCanvas : public Canvas {
 private:
+  // mouse targets registered while presenting the last frame
+  details::HitTestIndex hit_test_index_;
+  // those registered in this frame so far and in the last one, in paint order.
+  // the index is only repainted when they differ, most frames leave it as it is
+  struct PaintedMouseTarget {
+    Rect rect, visible;
+    details::MouseTarget *target;
+    bool operator==(const PaintedMouseTarget& other) const {
+      return target == other.target && rect == other.rect && visible == other.visible;
+    }
+  };
+  std::vector<PaintedMouseTarget> painted_, last_painted_;
+  unsigned long last_removals_ = 0;
+  // layers begun in the previous frame or in this one, by owner
+  std::unordered_map<const void*, std::unique_ptr<details::TermboxLayer>> layers_;
+  std::uint64_t frame_ = 0;
+  std::size_t next_order_ = 0;
+  // where layers were composited last time, skipping what's under them relies on them staying there
+  struct Occluder {
+    const void *owner;
+    int z;
+    Rect rect;
+  };
+  std::vector<Occluder> occluders_;
+  // the ones skipping something relied on in this frame
+  mutable std::vector<Occluder> relied_on_;
+
   // disable manual construction. Ensure that only Termbox can instantiate it, after initializing termbox.
   TermboxCanvas() {}
 
+  // higher ones first, those composited later are above those of the same z
+  std::vector<details::TermboxLayer*> composited_() const {
+    std::vector<details::TermboxLayer*> layers;
+    for (auto& entry : layers_) {
+      if (entry.second->frame_ == frame_) layers.push_back(entry.second.get());
+    }
+    std::sort(layers.begin(), layers.end(), [] (const details::TermboxLayer *a, const details::TermboxLayer *b) {
+      return a->z_ != b->z_ ? a->z_ > b->z_ : a->order_ > b->order_;
+    });
+    return layers;
+  }
+
+  void blit_(const details::TermboxLayer& layer) {
+    int x0 = std::max(layer.rect_.x, 0), y0 = std::max(layer.rect_.y, 0);
+    int x1 = std::min(layer.rect_.x + layer.rect_.width, layer.width_);
+    int y1 = std::min(layer.rect_.y + layer.rect_.height, layer.height_);
+    for (int y = y0; y < y1; y++) {
+      const tb_cell *row = &layer.cells_[y * layer.width_];
+      tb_blit(x0, y, x1 - x0, 1, row + x0);
+      if (layer.clusters_.empty()) continue;
+      for (int x = x0; x < x1; x++) {
+        if (!(row[x].ch & TB_CLUSTER)) continue;
+        auto& cluster = layer.clusters_[row[x].ch & ~TB_CLUSTER];
+        tb_change_cluster(x, y, cluster.data(), static_cast<int>(cluster.size()), row[x].fg, row[x].bg);
+      }
+    }
+    for (auto& target : layer.mouse_targets_) {
+      painted_.push_back(PaintedMouseTarget{target.rect, target.visible, target.target});
+    }
+  }
+
+  // a target that left the index since could be back at the same address, that's repainted too
+  void commitMouseTargets_() {
+    if (painted_ == last_painted_ && hit_test_index_.removals() == last_removals_) return;
+    hit_test_index_.clear();
+    for (auto& painted : painted_) hit_test_index_.paint(painted.rect, painted.visible, painted.target);
+    last_painted_.swap(painted_);
+    last_removals_ = hit_test_index_.removals();
+  }
+
+  // whether everything that got skipped in this frame for being under a layer really is
+  bool occlusionHeld_() const {
+    for (auto& occluder : relied_on_) {
+      auto it = layers_.find(occluder.owner);
+      if (it == layers_.end() || it->second->frame_ != frame_ || it->second->z_ != occluder.z ||
+          it->second->rect_ != occluder.rect) return false;
+    }
+    return true;
+  }
+
+  // so that the frame can be presented again without skipping anything
+  void dropOccluders_() {
+    occluders_.clear();
+  }
+
 public:
   int getWidth() const override {
     return tb_width();
@@ -29,33 +204,201 @@ public:
   void clear(uint16_t fg = TB_DEFAULT, uint16_t bg = TB_DEFAULT) override {
     tb_set_clear_attributes(fg, bg);
     tb_clear();
+    painted_.clear();
+    // the ones not begun in the last frame are gone or hidden, they'll be drawn from scratch if needed
+    for (auto it = layers_.begin(); it != layers_.end();) {
+      if (it->second->frame_ != frame_) it = layers_.erase(it);
+      else ++it;
+    }
+    frame_++;
+    next_order_ = 0;
+    relied_on_.clear();
   }
 
   void setCell(int x, int y, uint32_t ch, uint16_t fg = TB_DEFAULT, uint16_t bg = TB_DEFAULT) override {
     tb_change_cell(x, y, ch, fg, bg);
   }
 
+  // one grapheme cluster per cell, or two for the wide ones
+  void writeString(int x, int y, std::string str, uint16_t fg = TB_DEFAULT, uint16_t bg = TB_DEFAULT) override {
+    int i = 0, len = static_cast<int>(str.size());
+    while (i < len) {
+      int n = tb_utf8_cluster_length(str.data() + i, len - i, nullptr);
+      x += tb_change_cluster(x, y, str.data() + i, n, fg, bg);
+      i += n;
+    }
+  }
+
+  void writeStringClipped(int x, int y, std::string str, uint16_t fg, uint16_t bg, int from, int to) override {
+    int i = 0, len = static_cast<int>(str.size());
+    while (i < len && x < to) {
+      int width;
+      int n = tb_utf8_cluster_length(str.data() + i, len - i, &width);
+      // a wide one cut in two is left out
+      if (x >= from && x + width <= to) tb_change_cluster(x, y, str.data() + i, n, fg, bg);
+      x += width;
+      i += n;
+    }
+  }
+
+  // composites the layers, bottom up, leaving out those hidden under a single higher one
   void present() override {
+    auto layers = composited_();
+    occluders_.clear();
+    for (auto it = layers.begin(); it != layers.end(); ++it) {
+      auto& rect = (*it)->rect_;
+      if (std::none_of(layers.begin(), it, [&rect] (details::TermboxLayer *above) {
+        return above->rect_.contains(rect);
+      })) occluders_.push_back(Occluder{(*it)->owner_, (*it)->z_, rect});
+    }
+    for (auto it = occluders_.rbegin(); it != occluders_.rend(); ++it) {
+      blit_(*layers_.at(it->owner));
+    }
+    commitMouseTargets_();
     tb_present();
   }
 
+  void scroll(int x, int y, int w, int h, int dy) override {
+    tb_scroll(x, y, w, h, dy);
+  }
+
+  using Canvas::addMouseTarget;
+  void addMouseTarget(const Rect& rect, const Rect& visible, details::MouseTarget *target) override {
+    painted_.push_back(PaintedMouseTarget{rect, visible, target});
+  }
+
+  details::MouseTarget* hitTest(int x, int y, Rect *rect) const {
+    return hit_test_index_.hitTest(x, y, rect);
+  }
+
+  Canvas* beginLayer(const void *owner, int z, bool& redraw) override {
+    auto& layer = layers_[owner];
+    if (!layer) layer = std::make_unique<details::TermboxLayer>(this, owner);
+    int width = getWidth(), height = getHeight();
+    if (layer->width_ != width || layer->height_ != height) {
+      layer->width_ = width;
+      layer->height_ = height;
+      layer->cells_.resize(static_cast<std::size_t>(width) * height);
+      redraw = true;
+    }
+    if (layer->frame_ != frame_ - 1 && layer->frame_ != frame_) redraw = true;
+    if (redraw) layer->clear();
+    layer->mouse_targets_.clear();
+    layer->z_ = z;
+    layer->frame_ = frame_;
+    layer->order_ = next_order_++;
+    return layer.get();
+  }
+
+  void endLayer(const void *owner, const Rect& rect) override {
+    auto it = layers_.find(owner);
+    if (it != layers_.end()) it->second->rect_ = rect;
+  }
+
+  bool occluded(const Rect& rect, int z = 0) const override {
+    for (auto& occluder : occluders_) {
+      if (occluder.z > z && occluder.rect.contains(rect)) {
+        relied_on_.push_back(occluder);
+        return true;
+      }
+    }
+    return false;
+  }
+
   friend class Termbox;
 };
 
+namespace details {
+
+inline Canvas* TermboxLayer::beginLayer(const void *owner, int z, bool& redraw) {
+  return screen_->beginLayer(owner, z, redraw);
+}
+
+inline void TermboxLayer::endLayer(const void *owner, const Rect& rect) {
+  screen_->endLayer(owner, rect);
+}
+
+inline bool TermboxLayer::occluded(const Rect& rect, int z) const {
+  return z > 0 && screen_->occluded(rect, z);
+}
+
+}
+
+// how the main loop is keeping up, all durations are for frames actually presented
+struct FrameStats {
+  std::uint64_t presented = 0;
+  // frames not presented because the terminal hadn't consumed the previous ones yet
+  std::uint64_t dropped = 0;
+  // rendering and presenting, present alone includes writing unless the output is threaded
+  std::chrono::microseconds last_frame_time{0}, average_frame_time{0}, worst_frame_time{0};
+  std::chrono::microseconds last_present_time{0};
+  // the current interval between frames
+  std::chrono::microseconds frame_interval{0};
+};
+
 class Termbox : public Provider {
 private:
   using EventHandler = void(Termbox::*)(const tb_event&);
+  // the terminal this one draws to, it's current (along with scheduler_) while in a Selected scope
+  tb_context *context_;
   TermboxCanvas canvas_;
   bool should_exit_;
-  std::function<void(int)> updateWindowWidth_, updateWindowHeight_;
+  std::function<void(int, int)> updateWindowSize_;
+  // the latest size reported by the terminal and not dispatched yet
+  int pending_width_, pending_height_;
+  std::chrono::steady_clock::time_point last_resize_;
+  std::chrono::milliseconds resize_debounce_;
+  // rendering left over from the previous slices, only used with a render budget
+  details::RenderScheduler scheduler_;
+  // lazy children found in sight by the present going on
+  details::DeferredMounts mounts_;
+  std::chrono::microseconds render_budget_;
+  // background dispatches wait while there is input to handle, but never longer than this
+  std::function<void()> flushBackground_;
+  std::chrono::steady_clock::time_point last_background_flush_;
+  std::chrono::milliseconds background_max_delay_;
+  // takes what other threads posted to the store
+  std::function<void()> drainPosted_;
+  // the frame interval moves between these depending on how fast the terminal consumes output
+  std::chrono::microseconds min_frame_interval_, max_frame_interval_;
+  std::chrono::steady_clock::time_point last_present_;
+  // when step() runs the next frame
+  std::chrono::high_resolution_clock::time_point next_frame_;
+  FrameStats frame_stats_;
   details::Focusable *focus_;
-  std::function<void()> nextFocus_;
+  details::FocusIndex *focus_index_;
+  std::function<void()> nextFocus_, prevFocus_;
+  std::function<void(FocusDirection)> moveFocus_;
   std::unordered_map<int, EventHandler> event_handlers_;
 
+  // makes the terminal and render scheduler of a Termbox the current ones of the thread
+  class Selected {
+  private:
+    tb_context *previous_context_;
+    details::RenderScheduler *previous_scheduler_;
+    details::DeferredMounts *previous_mounts_;
+
+  public:
+    explicit Selected(Termbox& termbox)
+    : previous_context_{tb_select_context(termbox.context_)},
+      previous_scheduler_{details::RenderScheduler::select(
+        termbox.render_budget_.count() > 0 ? &termbox.scheduler_ : nullptr)},
+      previous_mounts_{details::DeferredMounts::select(&termbox.mounts_)} {}
+
+    ~Selected() {
+      details::DeferredMounts::select(previous_mounts_);
+      details::RenderScheduler::select(previous_scheduler_);
+      tb_select_context(previous_context_);
+    }
+
+    Selected(const Selected&) = delete;
+    Selected& operator=(const Selected&) = delete;
+  };
+
   void render_(ComponentPointer root_elm) override {
+    Selected selected{*this};
     setRootElm_(std::move(root_elm));
-    updateWindowWidth_(tb_width());
-    updateWindowHeight_(tb_height());
+    updateWindowSize_(tb_width(), tb_height());
   }
 
   void exit_() override {
@@ -64,45 +407,175 @@ private:
 
   void updateFocus_(details::Focusable *focus) {
     if (focus == focus_) return;
-    if (focus_) focus_->onLostFocus();
+    // the previous focus may be the one being unmounted
+    if (focus_ && focus_index_->contains(focus_)) focus_->onLostFocus();
     focus_ = focus;
-    focus_->onFocus();
+    if (focus_) focus_->onFocus();
   }
 
   void handleKey_(const tb_event& evt) {
     if (focus_ == nullptr) return;
     if (evt.key == TB_KEY_TAB) {
-      return nextFocus_();     
+      return (evt.mod & TB_MOD_SHIFT) ? prevFocus_() : nextFocus_();
+    }
+    // alt + arrows move the focus spatially, plain arrows belong to the focused component
+    if (evt.mod == TB_MOD_ALT && evt.ch == 0) {
+      switch (evt.key) {
+      case TB_KEY_ARROW_LEFT: return moveFocus_(FocusDirection::Left);
+      case TB_KEY_ARROW_RIGHT: return moveFocus_(FocusDirection::Right);
+      case TB_KEY_ARROW_UP: return moveFocus_(FocusDirection::Up);
+      case TB_KEY_ARROW_DOWN: return moveFocus_(FocusDirection::Down);
+      }
     }
     focus_->onKeyPress(Event{ evt.mod, evt.key, evt.ch });
   }
 
-  void handleMouse_(const tb_event&) {}
+  void handleMouse_(const tb_event& evt) {
+    Rect rect;
+    auto target = canvas_.hitTest(evt.x, evt.y, &rect);
+    if (target == nullptr) return;
+    target->onMouse(MouseEvent{ evt.mod, evt.key, evt.x - rect.x, evt.y - rect.y });
+  }
 
+  // resizes are only recorded here and dispatched once per frame by flushResize_
   void handleResize_(const tb_event& evt) {
-    updateWindowWidth_(evt.w);
-    updateWindowHeight_(evt.h);
+    pending_width_ = evt.w;
+    pending_height_ = evt.h;
+    last_resize_ = std::chrono::steady_clock::now();
   }
 
-public:
+  // posted dispatches are drained in batches so a busy producer can't hold up a frame
+  void handleWakeup_(const tb_event&) {
+    drainPosted_();
+  }
+
+  void maybeFlushBackground_() {
+    auto now = std::chrono::steady_clock::now();
+    if (tb_input_pending() && now - last_background_flush_ < background_max_delay_) return;
+    last_background_flush_ = now;
+    flushBackground_();
+  }
+
+  // the terminal is still busy with what was presented before. never skip for longer than ceiling,
+  // the screen would look frozen otherwise
+  bool shouldSkipFrame_(std::chrono::microseconds ceiling) const {
+    if (std::chrono::steady_clock::now() - last_present_ >= ceiling) return false;
+    return tb_output_pending() > 0;
+  }
+
+  void recordFrame_(std::chrono::microseconds frame_time, std::chrono::microseconds present_time,
+                    std::chrono::microseconds floor, std::chrono::microseconds ceiling) {
+    auto& stats = frame_stats_;
+    stats.presented++;
+    stats.last_frame_time = frame_time;
+    stats.last_present_time = present_time;
+    stats.average_frame_time = stats.presented == 1 ? frame_time :
+      stats.average_frame_time + (frame_time - stats.average_frame_time) / 8;
+    stats.worst_frame_time = std::max(stats.worst_frame_time, frame_time);
+    // a present blocking on the write for a good part of the interval is backpressure too
+    if (present_time * 2 > stats.frame_interval) {
+      stats.frame_interval = std::min(ceiling, stats.frame_interval * 2);
+    } else {
+      stats.frame_interval = std::max(floor, stats.frame_interval * 3 / 4);
+    }
+  }
+
+  void framePacing_(std::chrono::microseconds frame_duration,
+                    std::chrono::microseconds *floor, std::chrono::microseconds *ceiling) const {
+    *floor = min_frame_interval_.count() > 0 ? min_frame_interval_ : frame_duration;
+    *ceiling = std::max(*floor, max_frame_interval_);
+  }
+
+  // one slice of the main loop: takes what's pending in the store, renders, and presents unless the
+  // terminal is lagging behind. returns false if rendering ran out of budget before completing
+  bool frame_(std::chrono::high_resolution_clock::time_point start_time,
+              std::chrono::microseconds floor, std::chrono::microseconds ceiling) {
+    using namespace std::chrono;
+    using us = microseconds;
+    auto& canvas = getCanvas();
+    flushResize_();
+    drainPosted_();
+    maybeFlushBackground_();
+    int units = 0;
+    bool complete = scheduler_.run([&] () {
+      // polling the tty is a syscall, don't do it for every component
+      return high_resolution_clock::now() - start_time >= render_budget_ ||
+        (++units % 16 == 0 && tb_input_pending());
+    });
+    if (!complete) return false;
+    if (shouldSkipFrame_(ceiling)) {
+      frame_stats_.dropped++;
+      frame_stats_.frame_interval = std::min(ceiling, frame_stats_.frame_interval * 2);
+    } else {
+      presentTree_();
+      // lazy children found in sight show up in this very frame, unless their render has to wait
+      while (mounts_.mount() && scheduler_.idle()) presentTree_();
+      // a layer that hid what got skipped moved or went away, nothing is skipped the second time
+      if (!canvas_.occlusionHeld_()) {
+        canvas_.dropOccluders_();
+        presentTree_();
+      }
+      auto present_start = high_resolution_clock::now();
+      canvas.present();
+      auto end_time = high_resolution_clock::now();
+      last_present_ = steady_clock::now();
+      recordFrame_(duration_cast<us>(end_time - start_time), duration_cast<us>(end_time - present_start),
+                   floor, ceiling);
+    }
+    return true;
+  }
+
+  void presentTree_() {
+    auto& canvas = getCanvas();
+    canvas.clear();
+    focus_index_->beginPresent();
+    getRootElm_()->present(canvas.slice(0, 0, canvas.getWidth(), canvas.getHeight()), true);
+    focus_index_->endPresent();
+  }
+
+  // dispatch the pending size once it has been stable for the debounce interval
+  void flushResize_() {
+    if (pending_width_ < 0) return;
+    if (std::chrono::steady_clock::now() - last_resize_ < resize_debounce_) return;
+    updateWindowSize_(pending_width_, pending_height_);
+    pending_width_ = pending_height_ = -1;
+  }
+
+  // init sets the terminal of context up
   template <typename Store>
-  Termbox(Store& store, int output_mode = TB_OUTPUT_256) : canvas_{}, should_exit_{false}, 
-    updateWindowWidth_{[&store] (int width) { 
-      store.template dispatch<ACTION(details::BuiltinAction::UpdateWindowWidth)>(width); 
-    }},
-    updateWindowHeight_{[&store] (int height) { 
-      store.template dispatch<ACTION(details::BuiltinAction::UpdateWindowHeight)>(height); 
+  Termbox(Store& store, tb_context *context, const std::function<int()>& init, int output_mode, int input_mode)
+  : context_{context}, canvas_{}, should_exit_{false}, 
+    updateWindowSize_{[&store] (int width, int height) {
+      store.template dispatch<ACTION(details::BuiltinAction::UpdateWindowSize)>(width, height);
     }},
+    pending_width_{-1}, pending_height_{-1}, resize_debounce_{0},
+    render_budget_{0},
+    flushBackground_{[&store] () { store.flushBackground(); }},
+    background_max_delay_{100},
+    drainPosted_{[&store] () { store.drainPosted(1024); }},
+    min_frame_interval_{0}, max_frame_interval_{std::chrono::seconds{1}},
     focus_{nullptr},
+    focus_index_{&store.focusIndex()},
     nextFocus_{[&store] () { 
-      store.template dispatch<ACTION(details::BuiltinAction::nextFocus)>(); 
+      store.template dispatchAt<ACTION(details::BuiltinAction::nextFocus)>(DispatchPriority::Immediate,
+                                                                           std::cref(store.focusIndex()));
+    }},
+    prevFocus_{[&store] () {
+      store.template dispatchAt<ACTION(details::BuiltinAction::prevFocus)>(DispatchPriority::Immediate,
+                                                                           std::cref(store.focusIndex()));
+    }},
+    moveFocus_{[&store] (FocusDirection direction) {
+      store.template dispatchAt<ACTION(details::BuiltinAction::moveFocus)>(DispatchPriority::Immediate,
+                                                                           std::cref(store.focusIndex()), direction);
     }},
     event_handlers_{
       {TB_EVENT_KEY, &Termbox::handleKey_}, 
       {TB_EVENT_MOUSE, &Termbox::handleMouse_}, 
-      {TB_EVENT_RESIZE, &Termbox::handleResize_}
+      {TB_EVENT_RESIZE, &Termbox::handleResize_},
+      {TB_EVENT_WAKEUP, &Termbox::handleWakeup_}
     } {
-    int ret = tb_init();
+    Selected selected{*this};
+    int ret = init();
     if (ret) {
 #ifdef NDEBUG
       // -2 in VS Code debugger
@@ -111,6 +584,8 @@ public:
     }
     tb_clear();
     tb_select_output_mode(output_mode);
+    tb_select_input_mode(input_mode);
+    store.setPostWakeup([context] () { tb_interrupt_context(context); });
 
     using State = typename Store::StateType;
     store.addListener([this] (const State&, const State& next_state) {
@@ -118,7 +593,37 @@ public:
     });
   }
 
+public:
+  // the size of a terminal that isn't there, see Termbox(Store&, tb_context*, Headless)
+  struct Headless {
+    int width;
+    int height;
+  };
+
+  // onMouse handlers only get events with TB_INPUT_MOUSE in input_mode, the terminal keeps its own selection otherwise
+  template <typename Store>
+  Termbox(Store& store, int output_mode = TB_OUTPUT_256, int input_mode = TB_INPUT_ESC)
+  : Termbox{store, tb_current_context(), -1, output_mode, input_mode} {}
+
+  // draws to the tty fd (the controlling terminal if -1) through context, which has to outlive it.
+  // fd is closed along with the terminal
+  template <typename Store>
+  Termbox(Store& store, tb_context *context, int fd,
+          int output_mode = TB_OUTPUT_256, int input_mode = TB_INPUT_ESC)
+  : Termbox{store, context, [fd] () { return fd < 0 ? tb_init() : tb_init_fd(fd); }, output_mode, input_mode} {}
+
+  // draws for the viewers attached with listen() only, at the size of the last one that resized
+  template <typename Store>
+  Termbox(Store& store, tb_context *context, Headless size,
+          int output_mode = TB_OUTPUT_256, int input_mode = TB_INPUT_ESC)
+  : Termbox{store, context, [size] () { return tb_init_headless(size.width, size.height); },
+            output_mode, input_mode} {}
+
   ~Termbox() {
+    Selected selected{*this};
+    // unmounting dispatches, the listeners calling back into this one have to find it whole
+    setRootElm_(nullptr);
+    scheduler_.deactivate();
     tb_shutdown();
   }
 
@@ -126,22 +631,77 @@ public:
     return canvas_;
   }
 
+  // wait until the window size has been stable for this long before laying out for it,
+  // the previous layout keeps being presented meanwhile. 0 lays out once per frame
+  void setResizeDebounce(std::chrono::milliseconds debounce) {
+    resize_debounce_ = debounce;
+  }
+
+  // write to the terminal from a thread of its own so a slow terminal never holds up input
+  // handling, frames the terminal can't keep up with are dropped. returns false if it can't
+  bool setThreadedOutput(bool threaded) {
+    Selected selected{*this};
+    if (threaded) return tb_start_writer() == 0;
+    tb_stop_writer();
+    return true;
+  }
+
+  // frames are presented every floor at best. while the terminal lags behind, frames are skipped
+  // (the next one presented shows the latest state) and the interval backs off up to ceiling.
+  // a zero floor uses runMainLoop's frame_duration
+  void setFramePacing(std::chrono::microseconds floor, std::chrono::microseconds ceiling) {
+    min_frame_interval_ = floor;
+    max_frame_interval_ = ceiling;
+  }
+
+  const FrameStats& getFrameStats() const {
+    return frame_stats_;
+  }
+
+  // how long background dispatches may be held back by a steady stream of input
+  void setBackgroundMaxDelay(std::chrono::milliseconds delay) {
+    background_max_delay_ = delay;
+  }
+
+  // spend at most this long per frame rendering, the rest is carried over to the next slices
+  // and the screen keeps showing the last complete tree meanwhile. rendering also gives way
+  // as soon as there is input to handle. 0 renders synchronously on every store update
+  void setRenderBudget(std::chrono::microseconds budget) {
+    render_budget_ = budget;
+    if (budget.count() == 0) {
+      // finish whatever was left before rendering synchronously again
+      Selected selected{*this};
+      scheduler_.run([] () { return false; });
+      scheduler_.deactivate();
+    }
+  }
+
   void runMainLoop(std::chrono::microseconds frame_duration = std::chrono::microseconds{16667 * 12}) override {
     using namespace std::chrono;
     using us = microseconds;
     using ms = milliseconds;
+    Selected selected{*this};
     tb_event ev;
-    auto& canvas = getCanvas();
+    us floor, ceiling;
+    framePacing_(frame_duration, &floor, &ceiling);
+    frame_stats_.frame_interval = floor;
     while (!should_exit_) {
       auto start_time = high_resolution_clock::now();
-      canvas.clear();
-      getRootElm_()->present(canvas.slice(0, 0, canvas.getWidth(), canvas.getHeight()), true);
-      canvas.present();
+      if (!frame_(start_time, floor, ceiling)) {
+        // handle what is pending right away and get back to rendering,
+        // a half rendered tree is never presented
+        int event_type;
+        while ((event_type = tb_peek_event(&ev, 0)) > 0) {
+          (this->*event_handlers_[event_type])(ev);
+        }
+        continue;
+      }
+      us frame_interval = frame_stats_.frame_interval;
       do {
         us us_elapsed = duration_cast<us>(high_resolution_clock::now() - start_time);
-        if (us_elapsed >= frame_duration) break;
+        if (us_elapsed >= frame_interval) break;
 
-        ms ms_to_wait = duration_cast<ms>(frame_duration - us_elapsed);
+        ms ms_to_wait = duration_cast<ms>(frame_interval - us_elapsed);
         int event_type = tb_peek_event(&ev, ms_to_wait.count());
         if (event_type > 0) {
           (this->*event_handlers_[event_type])(ev);
@@ -153,6 +713,109 @@ public:
       } while (true);
     }
   }
+
+  // runMainLoop() for event loops of their own: handles the events already there and runs a frame
+  // if one is due, without ever blocking. call it again once one of eventFds() is readable or
+  // nextStepIn() has passed. returns false once the app exits or the terminal is gone
+  bool step(std::chrono::microseconds frame_duration = std::chrono::microseconds{16667}) {
+    using namespace std::chrono;
+    Selected selected{*this};
+    tb_event ev;
+    int event_type;
+    while ((event_type = tb_peek_event(&ev, 0)) > 0) {
+      (this->*event_handlers_[event_type])(ev);
+    }
+    if (event_type < 0 || should_exit_) return false;
+
+    microseconds floor, ceiling;
+    framePacing_(frame_duration, &floor, &ceiling);
+    if (frame_stats_.frame_interval.count() == 0) frame_stats_.frame_interval = floor;
+    auto now = high_resolution_clock::now();
+    if (now >= next_frame_) {
+      // an incomplete frame goes on with the next step
+      next_frame_ = frame_(now, floor, ceiling) ? now + frame_stats_.frame_interval : now;
+    }
+    return !should_exit_;
+  }
+
+  // how long step() has nothing to do unless one of eventFds() becomes readable
+  std::chrono::microseconds nextStepIn() {
+    using namespace std::chrono;
+    Selected selected{*this};
+    auto left = duration_cast<microseconds>(next_frame_ - high_resolution_clock::now());
+    left = std::max(left, microseconds{0});
+    int input_timeout = tb_input_timeout();
+    if (input_timeout >= 0) left = std::min<microseconds>(left, milliseconds{input_timeout});
+    return left;
+  }
+
+  // the tty, the resize notifications and the wakeups
+  void eventFds(int fds[3]) {
+    Selected selected{*this};
+    tb_event_fds(fds);
+  }
+
+  // the terminal got resized without a SIGWINCH telling us, as happens to ptys we don't control
+  void notifyResize() {
+    tb_notify_resize(context_);
+  }
+
+  // serves the screen to viewers (see tb_attach()) on the unix socket path, their input is
+  // handled like the terminal's. false if the socket can't be set up
+  bool listen(const std::string& path) {
+    Selected selected{*this};
+    return tb_listen(path.c_str()) == 0;
+  }
+
+  // appends what gets presented to the file at path, with a keyframe at least every keyframe_interval.
+  // tb_export_asciicast() turns it into something to watch. false if the file can't be opened
+  bool record(const std::string& path, std::chrono::milliseconds keyframe_interval = std::chrono::seconds{30},
+              bool compress = true) {
+    Selected selected{*this};
+    return tb_record(path.c_str(), static_cast<int>(keyframe_interval.count()), compress ? TB_RECORD_COMPRESS : 0) == 0;
+  }
+
+  void stopRecording() {
+    Selected selected{*this};
+    tb_stop_recording();
+  }
+
+  // logs the raw input with the time, for replay()
+  bool captureInput(const std::string& path) {
+    Selected selected{*this};
+    return tb_capture_input(path.c_str()) == 0;
+  }
+
+  void stopInputCapture() {
+    Selected selected{*this};
+    tb_stop_input_capture();
+  }
+
+  // feeds the app a log written by captureInput(), at the pace it was captured or as fast as the app
+  // presents it, until the log runs out or the app exits. the output goes wherever this Termbox draws,
+  // a headless one is a null sink. returns how long the events took to get presented
+  tb_replay_stats replay(const std::string& path, bool max_speed = false,
+                         std::chrono::microseconds frame_duration = std::chrono::microseconds{16667}) {
+    int fds[3];
+    {
+      Selected selected{*this};
+      if (tb_replay_input(path.c_str(), max_speed ? TB_REPLAY_MAX_SPEED : 0) < 0) {
+        throw std::runtime_error("can't replay " + path);
+      }
+      tb_event_fds(fds);
+    }
+    // every record gets a frame of its own
+    if (max_speed) frame_duration = std::chrono::microseconds{0};
+    while (step(frame_duration)) {
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextStepIn() + std::chrono::microseconds{999});
+      pollfd wakeup{fds[2], POLLIN, 0};
+      poll(&wakeup, 1, static_cast<int>(wait.count()));
+    }
+    Selected selected{*this};
+    tb_replay_stats stats;
+    tb_get_replay_stats(&stats);
+    return stats;
+  }
 };
 
 }
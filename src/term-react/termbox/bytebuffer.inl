@@ -49,22 +49,7 @@ static void bytebuffer_puts(struct bytebuffer *b, const char *str) {
 	bytebuffer_append(b, str, strlen(str));
 }
 
-static void bytebuffer_resize(struct bytebuffer *b, int len) {
-	bytebuffer_reserve(b, len);
-	b->len = len;
-}
-
 static void bytebuffer_flush(struct bytebuffer *b, int fd) {
 	write(fd, b->buf, b->len);
 	bytebuffer_clear(b);
 }
-
-static void bytebuffer_truncate(struct bytebuffer *b, int n) {
-	if (n <= 0)
-		return;
-	if (n > b->len)
-		n = b->len;
-	const int nmove = b->len - n;
-	memmove(b->buf, b->buf+n, nmove);
-	b->len -= n;
-}
@@ -0,0 +1,126 @@
+/* a grid of cells whose rows start on a cache line and are 'stride' cells
+ * apart. rows and columns are reserved beyond the current size so that a
+ * window growing within the capacity is resized in place. */
+#define CELLBUF_ALIGN 64
+#define CELLBUF_ALIGN_CELLS (CELLBUF_ALIGN / sizeof(struct tb_cell))
+
+/* never equal to a cell written by the user, marks cells whose content on
+ * the screen is unknown so the next present repaints them */
+static const struct tb_cell cellbuf_unknown = {0xFFFFFFFF, 0xFFFF, 0xFFFF};
+
+struct cellbuf {
+	int width;
+	int height;
+	int stride;
+	int cap_height;
+	struct tb_cell *cells;
+
+	struct tb_cell *row(int y) { return cells + (size_t)y * stride; }
+	const struct tb_cell *row(int y) const { return cells + (size_t)y * stride; }
+	struct tb_cell &at(int x, int y) { return row(y)[x]; }
+
+	void init(int w, int h) {
+		cells = 0;
+		width = height = stride = cap_height = 0;
+		reserve(w, h);
+		width = w;
+		height = h;
+	}
+
+	void free_cells() {
+		free(cells);
+		cells = 0;
+		width = height = stride = cap_height = 0;
+	}
+
+	void fill(int x, int y, int w, int h, const struct tb_cell &cell) {
+		int i, j;
+		for (j = y; j < y + h; ++j) {
+			struct tb_cell *r = row(j);
+			for (i = x; i < x + w; ++i)
+				r[i] = cell;
+		}
+	}
+
+	/* change the size, keeping the overlapping cells and filling the newly
+	 * exposed ones with 'exposed' */
+	void resize(int w, int h, const struct tb_cell &exposed) {
+		if (w == width && h == height)
+			return;
+
+		int oldw = width;
+		int oldh = height;
+		reserve(w, h);
+		width = w;
+		height = h;
+
+		int keepw = (w < oldw) ? w : oldw;
+		int keeph = (h < oldh) ? h : oldh;
+		if (w > keepw)
+			fill(keepw, 0, w - keepw, keeph, exposed);
+		if (h > keeph)
+			fill(0, keeph, w, h - keeph, exposed);
+	}
+
+	/* move the rows of the given area up by dy rows (down if negative),
+	 * the rows left behind are filled with 'exposed' */
+	void scroll(int x, int y, int w, int h, int dy, const struct tb_cell &exposed) {
+		int n = (dy > 0) ? dy : -dy;
+		if (n >= h) {
+			fill(x, y, w, h, exposed);
+			return;
+		}
+		int j;
+		if (dy > 0) {
+			for (j = y; j < y + h - n; ++j)
+				memcpy(row(j) + x, row(j + n) + x, sizeof(struct tb_cell) * w);
+			fill(x, y + h - n, w, n, exposed);
+		} else {
+			for (j = y + h - 1; j >= y + n; --j)
+				memcpy(row(j) + x, row(j - n) + x, sizeof(struct tb_cell) * w);
+			fill(x, y, w, n, exposed);
+		}
+	}
+
+	/* become a copy of 'other', keeping the allocation when it fits */
+	void copy_from(const struct cellbuf &other) {
+		reserve(other.width, other.height);
+		width = other.width;
+		height = other.height;
+		int y;
+		for (y = 0; y < height; ++y)
+			memcpy(row(y), other.row(y), sizeof(struct tb_cell) * width);
+	}
+
+private:
+	static int round_up(int n) {
+		return (n + CELLBUF_ALIGN_CELLS - 1) / CELLBUF_ALIGN_CELLS * CELLBUF_ALIGN_CELLS;
+	}
+
+	/* make sure the grid can hold w x h cells, reallocating with some room
+	 * to grow when it can't */
+	void reserve(int w, int h) {
+		if (w <= stride && h <= cap_height)
+			return;
+
+		int newstride = (w <= stride) ? stride : round_up(w + w / 4);
+		int newcaph = (h <= cap_height) ? cap_height : h + h / 4;
+		if (newstride == 0) newstride = CELLBUF_ALIGN_CELLS;
+		if (newcaph == 0) newcaph = 1;
+
+		void *mem = 0;
+		int ret = posix_memalign(&mem, CELLBUF_ALIGN, sizeof(struct tb_cell) * newstride * newcaph);
+		assert(ret == 0);
+		(void) ret;
+		struct tb_cell *newcells = static_cast<struct tb_cell*>(mem);
+
+		int y;
+		for (y = 0; y < height; ++y)
+			memcpy(newcells + (size_t)y * newstride, row(y), sizeof(struct tb_cell) * width);
+
+		free(cells);
+		cells = newcells;
+		stride = newstride;
+		cap_height = newcaph;
+	}
+};
@@ -0,0 +1,113 @@
+/* grapheme clusters of more than one codepoint, see tb_change_cluster().
+ * they're kept out of the cells in a pool, a cell holding one has TB_CLUSTER
+ * and the offset of the cluster in its pool for 'ch'. the back buffer and
+ * the front buffer have a pool each: the back one is emptied by tb_clear(),
+ * and both are compacted once they grow past what's in use, into a spare
+ * buffer that's swapped in, so a frame loop doesn't allocate */
+
+struct cluster_head {
+	uint16_t len;
+	uint8_t width;
+	uint8_t pad;
+};
+
+/* clusters are aligned on this, so that an unknown cell (cellbuf.inl) is
+ * never taken for one */
+#define CLUSTER_ALIGN 4
+#define CLUSTER_PADDED(len) (((len) + CLUSTER_ALIGN - 1) & ~(CLUSTER_ALIGN - 1))
+#define CLUSTER_MAX_LEN 0xFFFF
+/* a pool is compacted when it's this big and twice what it was after the
+ * last compaction */
+#define CLUSTER_COMPACT_BYTES (64 * 1024)
+
+/* zeroed is empty */
+struct cluster_pool {
+	struct bytebuffer bytes;
+	int compacted_len;
+};
+
+static bool is_cluster(uint32_t ch)
+{
+	return (ch & TB_CLUSTER) && (ch & (CLUSTER_ALIGN - 1)) == 0;
+}
+
+static void cluster_pool_clear(struct cluster_pool *p)
+{
+	bytebuffer_clear(&p->bytes);
+	p->compacted_len = 0;
+}
+
+static void cluster_pool_free(struct cluster_pool *p)
+{
+	bytebuffer_free(&p->bytes);
+	bytebuffer_init(&p->bytes, 0);
+	p->compacted_len = 0;
+}
+
+static const struct cluster_head *cluster_get(const struct cluster_pool *p, uint32_t ch)
+{
+	return (const struct cluster_head*)(p->bytes.buf + (ch & ~TB_CLUSTER));
+}
+
+static const char *cluster_data(const struct cluster_pool *p, uint32_t ch, int *len)
+{
+	const struct cluster_head *head = cluster_get(p, ch);
+	*len = head->len;
+	return (const char*)(head + 1);
+}
+
+/* returns the 'ch' of a cell showing it */
+static uint32_t cluster_add(struct cluster_pool *p, const char *utf8, int len, int width)
+{
+	struct cluster_head head = {(uint16_t)len, (uint8_t)width, 0};
+	uint32_t offset = p->bytes.len;
+	static const char padding[CLUSTER_ALIGN] = {0};
+	bytebuffer_append(&p->bytes, (const char*)&head, sizeof(head));
+	bytebuffer_append(&p->bytes, utf8, len);
+	bytebuffer_append(&p->bytes, padding, CLUSTER_PADDED(len) - len);
+	return TB_CLUSTER | offset;
+}
+
+static uint32_t cluster_copy(struct cluster_pool *to, const struct cluster_pool *from, uint32_t ch)
+{
+	int len;
+	const char *data = cluster_data(from, ch, &len);
+	return cluster_add(to, data, len, cluster_get(from, ch)->width);
+}
+
+static bool cluster_equal(const struct cluster_pool *a, uint32_t cha, const struct cluster_pool *b, uint32_t chb)
+{
+	const struct cluster_head *ha = cluster_get(a, cha), *hb = cluster_get(b, chb);
+	return ha->len == hb->len && memcmp(ha + 1, hb + 1, ha->len) == 0;
+}
+
+static uint64_t cluster_hash(const struct cluster_pool *p, uint32_t ch)
+{
+	int len, i;
+	const char *data = cluster_data(p, ch, &len);
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (i = 0; i < len; ++i)
+		h = (h ^ (unsigned char)data[i]) * 0x100000001b3ull;
+	return h;
+}
+
+/* moves the clusters 'cells' still shows into 'spare', which becomes the
+ * pool, if the pool grew enough for it to be worth it */
+static void cluster_pool_compact(struct cluster_pool *p, struct bytebuffer *spare, struct cellbuf *cells)
+{
+	int x, y;
+	if (p->bytes.len < CLUSTER_COMPACT_BYTES || p->bytes.len < 2 * p->compacted_len)
+		return;
+	struct cluster_pool compacted = {*spare, 0};
+	bytebuffer_clear(&compacted.bytes);
+	for (y = 0; y < cells->height; ++y) {
+		struct tb_cell *row = cells->row(y);
+		for (x = 0; x < cells->width; ++x) {
+			if (is_cluster(row[x].ch))
+				row[x].ch = cluster_copy(&compacted, p, row[x].ch);
+		}
+	}
+	*spare = p->bytes;
+	p->bytes = compacted.bytes;
+	p->compacted_len = p->bytes.len;
+}
@@ -1,179 +1,446 @@
-// if s1 starts with s2 returns true, else false
-// len is the length of s1
-// s2 should be null-terminated
-static bool starts_with(const char *s1, int len, const char *s2)
+//----------------------------------------------------------------------
+// key trie
+//----------------------------------------------------------------------
+
+// the key table (either builtin or from terminfo) compiled into a byte trie,
+// so an escape sequence is matched in a single pass over the input instead of
+// comparing it against every entry of 'keys'
+struct key_trie_node {
+	unsigned char byte;
+	uint16_t key; // 0 if no key ends here
+	int child; // first child, -1 if none
+	int sibling; // next node sharing the same parent, -1 if none
+};
+
+static struct key_trie_node *key_trie = 0;
+static int key_trie_len = 0;
+
+static int key_trie_find_child(int node, unsigned char byte)
 {
-	int n = 0;
-	while (*s2 && n < len) {
-		if (*s1++ != *s2++)
-			return false;
-		n++;
+	int c;
+	for (c = key_trie[node].child; c != -1; c = key_trie[c].sibling) {
+		if (key_trie[c].byte == byte)
+			return c;
 	}
-	return *s2 == 0;
+	return -1;
 }
 
-static int parse_mouse_event(struct tb_event *event, const char *buf, int len) {
-	if (len >= 6 && starts_with(buf, len, "\033[M")) {
-		// X10 mouse encoding, the simplest one
-		// \033 [ M Cb Cx Cy
-		int b = buf[3] - 32;
-		switch (b & 3) {
-		case 0:
-			if ((b & 64) != 0)
-				event->key = TB_KEY_MOUSE_WHEEL_UP;
-			else
-				event->key = TB_KEY_MOUSE_LEFT;
-			break;
-		case 1:
-			if ((b & 64) != 0)
-				event->key = TB_KEY_MOUSE_WHEEL_DOWN;
-			else
-				event->key = TB_KEY_MOUSE_MIDDLE;
-			break;
-		case 2:
-			event->key = TB_KEY_MOUSE_RIGHT;
-			break;
-		case 3:
-			event->key = TB_KEY_MOUSE_RELEASE;
-			break;
-		default:
-			return -6;
+static void key_trie_insert(const char *seq, uint16_t key)
+{
+	int node = 0;
+	for (; *seq; seq++) {
+		int c = key_trie_find_child(node, (unsigned char)*seq);
+		if (c == -1) {
+			c = key_trie_len++;
+			key_trie[c].byte = (unsigned char)*seq;
+			key_trie[c].key = 0;
+			key_trie[c].child = -1;
+			key_trie[c].sibling = key_trie[node].child;
+			key_trie[node].child = c;
 		}
-		event->type = TB_EVENT_MOUSE; // TB_EVENT_KEY by default
-		if ((b & 32) != 0)
-			event->mod |= TB_MOD_MOTION;
-
-		// the coord is 1,1 for upper left
-		event->x = (uint8_t)buf[4] - 1 - 32;
-		event->y = (uint8_t)buf[5] - 1 - 32;
-
-		return 6;
-	} else if (starts_with(buf, len, "\033[<") || starts_with(buf, len, "\033[")) {
-		// xterm 1006 extended mode or urxvt 1015 extended mode
-		// xterm: \033 [ < Cb ; Cx ; Cy (M or m)
-		// urxvt: \033 [ Cb ; Cx ; Cy M
-		int i, mi = -1, starti = -1;
-		int isM, isU, s1 = -1, s2 = -1;
-		int n1 = 0, n2 = 0, n3 = 0;
-
-		for (i = 0; i < len; i++) {
-			// We search the first (s1) and the last (s2) ';'
-			if (buf[i] == ';') {
-				if (s1 == -1)
-					s1 = i;
-				s2 = i;
-			}
+		node = c;
+	}
+	// keep the first definition, like the old linear scan did
+	if (node != 0 && key_trie[node].key == 0)
+		key_trie[node].key = key;
+}
 
-			// We search for the first 'm' or 'M'
-			if ((buf[i] == 'm' || buf[i] == 'M') && mi == -1) {
-				mi = i;
-				break;
-			}
-		}
-		if (mi == -1)
-			return 0;
+static void key_trie_init(const char **tkeys)
+{
+	int i, cap = 1;
+	for (i = 0; tkeys[i]; i++)
+		cap += strlen(tkeys[i]);
 
-		// whether it's a capital M or not
-		isM = (buf[mi] == 'M');
+	key_trie = static_cast<struct key_trie_node*>(malloc(sizeof(struct key_trie_node) * cap));
+	key_trie_len = 1;
+	key_trie[0].byte = 0;
+	key_trie[0].key = 0;
+	key_trie[0].child = -1;
+	key_trie[0].sibling = -1;
 
-		if (buf[2] == '<') {
-			isU = 0;
-			starti = 3;
-		} else {
-			isU = 1;
-			starti = 2;
+	for (i = 0; tkeys[i]; i++)
+		key_trie_insert(tkeys[i], 0xFFFF-i);
+}
+
+static void key_trie_free(void)
+{
+	free(key_trie);
+	key_trie = 0;
+	key_trie_len = 0;
+}
+
+// exact lookup of a whole sequence, 0 if it's not a known key
+static uint16_t key_trie_lookup(const char *seq, int len)
+{
+	int i, node = 0;
+	for (i = 0; i < len && node != -1; i++)
+		node = key_trie_find_child(node, (unsigned char)seq[i]);
+	return node > 0 ? key_trie[node].key : 0;
+}
+
+//----------------------------------------------------------------------
+// CSI sequences
+//----------------------------------------------------------------------
+
+#define CSI_MAX_PARAMS 16
+// anything longer is garbage rather than a sequence we could understand
+#define CSI_MAX_LEN 64
+
+struct csi_seq {
+	char marker; // private marker ('<', '=', '>' or '?'), 0 if none
+	char final;
+	int nparams;
+	int params[CSI_MAX_PARAMS]; // -1 for omitted parameters
+};
+
+enum {
+	CSI_START, // right after ESC [
+	CSI_PARAMS,
+	CSI_SUBPARAM, // after ':', sub-parameters are ignored
+	CSI_INTERMEDIATE,
+	CSI_DONE,
+	CSI_DEAD,
+};
+
+// feed one byte into the CSI recognizer. 'i' is the index of the byte in the
+// sequence, the leading ESC [ is checked by the caller
+static int csi_step(struct csi_seq *csi, int state, int i, unsigned char c)
+{
+	if (i >= CSI_MAX_LEN)
+		return CSI_DEAD;
+
+	switch (state) {
+	case CSI_START:
+		if (c == '<' || c == '=' || c == '>' || c == '?') {
+			csi->marker = c;
+			return CSI_PARAMS;
+		}
+		// fall through
+	case CSI_PARAMS:
+	case CSI_SUBPARAM:
+		if (c >= '0' && c <= '9') {
+			if (state == CSI_SUBPARAM)
+				return CSI_SUBPARAM;
+			if (csi->nparams == 0)
+				csi->nparams = 1;
+			int *p = &csi->params[csi->nparams-1];
+			*p = (*p < 0 ? 0 : *p * 10) + (c - '0');
+			return CSI_PARAMS;
+		}
+		if (c == ';') {
+			if (csi->nparams == 0)
+				csi->nparams = 1;
+			if (csi->nparams == CSI_MAX_PARAMS)
+				return CSI_DEAD;
+			csi->nparams++;
+			return CSI_PARAMS;
 		}
+		if (c == ':')
+			return CSI_SUBPARAM;
+		// fall through
+	case CSI_INTERMEDIATE:
+		if (c >= 0x20 && c <= 0x2F)
+			return CSI_INTERMEDIATE;
+		if (c >= 0x40 && c <= 0x7E) {
+			csi->final = c;
+			return CSI_DONE;
+		}
+		return CSI_DEAD;
+	}
+	return CSI_DEAD;
+}
 
-		if (s1 == -1 || s2 == -1 || s1 == s2)
-			return 0;
+static int csi_param(const struct csi_seq *csi, int i, int def)
+{
+	if (i >= csi->nparams || csi->params[i] < 0)
+		return def;
+	return csi->params[i];
+}
 
-		n1 = strtoul(&buf[starti], NULL, 10);
-		n2 = strtoul(&buf[s1 + 1], NULL, 10);
-		n3 = strtoul(&buf[s2 + 1], NULL, 10);
-		
-		if (isU)
-			n1 -= 32;
-
-		switch (n1 & 3) {
-		case 0:
-			if ((n1&64) != 0) {
-				event->key = TB_KEY_MOUSE_WHEEL_UP;
-			} else {
-				event->key = TB_KEY_MOUSE_LEFT;
-			}
-			break;
-		case 1:
-			if ((n1&64) != 0) {
-				event->key = TB_KEY_MOUSE_WHEEL_DOWN;
-			} else {
-				event->key = TB_KEY_MOUSE_MIDDLE;
+// xterm style modifier parameter: 1 + (shift | alt << 1 | ctrl << 2 | meta << 3)
+static uint8_t csi_modifiers(int param)
+{
+	uint8_t mod = 0;
+	if (param <= 1)
+		return 0;
+	param -= 1;
+	if (param & 1)
+		mod |= TB_MOD_SHIFT;
+	if (param & (2 | 8))
+		mod |= TB_MOD_ALT;
+	if (param & 4)
+		mod |= TB_MOD_CTRL;
+	return mod;
+}
+
+// fill key and mod of a mouse event from the button byte shared by all
+// encodings:
+//   bits 0-1: button (0 left, 1 middle, 2 right, 3 release)
+//   bit 2: shift, bit 3: meta, bit 4: ctrl
+//   bit 5: motion, bit 6: wheel (buttons 4-7)
+// returns false for buttons termbox can't represent (horizontal wheel etc.)
+static bool fill_mouse_button(struct tb_event *event, int b)
+{
+	if (b < 0 || (b & 128) != 0)
+		return false;
+	switch (b & 3) {
+	case 0:
+		event->key = (b & 64) ? TB_KEY_MOUSE_WHEEL_UP : TB_KEY_MOUSE_LEFT;
+		break;
+	case 1:
+		event->key = (b & 64) ? TB_KEY_MOUSE_WHEEL_DOWN : TB_KEY_MOUSE_MIDDLE;
+		break;
+	case 2:
+		if ((b & 64) != 0)
+			return false;
+		event->key = TB_KEY_MOUSE_RIGHT;
+		break;
+	case 3:
+		if ((b & 64) != 0)
+			return false;
+		event->key = TB_KEY_MOUSE_RELEASE;
+		break;
+	}
+	event->type = TB_EVENT_MOUSE; // TB_EVENT_KEY by default
+	event->ch = 0;
+	if ((b & 4) != 0)
+		event->mod |= TB_MOD_SHIFT;
+	if ((b & 8) != 0)
+		event->mod |= TB_MOD_ALT;
+	if ((b & 16) != 0)
+		event->mod |= TB_MOD_CTRL;
+	if ((b & 32) != 0)
+		event->mod |= TB_MOD_MOTION;
+	return true;
+}
+
+// key event from a unicode codepoint, as reported by CSI-u and modifyOtherKeys
+static void fill_codepoint_key(struct tb_event *event, uint32_t cp, uint8_t mod)
+{
+	event->mod |= mod;
+	if ((mod & TB_MOD_CTRL) && ((cp >= 'a' && cp <= 'z') || (cp >= '@' && cp <= '_'))) {
+		// map to the same keys legacy encoding produces
+		event->key = cp & 0x1F;
+		event->ch = 0;
+	} else if (cp <= TB_KEY_SPACE || cp == TB_KEY_BACKSPACE2) {
+		event->key = cp;
+		event->ch = 0;
+	} else {
+		event->key = 0;
+		event->ch = cp;
+	}
+}
+
+// the key sent for final byte 'final' without modifiers, in either the
+// normal (CSI) or application (SS3) cursor mode
+static uint16_t unmodified_key(char final)
+{
+	char seq[3] = {'\033', '[', final};
+	uint16_t key = key_trie_lookup(seq, 3);
+	if (key == 0) {
+		seq[1] = 'O';
+		key = key_trie_lookup(seq, 3);
+	}
+	return key;
+}
+
+// convert a complete CSI sequence into an event. returns the number of
+// consumed bytes (len, or more for X10 mouse reports), its negation if the
+// sequence is understood to carry nothing we can report, or 0 if more bytes
+// are needed
+static int decode_csi(struct tb_event *event, const struct csi_seq *csi,
+		      const char *buf, int len, int seqlen)
+{
+	if (csi->final == 'M' || csi->final == 'm') {
+		if (csi->marker == '<' && csi->nparams == 3) {
+			// xterm 1006 extended mode
+			// \033 [ < Cb ; Cx ; Cy (M or m)
+			if (!fill_mouse_button(event, csi_param(csi, 0, 0)))
+				return -seqlen;
+			if (csi->final == 'm') {
+				// on xterm mouse release is signaled by lowercase m
+				event->key = TB_KEY_MOUSE_RELEASE;
 			}
-			break;
-		case 2:
-			event->key = TB_KEY_MOUSE_RIGHT;
-			break;
-		case 3:
-			event->key = TB_KEY_MOUSE_RELEASE;
-			break;
-		default:
-			return mi + 1;
+			event->x = csi_param(csi, 1, 1) - 1;
+			event->y = csi_param(csi, 2, 1) - 1;
+			return seqlen;
 		}
-
-		if (!isM) {
-			// on xterm mouse release is signaled by lowercase m
-			event->key = TB_KEY_MOUSE_RELEASE;
+		if (csi->marker == 0 && csi->final == 'M' && csi->nparams == 3) {
+			// urxvt 1015 extended mode
+			// \033 [ Cb ; Cx ; Cy M
+			if (!fill_mouse_button(event, csi_param(csi, 0, 0) - 32))
+				return -seqlen;
+			event->x = csi_param(csi, 1, 1) - 1;
+			event->y = csi_param(csi, 2, 1) - 1;
+			return seqlen;
 		}
+		if (csi->marker == 0 && csi->final == 'M' && csi->nparams == 0) {
+			// X10 mouse encoding, the simplest one
+			// \033 [ M Cb Cx Cy
+			// coordinates are a single byte each, so this can't go past 223
+			if (len < seqlen + 3)
+				return 0;
+			if (!fill_mouse_button(event, (uint8_t)buf[seqlen] - 32))
+				return -(seqlen + 3);
 
-		event->type = TB_EVENT_MOUSE; // TB_EVENT_KEY by default
-		if ((n1&32) != 0)
-			event->mod |= TB_MOD_MOTION;
+			// the coord is 1,1 for upper left
+			event->x = (uint8_t)buf[seqlen+1] - 1 - 32;
+			event->y = (uint8_t)buf[seqlen+2] - 1 - 32;
+			return seqlen + 3;
+		}
+		return -seqlen;
+	}
 
-		event->x = (uint8_t)n2 - 1;
-		event->y = (uint8_t)n3 - 1;
+	if (csi->marker != 0)
+		return -seqlen;
 
-		return mi + 1;
+	switch (csi->final) {
+	case 'u': {
+		// fixterms / kitty keyboard protocol
+		// \033 [ codepoint ; modifiers u
+		uint32_t cp = csi_param(csi, 0, 0);
+		// functional keys of the kitty protocol live in the private use area
+		if (cp >= 0xE000 && cp <= 0xF8FF)
+			return -seqlen;
+		fill_codepoint_key(event, cp, csi_modifiers(csi_param(csi, 1, 1)));
+		return seqlen;
+	}
+	case '~': {
+		if (csi_param(csi, 0, 0) == 27 && csi->nparams >= 3) {
+			// xterm modifyOtherKeys
+			// \033 [ 27 ; modifiers ; codepoint ~
+			fill_codepoint_key(event, csi_param(csi, 2, 0),
+				csi_modifiers(csi_param(csi, 1, 1)));
+			return seqlen;
+		}
+		// modified editing / function keys, e.g. \033 [ 15 ; 5 ~ for ctrl+F5
+		char seq[16];
+		int n = snprintf(seq, sizeof(seq), "\033[%d~", csi_param(csi, 0, 0));
+		uint16_t key = key_trie_lookup(seq, n);
+		if (key == 0)
+			return -seqlen;
+		event->key = key;
+		event->ch = 0;
+		event->mod |= csi_modifiers(csi_param(csi, 1, 1));
+		return seqlen;
+	}
+	case 'Z':
+		// back tab
+		event->key = TB_KEY_TAB;
+		event->ch = 0;
+		event->mod |= TB_MOD_SHIFT;
+		return seqlen;
+	default: {
+		// modified cursor keys and F1-F4, e.g. \033 [ 1 ; 5 A for ctrl+up
+		uint16_t key = unmodified_key(csi->final);
+		if (key == 0)
+			return -seqlen;
+		event->key = key;
+		event->ch = 0;
+		event->mod |= csi_modifiers(csi_param(csi, 1, 1));
+		return seqlen;
+	}
 	}
-
-	return 0;
 }
 
-// convert escape sequence to event, and return consumed bytes on success (failure == 0)
-static int parse_escape_seq(struct tb_event *event, const char *buf, int len)
+//----------------------------------------------------------------------
+// escape sequence matching
+//----------------------------------------------------------------------
+
+// convert escape sequence to event, and return consumed bytes on success
+// (failure == 0). a negative result means the bytes form a sequence that
+// should be dropped without generating an event.
+// if buf ends in the middle of what may still become a longer sequence, 0 is
+// returned and *partial is set so the caller can wait for the rest, unless
+// 'timed_out' says the rest isn't coming
+static int parse_escape_seq(struct tb_event *event, const char *buf, int len,
+			    bool timed_out, bool *partial)
 {
-	int mouse_parsed = parse_mouse_event(event, buf, len);
+	// walk the key trie and the CSI recognizer side by side, so every byte
+	// is looked at once no matter which of them ends up matching
+	int node = 0;
+	int trie_match = 0;
+	uint16_t trie_key = 0;
 
-	if (mouse_parsed != 0)
-		return mouse_parsed;
+	struct csi_seq csi;
+	int csi_state = CSI_DEAD;
+	int csi_len = 0;
 
-	// it's pretty simple here, find 'starts_with' match and return
-	// success, else return failure
 	int i;
-	for (i = 0; keys[i]; i++) {
-		if (starts_with(buf, len, keys[i])) {
-			event->ch = 0;
-			event->key = 0xFFFF-i;
-			return strlen(keys[i]);
+	*partial = false;
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)buf[i];
+		if (node != -1) {
+			node = key_trie_find_child(node, c);
+			if (node != -1 && key_trie[node].key != 0) {
+				trie_match = i + 1;
+				trie_key = key_trie[node].key;
+			}
+		}
+
+		if (i == 1 && c == '[') {
+			memset(&csi, 0, sizeof(csi));
+			memset(csi.params, -1, sizeof(csi.params));
+			csi_state = CSI_START;
+		} else if (i > 1 && csi_state != CSI_DEAD && csi_state != CSI_DONE) {
+			csi_state = csi_step(&csi, csi_state, i, c);
+			if (csi_state == CSI_DONE)
+				csi_len = i + 1;
+		}
+
+		bool csi_alive = csi_state != CSI_DEAD && csi_state != CSI_DONE;
+		if ((node == -1 || key_trie[node].child == -1) && !csi_alive)
+			break;
+	}
+
+	// ran out of input while a longer match was still possible
+	if (i == len && !timed_out && trie_match < len) {
+		bool trie_alive = len == 1 || (node != -1 && key_trie[node].child != -1);
+		bool csi_alive = csi_state != CSI_DEAD && csi_state != CSI_DONE;
+		if (trie_alive || csi_alive) {
+			*partial = true;
+			return 0;
 		}
 	}
+
+	// prefer the longest complete match, terminfo wins a tie
+	if (csi_len > trie_match) {
+		int n = decode_csi(event, &csi, buf, len, csi_len);
+		if (n == 0 && !timed_out)
+			*partial = true;
+		return n;
+	}
+	if (trie_match > 0) {
+		event->ch = 0;
+		event->key = trie_key;
+		return trie_match;
+	}
 	return 0;
 }
 
-static bool extract_event(struct tb_event *event, struct bytebuffer *inbuf, int inputmode)
+// extract a single event from the input buffer. an escape sequence cut short
+// by the end of the buffer is kept until more input arrives, unless
+// 'esc_timeout' tells us none will, in which case it's ESC or ALT
+static bool extract_event(struct tb_event *event, struct inputbuffer *inbuf, int inputmode,
+			  bool esc_timeout, bool *partial)
 {
-	const char *buf = inbuf->buf;
-	const int len = inbuf->len;
+	const char *buf = inputbuffer_data(inbuf);
+	const int len = inputbuffer_len(inbuf);
+	*partial = false;
 	if (len == 0)
 		return false;
 
 	if (buf[0] == '\033') {
-		int n = parse_escape_seq(event, buf, len);
+		int n = parse_escape_seq(event, buf, len, esc_timeout, partial);
+		if (*partial)
+			return false;
 		if (n != 0) {
 			bool success = true;
 			if (n < 0) {
 				success = false;
 				n = -n;
 			}
-			bytebuffer_truncate(inbuf, n);
+			inputbuffer_consume(inbuf, n);
 			return success;
 		} else {
 			// it's not escape sequence, then it's ALT or ESC,
@@ -184,14 +451,14 @@ static bool extract_event(struct tb_event *event, struct bytebuffer *inbuf, int
 				event->ch = 0;
 				event->key = TB_KEY_ESC;
 				event->mod = 0;
-				bytebuffer_truncate(inbuf, 1);
+				inputbuffer_consume(inbuf, 1);
 				return true;
 			} else if (inputmode&TB_INPUT_ALT) {
 				// if we're in alt mode, set ALT modifier to
 				// event and redo parsing
 				event->mod = TB_MOD_ALT;
-				bytebuffer_truncate(inbuf, 1);
-				return extract_event(event, inbuf, inputmode);
+				inputbuffer_consume(inbuf, 1);
+				return extract_event(event, inbuf, inputmode, esc_timeout, partial);
 			}
 			assert(!"never got here");
 		}
@@ -207,7 +474,7 @@ static bool extract_event(struct tb_event *event, struct bytebuffer *inbuf, int
 		// fill event, pop buffer, return success */
 		event->ch = 0;
 		event->key = (uint16_t)buf[0];
-		bytebuffer_truncate(inbuf, 1);
+		inputbuffer_consume(inbuf, 1);
 		return true;
 	}
 
@@ -218,7 +485,7 @@ static bool extract_event(struct tb_event *event, struct bytebuffer *inbuf, int
 		/* everything ok, fill event, pop buffer, return success */
 		tb_utf8_char_to_unicode(&event->ch, buf);
 		event->key = 0;
-		bytebuffer_truncate(inbuf, tb_utf8_char_length(buf[0]));
+		inputbuffer_consume(inbuf, tb_utf8_char_length(buf[0]));
 		return true;
 	}
 
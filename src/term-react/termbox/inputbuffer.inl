@@ -0,0 +1,62 @@
+/* bytes read from the terminal and not parsed yet, buf[start, end). events
+ * are consumed by moving 'start' forward, bytes are only moved when making
+ * room at the back, and then only the unparsed ones (usually the beginning of
+ * a sequence whose end hasn't arrived yet) */
+struct inputbuffer {
+	char *buf;
+	int start;
+	int end;
+	int cap;
+};
+
+static void inputbuffer_init(struct inputbuffer *b, int cap) {
+	b->buf = static_cast<char*>(malloc(cap));
+	b->start = b->end = 0;
+	b->cap = cap;
+}
+
+static void inputbuffer_free(struct inputbuffer *b) {
+	free(b->buf);
+	b->buf = 0;
+	b->start = b->end = b->cap = 0;
+}
+
+static int inputbuffer_len(const struct inputbuffer *b) {
+	return b->end - b->start;
+}
+
+static const char *inputbuffer_data(const struct inputbuffer *b) {
+	return b->buf + b->start;
+}
+
+static void inputbuffer_consume(struct inputbuffer *b, int n) {
+	if (n <= 0)
+		return;
+	b->start += (n < b->end - b->start) ? n : b->end - b->start;
+	if (b->start == b->end)
+		b->start = b->end = 0;
+}
+
+/* make sure at least n bytes can be appended at the back and return where */
+static char *inputbuffer_reserve_tail(struct inputbuffer *b, int n) {
+	if (b->cap - b->end >= n)
+		return b->buf + b->end;
+
+	int len = b->end - b->start;
+	if (b->start > 0) {
+		memmove(b->buf, b->buf + b->start, len);
+		b->start = 0;
+		b->end = len;
+	}
+	if (b->cap - b->end < n) {
+		int cap = (b->cap * 2 > len + n) ? b->cap * 2 : len + n;
+		b->buf = static_cast<char*>(realloc(b->buf, cap));
+		b->cap = cap;
+	}
+	return b->buf + b->end;
+}
+
+/* the caller wrote n bytes at the pointer returned by inputbuffer_reserve_tail() */
+static void inputbuffer_commit(struct inputbuffer *b, int n) {
+	b->end += n;
+}
@@ -0,0 +1,236 @@
+/* the input of a terminal as it was read, with the time, see
+ * tb_capture_input(), and the replay of such a log in place of the
+ * terminal, see tb_replay_input(). a log is a magic followed by records,
+ * each one with its payload right after it: the bytes read, or the size of
+ * the terminal (two int32_t) when it got resized */
+
+#define INPUTLOG_MAGIC "TBINP\0\1\0"
+#define INPUTLOG_MAGIC_LEN 8
+
+/* writes are batched, at most this much or this long */
+#define INPUTLOG_FLUSH_BYTES (16 * 1024)
+#define INPUTLOG_FLUSH_US 1000000
+
+enum {
+	INPUTLOG_BYTES = 1,
+	INPUTLOG_RESIZE = 2,
+};
+
+/* payloads are padded so that the next record is aligned. in 64 bits, a
+ * length read from a log may be anything */
+#define INPUTLOG_PADDED(len) (((uint64_t)(len) + 7) & ~(uint64_t)7)
+
+struct inputlog_record {
+	uint32_t type;
+	uint32_t len; /* of the payload, without the padding */
+	int64_t time_us; /* since the capture started */
+};
+
+struct inputlog {
+	int fd;
+	int64_t start_us;
+	int64_t last_flush_us;
+	struct bytebuffer buf;
+};
+
+static int64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void inputlog_flush(struct inputlog *log)
+{
+	int off = 0;
+	while (off < log->buf.len) {
+		ssize_t n = write(log->fd, log->buf.buf + off, log->buf.len - off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	bytebuffer_clear(&log->buf);
+	log->last_flush_us = monotonic_us();
+}
+
+static struct inputlog *inputlog_open(const char *path, int *err)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		*err = errno;
+		return 0;
+	}
+	struct inputlog *log = static_cast<struct inputlog*>(calloc(1, sizeof(struct inputlog)));
+	log->fd = fd;
+	log->start_us = log->last_flush_us = monotonic_us();
+	bytebuffer_init(&log->buf, INPUTLOG_FLUSH_BYTES + 4096);
+	bytebuffer_append(&log->buf, INPUTLOG_MAGIC, INPUTLOG_MAGIC_LEN);
+	return log;
+}
+
+static void inputlog_close(struct inputlog *log)
+{
+	inputlog_flush(log);
+	close(log->fd);
+	bytebuffer_free(&log->buf);
+	free(log);
+}
+
+static void inputlog_add(struct inputlog *log, uint32_t type, const void *data, int len)
+{
+	int64_t now = monotonic_us();
+	struct inputlog_record rec = {type, (uint32_t)len, now - log->start_us};
+	bytebuffer_append(&log->buf, (const char*)&rec, sizeof(rec));
+	bytebuffer_append(&log->buf, (const char*)data, len);
+	static const char padding[8] = {0};
+	bytebuffer_append(&log->buf, padding, INPUTLOG_PADDED(len) - len);
+	if (log->buf.len >= INPUTLOG_FLUSH_BYTES || now - log->last_flush_us >= INPUTLOG_FLUSH_US)
+		inputlog_flush(log);
+}
+
+struct replay {
+	char *data;
+	int len;
+	int pos;
+	int flags;
+	int64_t start_us;
+	/* when the last record was handed out, the events it completes are
+	 * stamped with it */
+	int64_t taken_us;
+	/* when the events reported since the last present were handed out, a
+	 * present ends their latency */
+	int64_t *injected;
+	int injected_len;
+	int injected_cap;
+	int64_t *latencies;
+	int latencies_len;
+	int latencies_cap;
+};
+
+static struct replay *replay_open(const char *path, int flags, int *err)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		*err = errno;
+		return 0;
+	}
+	struct bytebuffer b;
+	bytebuffer_init(&b, 64 * 1024);
+	char chunk[16 * 1024];
+	ssize_t n;
+	while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+		bytebuffer_append(&b, chunk, n);
+	close(fd);
+	if (b.len < INPUTLOG_MAGIC_LEN || memcmp(b.buf, INPUTLOG_MAGIC, INPUTLOG_MAGIC_LEN) != 0) {
+		bytebuffer_free(&b);
+		*err = EINVAL;
+		return 0;
+	}
+
+	struct replay *r = static_cast<struct replay*>(calloc(1, sizeof(struct replay)));
+	r->data = b.buf;
+	r->len = b.len;
+	r->pos = INPUTLOG_MAGIC_LEN;
+	r->flags = flags;
+	r->start_us = monotonic_us();
+	return r;
+}
+
+static void replay_free(struct replay *r)
+{
+	free(r->data);
+	free(r->injected);
+	free(r->latencies);
+	free(r);
+}
+
+/* the next record, NULL at the end (or at a record cut short, or claiming
+ * more than what's left) */
+static const struct inputlog_record *replay_next(const struct replay *r)
+{
+	if (r->len - r->pos < (int)sizeof(struct inputlog_record))
+		return 0;
+	const struct inputlog_record *rec = (const struct inputlog_record*)(r->data + r->pos);
+	uint64_t left = (uint64_t)(r->len - r->pos) - sizeof(*rec);
+	if (INPUTLOG_PADDED(rec->len) > left)
+		return 0;
+	return rec;
+}
+
+/* microseconds until the next record is due, -1 if none will be until the
+ * next present. as fast as possible, a record is due once the events before
+ * it have been presented */
+static int64_t replay_due_in(const struct replay *r)
+{
+	const struct inputlog_record *rec = replay_next(r);
+	if (!rec)
+		return -1;
+	if (r->flags & TB_REPLAY_MAX_SPEED)
+		return r->injected_len == 0 ? 0 : -1;
+	int64_t due = r->start_us + rec->time_us - monotonic_us();
+	return due > 0 ? due : 0;
+}
+
+/* all the records were handed out and presented */
+static bool replay_done(const struct replay *r)
+{
+	return !replay_next(r) && r->injected_len == 0;
+}
+
+static const struct inputlog_record *replay_take(struct replay *r)
+{
+	const struct inputlog_record *rec = replay_next(r);
+	r->pos += sizeof(*rec) + INPUTLOG_PADDED(rec->len);
+	r->taken_us = monotonic_us();
+	return rec;
+}
+
+/* an event was reported. its last byte came with the last record taken,
+ * the ones still buffered are reported before another one is */
+static void replay_reported(struct replay *r)
+{
+	if (r->injected_len == r->injected_cap) {
+		r->injected_cap = r->injected_cap ? r->injected_cap * 2 : 16;
+		r->injected = static_cast<int64_t*>(realloc(r->injected, sizeof(int64_t) * r->injected_cap));
+	}
+	r->injected[r->injected_len++] = r->taken_us;
+}
+
+static void replay_presented(struct replay *r)
+{
+	int i;
+	int64_t now = monotonic_us();
+	if (r->latencies_len + r->injected_len > r->latencies_cap) {
+		r->latencies_cap = (r->latencies_len + r->injected_len) * 2;
+		r->latencies = static_cast<int64_t*>(realloc(r->latencies, sizeof(int64_t) * r->latencies_cap));
+	}
+	for (i = 0; i < r->injected_len; ++i)
+		r->latencies[r->latencies_len++] = now - r->injected[i];
+	r->injected_len = 0;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void replay_stats(struct replay *r, struct tb_replay_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->events = r->latencies_len;
+	if (r->latencies_len == 0)
+		return;
+	int64_t *sorted = static_cast<int64_t*>(malloc(sizeof(int64_t) * r->latencies_len));
+	memcpy(sorted, r->latencies, sizeof(int64_t) * r->latencies_len);
+	qsort(sorted, r->latencies_len, sizeof(int64_t), compare_int64);
+	/* nearest rank */
+	int n = r->latencies_len;
+	stats->p50_us = sorted[(n * 50 + 99) / 100 - 1];
+	stats->p90_us = sorted[(n * 90 + 99) / 100 - 1];
+	stats->p99_us = sorted[(n * 99 + 99) / 100 - 1];
+	stats->max_us = sorted[n - 1];
+	free(sorted);
+}
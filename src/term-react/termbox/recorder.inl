@@ -0,0 +1,198 @@
+/* recordings of what a context presented, see tb_record(). a recording is
+ * the stream a viewer gets (session.inl) with the wall clock time before
+ * every frame, appended to a file: keyframes every now and then so that
+ * any part of it can be played back, and the frames in between as diffs.
+ * with TB_RECORD_COMPRESS the spans are run-length encoded. a keyframe
+ * comes with all the styles made so far */
+
+#define RECORDER_MAGIC "TBREC\0\1\0"
+#define RECORDER_MAGIC_LEN 8
+
+/* writes are batched, at most this much or this long */
+#define RECORDER_FLUSH_BYTES (64 * 1024)
+#define RECORDER_FLUSH_US 1000000
+
+struct recorder {
+	int fd;
+	int flags;
+	int64_t keyframe_interval_us;
+	int64_t last_keyframe_us;
+	int64_t last_flush_us;
+	bool needs_keyframe;
+	/* of the last frame written, an unchanged frame is left out */
+	int width, height;
+	int cursor_x, cursor_y;
+	int outputmode;
+	int styles_written;
+	struct bytebuffer buf;
+	struct bytebuffer keyframe;
+};
+
+static int64_t realtime_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void recorder_flush(struct recorder *r)
+{
+	int off = 0;
+	while (off < r->buf.len) {
+		ssize_t n = write(r->fd, r->buf.buf + off, r->buf.len - off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		/* a full disk loses what it can't take, the frame loop goes on */
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	bytebuffer_clear(&r->buf);
+	r->last_flush_us = realtime_us();
+}
+
+static struct recorder *recorder_open(const char *path, int keyframe_interval_ms, int flags, int *err)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		*err = errno;
+		return 0;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		*err = errno;
+		close(fd);
+		return 0;
+	}
+
+	struct recorder *r = static_cast<struct recorder*>(calloc(1, sizeof(struct recorder)));
+	r->fd = fd;
+	r->flags = flags;
+	r->keyframe_interval_us = (int64_t)(keyframe_interval_ms > 0 ? keyframe_interval_ms : 30000) * 1000;
+	r->needs_keyframe = true;
+	r->last_flush_us = realtime_us();
+	bytebuffer_init(&r->buf, RECORDER_FLUSH_BYTES + 4096);
+	bytebuffer_init(&r->keyframe, 4096);
+	/* another recording can be appended to an existing one */
+	if (st.st_size == 0)
+		bytebuffer_append(&r->buf, RECORDER_MAGIC, RECORDER_MAGIC_LEN);
+	return r;
+}
+
+static void recorder_close(struct recorder *r)
+{
+	recorder_flush(r);
+	close(r->fd);
+	bytebuffer_free(&r->buf);
+	bytebuffer_free(&r->keyframe);
+	free(r);
+}
+
+/* appends the frame message at 'data' with its spans turned into runs */
+static void recorder_append_rle(struct recorder *r, const struct session_msg *msg, const char *data)
+{
+	struct session_frame frame;
+	memcpy(&frame, data, sizeof(frame));
+	frame.rle = 1;
+	int msg_offset = r->buf.len;
+	bytebuffer_append(&r->buf, (const char*)msg, sizeof(*msg));
+	bytebuffer_append(&r->buf, (const char*)&frame, sizeof(frame));
+
+	const char *p = data + sizeof(frame);
+	uint32_t i;
+	int x;
+	for (i = 0; i < frame.spans; ++i) {
+		struct session_span span;
+		memcpy(&span, p, sizeof(span));
+		p += sizeof(span);
+		const struct tb_cell *cells = (const struct tb_cell*)p;
+		p += sizeof(struct tb_cell) * span.n;
+
+		int span_offset = r->buf.len;
+		bytebuffer_append(&r->buf, (const char*)&span, sizeof(span));
+		span.runs = 0;
+		for (x = 0; x < span.n; ) {
+			struct session_run run = {1, cells[x]};
+			while (x + (int)run.count < span.n &&
+			       memcmp(&cells[x + run.count], &run.cell, sizeof(struct tb_cell)) == 0)
+				run.count++;
+			bytebuffer_append(&r->buf, (const char*)&run, sizeof(run));
+			span.runs++;
+			x += run.count;
+		}
+		if (sizeof(struct session_run) * span.runs >= sizeof(struct tb_cell) * span.n) {
+			/* no runs to speak of, the cells go as they are */
+			r->buf.len = span_offset + sizeof(span);
+			bytebuffer_append(&r->buf, (const char*)cells, sizeof(struct tb_cell) * span.n);
+			span.runs = 0;
+		}
+		memcpy(r->buf.buf + span_offset, &span, sizeof(span));
+	}
+
+	struct session_msg encoded = {msg->type, (uint32_t)(r->buf.len - msg_offset - sizeof(*msg))};
+	memcpy(r->buf.buf + msg_offset, &encoded, sizeof(encoded));
+}
+
+static void recorder_append(struct recorder *r, const char *data, int len)
+{
+	if (!(r->flags & TB_RECORD_COMPRESS)) {
+		bytebuffer_append(&r->buf, data, len);
+		return;
+	}
+	const char *end = data + len;
+	while (data < end) {
+		struct session_msg msg;
+		memcpy(&msg, data, sizeof(msg));
+		data += sizeof(msg);
+		if (msg.type == SESSION_MSG_FRAME) {
+			recorder_append_rle(r, &msg, data);
+		} else {
+			bytebuffer_append(&r->buf, (const char*)&msg, sizeof(msg));
+			bytebuffer_append(&r->buf, data, msg.len);
+		}
+		data += msg.len;
+	}
+}
+
+/* 'pending' is what the viewers in sync get for this frame, sealed by
+ * session_seal_frame(), and 'screen' the screen it results in */
+static void recorder_frame(struct recorder *r, const struct bytebuffer *pending, const struct cellbuf *screen,
+			   const struct cluster_pool *clusters, int cursor_x, int cursor_y, int outputmode)
+{
+	int64_t now = realtime_us();
+	bool keyframe = r->needs_keyframe || screen->width != r->width || screen->height != r->height ||
+		now - r->last_keyframe_us >= r->keyframe_interval_us;
+	/* nothing but an empty frame: no spans and no scrolls before it */
+	bool changed = keyframe || pending->len > (int)(sizeof(struct session_msg) + sizeof(struct session_frame)) ||
+		cursor_x != r->cursor_x || cursor_y != r->cursor_y || outputmode != r->outputmode;
+
+	if (changed) {
+		struct session_msg msg = {SESSION_MSG_TIME, sizeof(now)};
+		bytebuffer_append(&r->buf, (const char*)&msg, sizeof(msg));
+		bytebuffer_append(&r->buf, (const char*)&now, sizeof(now));
+		int styles = style_published();
+		if (keyframe)
+			r->styles_written = 0;
+		if (r->styles_written < styles) {
+			session_styles(&r->buf, r->styles_written, styles);
+			r->styles_written = styles;
+		}
+		if (keyframe) {
+			bytebuffer_clear(&r->keyframe);
+			session_keyframe(&r->keyframe, screen, clusters, cursor_x, cursor_y, outputmode);
+			recorder_append(r, r->keyframe.buf, r->keyframe.len);
+			r->last_keyframe_us = now;
+			r->needs_keyframe = false;
+		} else {
+			recorder_append(r, pending->buf, pending->len);
+		}
+		r->width = screen->width;
+		r->height = screen->height;
+		r->cursor_x = cursor_x;
+		r->cursor_y = cursor_y;
+		r->outputmode = outputmode;
+	}
+
+	if (r->buf.len >= RECORDER_FLUSH_BYTES || now - r->last_flush_us >= RECORDER_FLUSH_US)
+		recorder_flush(r);
+}
@@ -0,0 +1,146 @@
+/* per-row hashes of the cell buffers. tb_present() uses them to skip rows
+ * that didn't change and to notice rows that only moved up or down, which
+ * the terminal can scroll instead of having them repainted */
+
+/* clusters are hashed by what they are, not by where they are in
+ * 'clusters' */
+static uint64_t row_hash(const struct tb_cell *cells, int w, const struct cluster_pool *clusters)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	int x;
+	for (x = 0; x < w; ++x) {
+		uint64_t ch = is_cluster(cells[x].ch) ? cluster_hash(clusters, cells[x].ch) : cells[x].ch;
+		uint64_t v = ch ^ ((uint64_t)cells[x].fg << 32 | (uint64_t)cells[x].bg << 48);
+		h = (h ^ v) * 0x100000001b3ull;
+		/* the multiplication only carries upwards, fold the top back */
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+/* rows [top, top + height) scrolled up by dy (down if negative) */
+struct row_shift {
+	int top;
+	int height;
+	int dy;
+	/* rows that differed and match once shifted */
+	int gain;
+};
+
+/* scratch space for detect_row_shift(), sized for 'cap' rows */
+struct row_shift_scratch {
+	int cap;
+	int *votes;
+	/* open addressing from front hashes to rows, -1 empty, -2 not unique */
+	uint64_t *keys;
+	int *rows;
+};
+
+static void row_shift_scratch_reserve(struct row_shift_scratch *s, int h)
+{
+	if (h <= s->cap)
+		return;
+	int tsize = 1;
+	while (tsize < 2 * h)
+		tsize <<= 1;
+	free(s->votes);
+	free(s->keys);
+	free(s->rows);
+	s->cap = tsize / 2;
+	s->votes = static_cast<int*>(calloc(2 * s->cap + 1, sizeof(int)));
+	s->keys = static_cast<uint64_t*>(malloc(sizeof(uint64_t) * tsize));
+	s->rows = static_cast<int*>(malloc(sizeof(int) * tsize));
+}
+
+static void row_shift_scratch_free(struct row_shift_scratch *s)
+{
+	free(s->votes);
+	free(s->keys);
+	free(s->rows);
+	memset(s, 0, sizeof(*s));
+}
+
+/* find the vertical shift of a block of contiguous rows that turns the most
+ * rows of 'front' into the ones of 'back', in O(h). returns false if there's
+ * no such block */
+static bool detect_row_shift(const uint64_t *front, const uint64_t *back, int h,
+			     struct row_shift_scratch *s, struct row_shift *out)
+{
+	int y;
+	row_shift_scratch_reserve(s, h);
+	const int tsize = 2 * s->cap;
+	const int mask = tsize - 1;
+	for (y = 0; y < tsize; ++y)
+		s->rows[y] = -1;
+
+	/* rows appearing more than once (blank ones mostly) can't tell where
+	 * they came from */
+	for (y = 0; y < h; ++y) {
+		int slot = (int)(front[y] & mask);
+		while (s->rows[slot] != -1 && s->keys[slot] != front[y])
+			slot = (slot + 1) & mask;
+		if (s->rows[slot] == -1) {
+			s->keys[slot] = front[y];
+			s->rows[slot] = y;
+		} else {
+			s->rows[slot] = -2;
+		}
+	}
+
+	/* every changed row votes for the distance it moved */
+	int best = 0, best_votes = 0;
+	for (y = 0; y < h; ++y) {
+		if (back[y] == front[y])
+			continue;
+		int slot = (int)(back[y] & mask);
+		while (s->rows[slot] != -1 && s->keys[slot] != back[y])
+			slot = (slot + 1) & mask;
+		if (s->rows[slot] < 0)
+			continue;
+		int dy = s->rows[slot] - y;
+		int v = ++s->votes[dy + s->cap];
+		if (v > best_votes) {
+			best_votes = v;
+			best = dy;
+		}
+	}
+	for (y = -h; y <= h; ++y)
+		s->votes[y + s->cap] = 0;
+	if (best_votes == 0)
+		return false;
+
+	/* the contiguous run of rows matching with that shift that fixes the
+	 * most changed rows */
+	int dy = best;
+	int lo = (dy > 0) ? 0 : -dy;
+	int hi = (dy > 0) ? h - dy : h;
+	int run_start = -1, run_gain = 0;
+	int best_start = 0, best_end = 0, best_gain = 0;
+	for (y = lo; y <= hi; ++y) {
+		bool match = y < hi && back[y] == front[y + dy];
+		if (match) {
+			if (run_start < 0) {
+				run_start = y;
+				run_gain = 0;
+			}
+			if (back[y] != front[y])
+				run_gain++;
+		} else if (run_start >= 0) {
+			if (run_gain > best_gain) {
+				best_gain = run_gain;
+				best_start = run_start;
+				best_end = y;
+			}
+			run_start = -1;
+		}
+	}
+	if (best_gain == 0)
+		return false;
+
+	/* the block comes from [start + dy, end + dy) in front */
+	out->dy = dy;
+	out->top = (dy > 0) ? best_start : best_start + dy;
+	out->height = best_end - best_start + ((dy > 0) ? dy : -dy);
+	out->gain = best_gain;
+	return true;
+}
@@ -0,0 +1,537 @@
+/* viewers attached to a context over a unix socket, see tb_listen(). every
+ * present sends them the cells that changed, as spans found by the same diff
+ * that paints the terminal, and they send their input back as tb_events. a
+ * viewer that just attached, or fell too far behind, gets the whole screen
+ * (a keyframe) instead. the styles of the cells (style.inl) are sent before
+ * the first frame using them, and the grapheme clusters (cluster.inl) of a
+ * frame right before it. both ends are on the same host, everything is sent
+ * in its native byte order */
+
+/* a viewer with more than this waiting to be written only gets a keyframe
+ * once it catches up */
+#define SESSION_MAX_PENDING (1024 * 1024)
+/* viewers only send events, a message of another kind longer than this is
+ * taken for garbage and its viewer dropped */
+#define SESSION_MAX_VIEWER_MSG 256
+/* the size a viewer says its terminal has is cut down to this, it ends up
+ * in the 16 bit fields of the frames and in buffers of w * h cells */
+#define SESSION_MAX_VIEWER_SIZE 1024
+
+enum {
+	SESSION_MSG_FRAME = 1,
+	SESSION_MSG_SCROLL = 2,
+	SESSION_MSG_EVENT = 3,
+	/* recordings only, see recorder.inl */
+	SESSION_MSG_TIME = 4,
+	SESSION_MSG_STYLES = 5,
+	SESSION_MSG_CLUSTERS = 6,
+};
+
+struct session_msg {
+	uint32_t type;
+	uint32_t len; /* of what follows */
+};
+
+struct session_frame {
+	uint32_t spans;
+	uint16_t width;
+	uint16_t height;
+	int16_t cursor_x;
+	int16_t cursor_y;
+	uint8_t keyframe;
+	uint8_t outputmode;
+	/* the spans are made of runs, recordings only */
+	uint8_t rle;
+	uint8_t pad;
+};
+
+/* followed by n cells, or in rle frames by 'runs' session_runs adding up
+ * to n cells (n cells still if 'runs' is 0) */
+struct session_span {
+	uint16_t x;
+	uint16_t y;
+	uint16_t n;
+	uint16_t runs;
+};
+
+struct session_run {
+	uint32_t count;
+	struct tb_cell cell;
+};
+
+/* a CLUSTERS message is a cluster pool, the clusters in the cells of the
+ * frame after it are in there */
+
+/* a STYLES message is the id of the first style followed by styles, in
+ * order */
+struct session_style {
+	uint32_t fg;
+	uint32_t bg;
+	uint16_t attrs;
+	uint16_t pad;
+};
+
+/* rows [top, top + height) scrolled up by dy (down if negative) */
+struct session_scroll {
+	int16_t top;
+	int16_t height;
+	int16_t dy;
+	int16_t pad;
+};
+
+struct session_client {
+	int fd;
+	bool needs_keyframe;
+	/* the styles it knows, the first ones made */
+	int styles_sent;
+	/* byte queues: what's not written yet and what's not parsed yet */
+	struct inputbuffer out;
+	struct inputbuffer in;
+};
+
+struct session {
+	/* -1 when it's only there for a recording */
+	int listen_fd;
+	char *path;
+	struct session_client *clients;
+	int clients_len;
+	int clients_cap;
+	/* messages for the viewers in sync, sent at the end of the frame */
+	struct bytebuffer pending;
+	/* spans of the frame being presented, the last one still growing */
+	struct bytebuffer spans;
+	uint32_t span_count;
+	int span_offset;
+	int span_x, span_y, span_n;
+	/* the clusters in those spans */
+	struct cluster_pool clusters;
+};
+
+static void session_queue(struct session_client *c, const char *data, int len)
+{
+	memcpy(inputbuffer_reserve_tail(&c->out, len), data, len);
+	inputbuffer_commit(&c->out, len);
+}
+
+static void session_queue_msg(struct bytebuffer *b, uint32_t type, const void *data, int len)
+{
+	struct session_msg msg = {type, (uint32_t)len};
+	bytebuffer_append(b, (const char*)&msg, sizeof(msg));
+	bytebuffer_append(b, (const char*)data, len);
+}
+
+/* returns false once the viewer is gone, which must not raise SIGPIPE */
+static bool session_write(struct session_client *c)
+{
+	while (inputbuffer_len(&c->out) > 0) {
+		ssize_t r = send(c->fd, inputbuffer_data(&c->out), inputbuffer_len(&c->out), MSG_NOSIGNAL);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		inputbuffer_consume(&c->out, r);
+	}
+	return true;
+}
+
+static void session_drop(struct session *s, int i)
+{
+	struct session_client *c = &s->clients[i];
+	close(c->fd);
+	inputbuffer_free(&c->out);
+	inputbuffer_free(&c->in);
+	s->clients[i] = s->clients[--s->clients_len];
+}
+
+static struct session *session_new(void)
+{
+	struct session *s = static_cast<struct session*>(calloc(1, sizeof(struct session)));
+	s->listen_fd = -1;
+	bytebuffer_init(&s->pending, 4096);
+	bytebuffer_init(&s->spans, 32 * 1024);
+	return s;
+}
+
+/* returns 0 or an errno */
+static int session_listen(struct session *s, const char *path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return errno;
+	/* a socket left behind by a process that's gone is taken over, one
+	 * that's still served is not */
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+		close(fd);
+		return EADDRINUSE;
+	}
+	unlink(path);
+	/* viewers get the screen and type into the app, only the owner may
+	 * connect. nobody can before listen() */
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || chmod(path, S_IRUSR | S_IWUSR) < 0 ||
+	    listen(fd, 8) < 0) {
+		int err = errno;
+		close(fd);
+		return err;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	s->listen_fd = fd;
+	s->path = strdup(path);
+	return 0;
+}
+
+static void session_close(struct session *s)
+{
+	while (s->clients_len > 0)
+		session_drop(s, s->clients_len - 1);
+	if (s->listen_fd >= 0) {
+		close(s->listen_fd);
+		unlink(s->path);
+	}
+	free(s->path);
+	free(s->clients);
+	bytebuffer_free(&s->pending);
+	bytebuffer_free(&s->spans);
+	cluster_pool_free(&s->clusters);
+	free(s);
+}
+
+static void session_accept(struct session *s)
+{
+	int fd;
+	while ((fd = accept(s->listen_fd, 0, 0)) >= 0) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		if (s->clients_len == s->clients_cap) {
+			s->clients_cap = s->clients_cap ? s->clients_cap * 2 : 4;
+			s->clients = static_cast<struct session_client*>(
+				realloc(s->clients, sizeof(struct session_client) * s->clients_cap));
+		}
+		struct session_client *c = &s->clients[s->clients_len++];
+		c->fd = fd;
+		/* sent with the next frame */
+		c->needs_keyframe = true;
+		c->styles_sent = 0;
+		inputbuffer_init(&c->out, 4096);
+		inputbuffer_init(&c->in, 256);
+	}
+}
+
+static void session_close_span(struct session *s)
+{
+	if (s->span_n == 0)
+		return;
+	struct session_span span = {(uint16_t)s->span_x, (uint16_t)s->span_y, (uint16_t)s->span_n, 0};
+	memcpy(s->spans.buf + s->span_offset, &span, sizeof(span));
+	s->span_count++;
+	s->span_n = 0;
+}
+
+/* appends 'n' cells, with their clusters moved from 'from' to 'to' */
+static void session_append_cells(struct bytebuffer *b, const struct tb_cell *cells, int n,
+				 const struct cluster_pool *from, struct cluster_pool *to)
+{
+	int i;
+	int offset = b->len;
+	bytebuffer_append(b, (const char*)cells, sizeof(struct tb_cell) * n);
+	for (i = 0; i < n; ++i) {
+		if (!is_cluster(cells[i].ch))
+			continue;
+		uint32_t ch = cluster_copy(to, from, cells[i].ch);
+		memcpy(b->buf + offset + sizeof(struct tb_cell) * i, &ch, sizeof(ch));
+	}
+}
+
+static void session_queue_clusters(struct bytebuffer *b, const struct cluster_pool *clusters)
+{
+	if (clusters->bytes.len > 0)
+		session_queue_msg(b, SESSION_MSG_CLUSTERS, clusters->bytes.buf, clusters->bytes.len);
+}
+
+/* cells [x, x + n) of row y changed, they're the ones in the back buffer
+ * whose clusters are in 'clusters' */
+static void session_add_cells(struct session *s, int x, int y, const struct tb_cell *cells, int n,
+			      const struct cluster_pool *clusters)
+{
+	if (s->span_n == 0 || s->span_y != y || s->span_x + s->span_n != x) {
+		session_close_span(s);
+		s->span_offset = s->spans.len;
+		struct session_span blank = {0, 0, 0, 0};
+		bytebuffer_append(&s->spans, (const char*)&blank, sizeof(blank));
+		s->span_x = x;
+		s->span_y = y;
+	}
+	session_append_cells(&s->spans, cells, n, clusters, &s->clusters);
+	s->span_n += n;
+}
+
+static void session_add_scroll(struct session *s, int top, int height, int dy)
+{
+	struct session_scroll scroll = {(int16_t)top, (int16_t)height, (int16_t)dy, 0};
+	session_queue_msg(&s->pending, SESSION_MSG_SCROLL, &scroll, sizeof(scroll));
+}
+
+/* the messages showing 'screen' as a whole, built into 'b' the first time */
+static void session_keyframe(struct bytebuffer *b, const struct cellbuf *screen, const struct cluster_pool *clusters,
+			     int cursor_x, int cursor_y, int outputmode)
+{
+	int y;
+	if (b->len > 0)
+		return;
+	struct session_frame frame = {(uint32_t)screen->height, (uint16_t)screen->width, (uint16_t)screen->height,
+				      (int16_t)cursor_x, (int16_t)cursor_y, 1, (uint8_t)outputmode, 0, 0};
+	int row = sizeof(struct session_span) + sizeof(struct tb_cell) * screen->width;
+	/* the clusters go first, the rows are only built to find them */
+	struct bytebuffer rows;
+	struct cluster_pool frame_clusters = {{0, 0, 0}, 0};
+	bytebuffer_init(&rows, row * screen->height);
+	for (y = 0; y < screen->height; ++y) {
+		struct session_span span = {0, (uint16_t)y, (uint16_t)screen->width, 0};
+		bytebuffer_append(&rows, (const char*)&span, sizeof(span));
+		session_append_cells(&rows, screen->row(y), screen->width, clusters, &frame_clusters);
+	}
+	session_queue_clusters(b, &frame_clusters);
+	struct session_msg msg = {SESSION_MSG_FRAME, (uint32_t)(sizeof(frame) + rows.len)};
+	bytebuffer_append(b, (const char*)&msg, sizeof(msg));
+	bytebuffer_append(b, (const char*)&frame, sizeof(frame));
+	bytebuffer_append(b, rows.buf, rows.len);
+	bytebuffer_free(&rows);
+	cluster_pool_free(&frame_clusters);
+}
+
+/* the message defining styles [first, last) */
+static void session_styles(struct bytebuffer *b, int first, int last)
+{
+	int id;
+	uint32_t first_id = first;
+	struct session_msg msg = {SESSION_MSG_STYLES,
+				  (uint32_t)(sizeof(first_id) + sizeof(struct session_style) * (last - first))};
+	bytebuffer_append(b, (const char*)&msg, sizeof(msg));
+	bytebuffer_append(b, (const char*)&first_id, sizeof(first_id));
+	for (id = first; id < last; ++id) {
+		const struct style *st = style_get(id);
+		struct session_style def = {st->fg, st->bg, st->attrs, 0};
+		bytebuffer_append(b, (const char*)&def, sizeof(def));
+	}
+}
+
+/* the styles made since the viewer was last sent some, 'styles' of them
+ * now. any frame queued after this can use them */
+static void session_queue_styles(struct session_client *c, int styles)
+{
+	if (c->styles_sent >= styles)
+		return;
+	struct bytebuffer b;
+	bytebuffer_init(&b, 1024);
+	session_styles(&b, c->styles_sent, styles);
+	session_queue(c, b.buf, b.len);
+	bytebuffer_free(&b);
+	c->styles_sent = styles;
+}
+
+/* adds the frame made of the spans gathered so far to the scrolls pending */
+static void session_seal_frame(struct session *s, const struct cellbuf *screen,
+			       int cursor_x, int cursor_y, int outputmode)
+{
+	session_close_span(s);
+	session_queue_clusters(&s->pending, &s->clusters);
+	struct session_frame frame = {s->span_count, (uint16_t)screen->width, (uint16_t)screen->height,
+				      (int16_t)cursor_x, (int16_t)cursor_y, 0, (uint8_t)outputmode, 0, 0};
+	struct session_msg msg = {SESSION_MSG_FRAME, (uint32_t)(sizeof(frame) + s->spans.len)};
+	bytebuffer_append(&s->pending, (const char*)&msg, sizeof(msg));
+	bytebuffer_append(&s->pending, (const char*)&frame, sizeof(frame));
+	bytebuffer_append(&s->pending, s->spans.buf, s->spans.len);
+}
+
+/* the sealed frame goes to the viewers in sync, the others get 'screen' as
+ * a whole */
+static void session_end_frame(struct session *s, const struct cellbuf *screen, const struct cluster_pool *clusters,
+			      int cursor_x, int cursor_y, int outputmode)
+{
+	int i, styles = style_published();
+	struct bytebuffer keyframe = {0, 0, 0};
+	for (i = 0; i < s->clients_len; ) {
+		struct session_client *c = &s->clients[i];
+		if (inputbuffer_len(&c->out) > SESSION_MAX_PENDING) {
+			/* it can't keep up, whatever it's missing is in the next
+			 * keyframe it gets */
+			c->needs_keyframe = true;
+		} else if (c->needs_keyframe) {
+			session_queue_styles(c, styles);
+			session_keyframe(&keyframe, screen, clusters, cursor_x, cursor_y, outputmode);
+			session_queue(c, keyframe.buf, keyframe.len);
+			c->needs_keyframe = false;
+		} else {
+			session_queue_styles(c, styles);
+			session_queue(c, s->pending.buf, s->pending.len);
+		}
+		if (!session_write(c)) {
+			session_drop(s, i);
+			continue;
+		}
+		++i;
+	}
+	bytebuffer_free(&keyframe);
+	bytebuffer_clear(&s->pending);
+	bytebuffer_clear(&s->spans);
+	cluster_pool_clear(&s->clusters);
+	s->span_count = 0;
+}
+
+/* viewers waiting for a keyframe get 'screen' (the last one presented)
+ * without waiting for the next frame, an idle app may not present for a
+ * while. the ones still behind keep waiting */
+static void session_catch_up(struct session *s, const struct cellbuf *screen, const struct cluster_pool *clusters,
+			     int cursor_x, int cursor_y, int outputmode)
+{
+	int i, styles = style_published();
+	/* scrolled since the last frame, the screen is only whole again once
+	 * the next one is presented */
+	if (s->pending.len > 0)
+		return;
+	struct bytebuffer keyframe = {0, 0, 0};
+	for (i = 0; i < s->clients_len; ) {
+		struct session_client *c = &s->clients[i];
+		if (!c->needs_keyframe || inputbuffer_len(&c->out) > 0) {
+			++i;
+			continue;
+		}
+		session_queue_styles(c, styles);
+		session_keyframe(&keyframe, screen, clusters, cursor_x, cursor_y, outputmode);
+		session_queue(c, keyframe.buf, keyframe.len);
+		c->needs_keyframe = false;
+		if (!session_write(c)) {
+			session_drop(s, i);
+			continue;
+		}
+		++i;
+	}
+	bytebuffer_free(&keyframe);
+}
+
+/* the screen changed in a way the diffs can't tell (a new size, a frame
+ * taken back), everybody gets a keyframe next */
+static void session_resync(struct session *s)
+{
+	int i;
+	for (i = 0; i < s->clients_len; ++i)
+		s->clients[i].needs_keyframe = true;
+	bytebuffer_clear(&s->pending);
+}
+
+/* whether a viewer could have sent a message with this header */
+static bool session_viewer_msg_valid(const struct session_msg *msg)
+{
+	if (msg->type == SESSION_MSG_EVENT)
+		return msg->len == sizeof(struct tb_event);
+	return msg->len <= SESSION_MAX_VIEWER_MSG;
+}
+
+/* whether a viewer could have sent this event, a resize is clamped to a
+ * size frames can have */
+static bool session_viewer_event_valid(struct tb_event *event)
+{
+	switch (event->type) {
+	case TB_EVENT_RESIZE:
+		if (event->w > SESSION_MAX_VIEWER_SIZE)
+			event->w = SESSION_MAX_VIEWER_SIZE;
+		if (event->h > SESSION_MAX_VIEWER_SIZE)
+			event->h = SESSION_MAX_VIEWER_SIZE;
+		return true;
+	case TB_EVENT_KEY:
+	case TB_EVENT_MOUSE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* the next event a viewer sent, if any. drops the viewers that sent
+ * garbage */
+static bool session_extract_event(struct session *s, struct tb_event *event)
+{
+	int i;
+	for (i = 0; i < s->clients_len; ) {
+		struct session_client *c = &s->clients[i];
+		bool valid = true;
+		while (inputbuffer_len(&c->in) >= (int)sizeof(struct session_msg)) {
+			struct session_msg msg;
+			memcpy(&msg, inputbuffer_data(&c->in), sizeof(msg));
+			/* before waiting for the rest, a bogus length would have us
+			 * buffer without end */
+			valid = session_viewer_msg_valid(&msg);
+			if (!valid)
+				break;
+			if ((size_t)inputbuffer_len(&c->in) < sizeof(msg) + msg.len)
+				break;
+			const char *data = inputbuffer_data(&c->in) + sizeof(msg);
+			bool found = msg.type == SESSION_MSG_EVENT;
+			if (found) {
+				memcpy(event, data, sizeof(struct tb_event));
+				/* the event handlers are looked up by type */
+				valid = session_viewer_event_valid(event);
+				if (!valid)
+					break;
+			}
+			/* a viewer that resized cleared its screen */
+			if (found && event->type == TB_EVENT_RESIZE)
+				c->needs_keyframe = true;
+			inputbuffer_consume(&c->in, sizeof(msg) + msg.len);
+			if (found)
+				return true;
+		}
+		/* the last one takes its place */
+		if (!valid)
+			session_drop(s, i);
+		else
+			++i;
+	}
+	return false;
+}
+
+static int session_pollfds(struct session *s, struct pollfd *fds)
+{
+	int i;
+	fds[0].fd = s->listen_fd;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	for (i = 0; i < s->clients_len; ++i) {
+		fds[i + 1].fd = s->clients[i].fd;
+		fds[i + 1].events = POLLIN | (inputbuffer_len(&s->clients[i].out) > 0 ? POLLOUT : 0);
+		fds[i + 1].revents = 0;
+	}
+	return s->clients_len + 1;
+}
+
+/* reads and writes what poll() said it could, 'fds' as filled by
+ * session_pollfds() */
+static void session_handle_poll(struct session *s, const struct pollfd *fds, int nfds)
+{
+	int i;
+	/* backwards, dropping a client moves the last one in its place */
+	for (i = nfds - 1; i >= 1; --i) {
+		struct session_client *c = &s->clients[i - 1];
+		bool alive = true;
+		if (fds[i].revents & POLLOUT)
+			alive = session_write(c);
+		if (alive && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+			char *tail = inputbuffer_reserve_tail(&c->in, 4096);
+			ssize_t r = read(c->fd, tail, 4096);
+			if (r > 0)
+				inputbuffer_commit(&c->in, r);
+			else if (r == 0 || (errno != EAGAIN && errno != EINTR))
+				alive = false;
+		}
+		if (!alive)
+			session_drop(s, i - 1);
+	}
+	if (fds[0].revents & POLLIN)
+		session_accept(s);
+}
@@ -0,0 +1,176 @@
+/* styles made with tb_style(): 24-bit colors and attributes that don't fit
+ * in a cell. a styled cell's fg is TB_STYLE | the id of an entry here, so
+ * cells stay 8 bytes and are diffed as before. the table is shared by all
+ * the contexts and only ever grows, an entry never changes once published:
+ * the SGR sequence of every output mode is made when the style is */
+
+#define STYLE_MAX 0x7FFF
+#define STYLE_PAGE 256
+#define STYLE_SGR_MAX 64
+/* the output modes, TB_OUTPUT_CURRENT aside */
+#define STYLE_MODES TB_OUTPUT_TRUECOLOR
+
+struct style {
+	uint32_t fg;
+	uint32_t bg;
+	uint16_t attrs;
+	uint8_t sgr_len[STYLE_MODES];
+	char sgr[STYLE_MODES][STYLE_SGR_MAX];
+};
+
+/* in pages that never move, so that reading a published entry takes no
+ * lock */
+static struct style *style_pages[(STYLE_MAX + STYLE_PAGE) / STYLE_PAGE];
+static int style_count;
+static pthread_mutex_t style_lock = PTHREAD_MUTEX_INITIALIZER;
+/* open addressing, ids + 1 (0 is a free slot) */
+#define STYLE_HASH_SIZE 65536
+static uint16_t *style_hash;
+
+/* the levels of the 6x6x6 cube of 256 color terminals and the nearest one
+ * of each channel value, then the nearest of the 24 grays */
+static const uint8_t cube_levels[6] = {0, 95, 135, 175, 215, 255};
+static uint8_t cube_index[256];
+static uint8_t gray_index[256];
+static pthread_once_t style_luts_once = PTHREAD_ONCE_INIT;
+
+static void style_init_luts(void)
+{
+	int v, i;
+	for (v = 0; v < 256; ++v) {
+		int best = 0;
+		for (i = 1; i < 6; ++i) {
+			if (abs(v - cube_levels[i]) < abs(v - cube_levels[best]))
+				best = i;
+		}
+		cube_index[v] = best;
+		int gray = (v - 8 + 5) / 10;
+		gray_index[v] = gray < 0 ? 0 : gray > 23 ? 23 : gray;
+	}
+}
+
+static int rgb_distance(int r1, int g1, int b1, int r2, int g2, int b2)
+{
+	return (r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) + (b1 - b2) * (b1 - b2);
+}
+
+static int rgb_to_216(uint32_t rgb)
+{
+	return 16 + 36 * cube_index[(rgb >> 16) & 0xFF] + 6 * cube_index[(rgb >> 8) & 0xFF] + cube_index[rgb & 0xFF];
+}
+
+static int rgb_to_gray(uint32_t rgb)
+{
+	int r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+	return 232 + gray_index[(r * 299 + g * 587 + b * 114) / 1000];
+}
+
+/* the nearest of the cube and the grays */
+static int rgb_to_256(uint32_t rgb)
+{
+	int r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+	int cube = rgb_to_216(rgb);
+	int cr = cube_levels[cube_index[r]], cg = cube_levels[cube_index[g]], cb = cube_levels[cube_index[b]];
+	int gray = rgb_to_gray(rgb);
+	int level = 8 + 10 * (gray - 232);
+	if (rgb_distance(r, g, b, level, level, level) < rgb_distance(r, g, b, cr, cg, cb))
+		return gray;
+	return cube;
+}
+
+/* one of the 8 colors, as an offset from 30 or 40 */
+static int rgb_to_8(uint32_t rgb)
+{
+	return (((rgb >> 16) & 0xFF) > 127) | ((((rgb >> 8) & 0xFF) > 127) << 1) | (((rgb & 0xFF) > 127) << 2);
+}
+
+static int style_sgr_color(char *out, uint32_t rgb, int base, int mode)
+{
+	if (rgb == TB_RGB_DEFAULT)
+		return 0;
+	switch (mode) {
+	case TB_OUTPUT_TRUECOLOR:
+		return sprintf(out, ";%d8;2;%u;%u;%u", base, (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+	case TB_OUTPUT_256:
+		return sprintf(out, ";%d8;5;%d", base, rgb_to_256(rgb));
+	case TB_OUTPUT_216:
+		return sprintf(out, ";%d8;5;%d", base, rgb_to_216(rgb));
+	case TB_OUTPUT_GRAYSCALE:
+		return sprintf(out, ";%d8;5;%d", base, rgb_to_gray(rgb));
+	case TB_OUTPUT_NORMAL:
+	default:
+		return sprintf(out, ";%d%d", base, rgb_to_8(rgb));
+	}
+}
+
+/* resets everything else, like send_attr() does */
+static int style_sgr(char *out, uint32_t fg, uint32_t bg, uint16_t attrs, int mode)
+{
+	int len = sprintf(out, "\033[0");
+	if (attrs & TB_BOLD)
+		len += sprintf(out + len, ";1");
+	if (attrs & TB_ITALIC)
+		len += sprintf(out + len, ";3");
+	if (attrs & TB_UNDERLINE)
+		len += sprintf(out + len, ";4");
+	if (attrs & TB_REVERSE)
+		len += sprintf(out + len, ";7");
+	if (attrs & TB_STRIKE)
+		len += sprintf(out + len, ";9");
+	len += style_sgr_color(out + len, fg, 3, mode);
+	len += style_sgr_color(out + len, bg, 4, mode);
+	out[len++] = 'm';
+	return len;
+}
+
+static uint32_t style_key_hash(uint32_t fg, uint32_t bg, uint16_t attrs)
+{
+	uint64_t h = ((uint64_t)fg * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)bg * 0xC2B2AE3D27D4EB4Full) ^ attrs;
+	return (uint32_t)(h ^ (h >> 29)) & (STYLE_HASH_SIZE - 1);
+}
+
+static const struct style *style_get(int id)
+{
+	return &style_pages[id / STYLE_PAGE][id % STYLE_PAGE];
+}
+
+/* the number of styles published so far */
+static int style_published(void)
+{
+	return __atomic_load_n(&style_count, __ATOMIC_ACQUIRE);
+}
+
+/* the id of the style, made if it's new. -1 once the table is full */
+static int style_intern(uint32_t fg, uint32_t bg, uint16_t attrs)
+{
+	int id = -1, mode;
+	pthread_once(&style_luts_once, style_init_luts);
+	pthread_mutex_lock(&style_lock);
+	if (!style_hash)
+		style_hash = static_cast<uint16_t*>(calloc(STYLE_HASH_SIZE, sizeof(uint16_t)));
+	uint32_t slot = style_key_hash(fg, bg, attrs);
+	while (style_hash[slot]) {
+		const struct style *s = style_get(style_hash[slot] - 1);
+		if (s->fg == fg && s->bg == bg && s->attrs == attrs) {
+			id = style_hash[slot] - 1;
+			break;
+		}
+		slot = (slot + 1) & (STYLE_HASH_SIZE - 1);
+	}
+	if (id < 0 && style_count < STYLE_MAX) {
+		id = style_count;
+		if (!style_pages[id / STYLE_PAGE])
+			style_pages[id / STYLE_PAGE] = static_cast<struct style*>(
+				calloc(STYLE_PAGE, sizeof(struct style)));
+		struct style *s = &style_pages[id / STYLE_PAGE][id % STYLE_PAGE];
+		s->fg = fg;
+		s->bg = bg;
+		s->attrs = attrs;
+		for (mode = 1; mode <= STYLE_MODES; ++mode)
+			s->sgr_len[mode - 1] = style_sgr(s->sgr[mode - 1], fg, bg, attrs, mode);
+		style_hash[slot] = id + 1;
+		__atomic_store_n(&style_count, id + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&style_lock);
+	return id;
+}
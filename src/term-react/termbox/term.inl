@@ -18,6 +18,9 @@ enum {
 
 #define ENTER_MOUSE_SEQ "\x1b[?1000h\x1b[?1002h\x1b[?1015h\x1b[?1006h"
 #define EXIT_MOUSE_SEQ "\x1b[?1006l\x1b[?1015l\x1b[?1002l\x1b[?1000l"
+// any-event tracking, sent after/before the sequences above when TB_INPUT_MOTION is requested
+#define ENTER_MOUSE_MOTION_SEQ "\x1b[?1003h"
+#define EXIT_MOUSE_MOTION_SEQ "\x1b[?1003l"
 
 #define EUNSUPPORTED_TERM -1
 
@@ -3,103 +3,198 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <termios.h>
 #include <unistd.h>
 #include <wchar.h>
 
 #include "termbox.h"
 #include "bytebuffer.inl"
+#include "inputbuffer.inl"
+#include "cellbuf.inl"
+#include "cluster.inl"
+#include "writer.inl"
+#include "rowhash.inl"
+#include "style.inl"
+#include "session.inl"
+#include "recorder.inl"
+#include "inputlog.inl"
 #include "term.inl"
 #include "input.inl"
 
-struct cellbuf {
-	int width;
-	int height;
-	struct tb_cell *cells;
-};
-
-#define CELL(buf, x, y) (buf)->cells[(y) * (buf)->width + (x)]
+#define CELL(buf, x, y) (buf)->at(x, y)
 #define IS_CURSOR_HIDDEN(cx, cy) (cx == -1 || cy == -1)
 #define LAST_COORD_INIT -1
 
-static struct termios orig_tios;
-
-static struct cellbuf back_buffer;
-static struct cellbuf front_buffer;
-static struct bytebuffer output_buffer;
-static struct bytebuffer input_buffer;
-
-static int termw = -1;
-static int termh = -1;
+#define LAST_ATTR_INIT 0xFFFF
 
-static int inputmode = TB_INPUT_ESC;
-static int outputmode = TB_OUTPUT_NORMAL;
+/* how long an incomplete escape sequence waits for the rest of its bytes
+ * before it's taken as a plain ESC (or ALT) */
+#define ESC_SEQ_TIMEOUT_MS 50
+
+/* everything about one terminal. each thread works with its current context,
+ * the default one unless tb_select_context() says otherwise */
+struct tb_context {
+	struct termios orig_tios;
+
+	struct cellbuf back_buffer;
+	struct cellbuf front_buffer;
+	/* the back buffer's rows are padded, tb_cell_buffer() lends a copy of
+	 * them laid out one after the other. it's copied back before anything
+	 * else reads the back buffer */
+	struct tb_cell *lent_cells;
+	size_t lent_cap;
+	bool lent;
+	/* the clusters of their cells, and what a pool is compacted into */
+	struct cluster_pool back_clusters;
+	struct cluster_pool front_clusters;
+	struct bytebuffer cluster_spare;
+	struct bytebuffer output_buffer;
+	struct inputbuffer input_buffer;
+
+	int termw = -1;
+	int termh = -1;
+
+	int inputmode = TB_INPUT_ESC;
+	int outputmode = TB_OUTPUT_NORMAL;
+
+	/* -1 for a headless context, the size is then up to its viewers */
+	int inout = -1;
+	int headless_w;
+	int headless_h;
+	int winch_fds[2] = {-1, -1};
+	/* written to by tb_interrupt(), possibly from other threads */
+	int wakeup_fds[2] = {-1, -1};
+
+	/* the screen as the frame being encoded is diffed against, kept while
+	 * the writer thread is running so that a superseded frame can be undone */
+	struct cellbuf frame_base;
+	struct writer output_writer;
+
+	/* row hashes of the back buffer as of the last present and of the front
+	 * buffer, the latter only valid while front_hashes_valid */
+	uint64_t *back_hashes;
+	uint64_t *front_hashes;
+	int hashes_cap;
+	bool front_hashes_valid;
+	struct row_shift_scratch shift_scratch;
+
+	int lastx = LAST_COORD_INIT;
+	int lasty = LAST_COORD_INIT;
+	int cursor_x = -1;
+	int cursor_y = -1;
+
+	uint16_t lastfg = LAST_ATTR_INIT;
+	uint16_t lastbg = LAST_ATTR_INIT;
+
+	uint16_t background = TB_DEFAULT;
+	uint16_t foreground = TB_DEFAULT;
+
+	long partial_since = -1;
+
+	/* viewers attached with tb_listen() and the frames for the recorder,
+	 * or NULL */
+	struct session *session;
+	struct recorder *recorder;
+	/* where a headless context's output goes instead of nowhere */
+	struct bytebuffer *capture;
+	/* the input being logged, and the log played back instead of it */
+	struct inputlog *input_log;
+	struct replay *replay;
+	/* what wait_fill_event() polls, grown with the viewers */
+	struct pollfd *pollfds;
+	int pollfds_cap;
+
+	/* may happen in a different thread */
+	volatile int buffer_size_change_request;
+};
 
-static int inout;
-static int winch_fds[2];
+static struct tb_context default_context;
+static thread_local struct tb_context *ctx = &default_context;
 
-static int lastx = LAST_COORD_INIT;
-static int lasty = LAST_COORD_INIT;
-static int cursor_x = -1;
-static int cursor_y = -1;
+/* terminfo and the key trie are shared by all contexts, they all speak the
+ * TERM of the process */
+static pthread_mutex_t term_lock = PTHREAD_MUTEX_INITIALIZER;
+static int term_users;
 
-static uint16_t background = TB_DEFAULT;
-static uint16_t foreground = TB_DEFAULT;
+/* SIGWINCH only comes for the controlling terminal, the contexts drawing to
+ * it are told through their winch pipe. the others have to be told with
+ * tb_notify_resize() */
+#define MAX_SIGWINCH_FDS 8
+static pthread_mutex_t sigwinch_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int sigwinch_fds[MAX_SIGWINCH_FDS] = {-1, -1, -1, -1, -1, -1, -1, -1};
+static bool sigwinch_installed;
 
 static void write_cursor(int x, int y);
 static void write_sgr(uint16_t fg, uint16_t bg);
 
-static void cellbuf_init(struct cellbuf *buf, int width, int height);
-static void cellbuf_resize(struct cellbuf *buf, int width, int height);
 static void cellbuf_clear(struct cellbuf *buf);
-static void cellbuf_free(struct cellbuf *buf);
+static void lend_cells(void);
+static void return_cells(bool keep);
 
 static void update_size(void);
 static void update_term_size(void);
 static void send_attr(uint16_t fg, uint16_t bg);
 static void send_char(int x, int y, uint32_t c);
+static void send_cluster(int x, int y, uint32_t ch);
 static void send_clear(void);
-static void sigwinch_handler(int xxx);
+static void flush_output(bool frame);
+static long now_ms(void);
+static void take_back_frame(void);
+static void scroll_front(int y, int h, int dy);
+static void sigwinch_subscribe(int fd);
+static void sigwinch_unsubscribe(int fd);
+static int acquire_term(bool fallback);
+static void release_term(void);
+static int open_pipes(void);
+static int init_buffers(void);
 static int wait_fill_event(struct tb_event *event, struct timeval *timeout);
-
-/* may happen in a different thread */
-static volatile int buffer_size_change_request;
+static void resync_session(void);
 
 /* -------------------------------------------------------- */
 
 int tb_init_fd(int inout_)
 {
-	inout = inout_;
-	if (inout == -1) {
+	ctx->inout = inout_;
+	if (ctx->inout == -1) {
 		return TB_EFAILED_TO_OPEN_TTY;
 	}
 
-	if (init_term() < 0) {
-		close(inout);
+	/* servers tend to hand over non-blocking fds, the output is written
+	 * whole and reads don't block anyway with VMIN and VTIME at 0 */
+	int flags = fcntl(ctx->inout, F_GETFL);
+	if (flags >= 0 && (flags & O_NONBLOCK))
+		fcntl(ctx->inout, F_SETFL, flags & ~O_NONBLOCK);
+
+	if (acquire_term(false) < 0) {
+		close(ctx->inout);
 		return TB_EUNSUPPORTED_TERMINAL;
 	}
 
-	if (pipe(winch_fds) < 0) {
-		close(inout);
+	if (open_pipes() < 0) {
+		release_term();
+		close(ctx->inout);
 		return TB_EPIPE_TRAP_ERROR;
 	}
 
-	struct sigaction sa;
-	memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = sigwinch_handler;
-	sa.sa_flags = 0;
-	sigaction(SIGWINCH, &sa, 0);
+	/* the session of a tty is only ours if it's our controlling terminal */
+	if (tcgetsid(ctx->inout) == getsid(0))
+		sigwinch_subscribe(ctx->winch_fds[1]);
 
-	tcgetattr(inout, &orig_tios);
+	tcgetattr(ctx->inout, &ctx->orig_tios);
 
 	struct termios tios;
-	memcpy(&tios, &orig_tios, sizeof(tios));
+	memcpy(&tios, &ctx->orig_tios, sizeof(tios));
 
 	tios.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
                            | INLCR | IGNCR | ICRNL | IXON);
@@ -109,23 +204,23 @@ int tb_init_fd(int inout_)
 	tios.c_cflag |= CS8;
 	tios.c_cc[VMIN] = 0;
 	tios.c_cc[VTIME] = 0;
-	tcsetattr(inout, TCSAFLUSH, &tios);
-
-	bytebuffer_init(&input_buffer, 128);
-	bytebuffer_init(&output_buffer, 32 * 1024);
-
-	bytebuffer_puts(&output_buffer, funcs[T_ENTER_CA]);
-	bytebuffer_puts(&output_buffer, funcs[T_ENTER_KEYPAD]);
-	bytebuffer_puts(&output_buffer, funcs[T_HIDE_CURSOR]);
-	send_clear();
+	tcsetattr(ctx->inout, TCSAFLUSH, &tios);
 
-	update_term_size();
-	cellbuf_init(&back_buffer, termw, termh);
-	cellbuf_init(&front_buffer, termw, termh);
-	cellbuf_clear(&back_buffer);
-	cellbuf_clear(&front_buffer);
+	return init_buffers();
+}
 
-	return 0;
+int tb_init_headless(int w, int h)
+{
+	ctx->inout = -1;
+	ctx->headless_w = w;
+	ctx->headless_h = h;
+	/* nothing is written anywhere, any terminal will do */
+	acquire_term(true);
+	if (open_pipes() < 0) {
+		release_term();
+		return TB_EPIPE_TRAP_ERROR;
+	}
+	return init_buffers();
 }
 
 int tb_init_file(const char* name){
@@ -139,30 +234,75 @@ int tb_init(void)
 
 void tb_shutdown(void)
 {
-	if (termw == -1) {
+	if (ctx->termw == -1) {
 		fputs("tb_shutdown() should not be called twice.", stderr);
 		abort();
 	}
 
-	bytebuffer_puts(&output_buffer, funcs[T_SHOW_CURSOR]);
-	bytebuffer_puts(&output_buffer, funcs[T_SGR0]);
-	bytebuffer_puts(&output_buffer, funcs[T_CLEAR_SCREEN]);
-	bytebuffer_puts(&output_buffer, funcs[T_EXIT_CA]);
-	bytebuffer_puts(&output_buffer, funcs[T_EXIT_KEYPAD]);
-	bytebuffer_puts(&output_buffer, funcs[T_EXIT_MOUSE]);
-	bytebuffer_flush(&output_buffer, inout);
-	tcsetattr(inout, TCSAFLUSH, &orig_tios);
-
-	shutdown_term();
-	close(inout);
-	close(winch_fds[0]);
-	close(winch_fds[1]);
-
-	cellbuf_free(&back_buffer);
-	cellbuf_free(&front_buffer);
-	bytebuffer_free(&output_buffer);
-	bytebuffer_free(&input_buffer);
-	termw = termh = -1;
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_SHOW_CURSOR]);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_SGR0]);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_CLEAR_SCREEN]);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_EXIT_CA]);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_EXIT_KEYPAD]);
+	if (ctx->inputmode & TB_INPUT_MOTION)
+		bytebuffer_puts(&ctx->output_buffer, EXIT_MOUSE_MOTION_SEQ);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_EXIT_MOUSE]);
+	flush_output(false);
+	writer_stop(&ctx->output_writer);
+	if (ctx->recorder) {
+		recorder_close(ctx->recorder);
+		ctx->recorder = 0;
+	}
+	if (ctx->input_log) {
+		inputlog_close(ctx->input_log);
+		ctx->input_log = 0;
+	}
+	if (ctx->replay) {
+		replay_free(ctx->replay);
+		ctx->replay = 0;
+	}
+	if (ctx->session) {
+		session_close(ctx->session);
+		ctx->session = 0;
+	}
+	free(ctx->pollfds);
+	ctx->pollfds = 0;
+	ctx->pollfds_cap = 0;
+
+	release_term();
+	if (ctx->inout >= 0) {
+		tcsetattr(ctx->inout, TCSAFLUSH, &ctx->orig_tios);
+		sigwinch_unsubscribe(ctx->winch_fds[1]);
+		close(ctx->inout);
+	}
+	close(ctx->winch_fds[0]);
+	close(ctx->winch_fds[1]);
+	close(ctx->wakeup_fds[0]);
+	close(ctx->wakeup_fds[1]);
+	ctx->inout = -1;
+	ctx->winch_fds[0] = ctx->winch_fds[1] = -1;
+	ctx->wakeup_fds[0] = ctx->wakeup_fds[1] = -1;
+
+	ctx->back_buffer.free_cells();
+	ctx->front_buffer.free_cells();
+	free(ctx->lent_cells);
+	ctx->lent_cells = 0;
+	ctx->lent_cap = 0;
+	ctx->lent = false;
+	ctx->frame_base.free_cells();
+	cluster_pool_free(&ctx->back_clusters);
+	cluster_pool_free(&ctx->front_clusters);
+	bytebuffer_free(&ctx->cluster_spare);
+	bytebuffer_init(&ctx->cluster_spare, 0);
+	free(ctx->back_hashes);
+	free(ctx->front_hashes);
+	ctx->back_hashes = ctx->front_hashes = 0;
+	ctx->hashes_cap = 0;
+	ctx->front_hashes_valid = false;
+	row_shift_scratch_free(&ctx->shift_scratch);
+	bytebuffer_free(&ctx->output_buffer);
+	inputbuffer_free(&ctx->input_buffer);
+	ctx->termw = ctx->termh = -1;
 }
 
 void tb_present(void)
@@ -171,35 +311,109 @@ void tb_present(void)
 	struct tb_cell *back, *front;
 
 	/* invalidate cursor position */
-	lastx = LAST_COORD_INIT;
-	lasty = LAST_COORD_INIT;
+	ctx->lastx = LAST_COORD_INIT;
+	ctx->lasty = LAST_COORD_INIT;
+
+	if (ctx->output_writer.running) {
+		/* replace the previous frame if the writer hasn't got to it yet,
+		 * this one is then diffed against the screen before it */
+		take_back_frame();
+		/* output queued since then (cursor changes) is never dropped */
+		if (ctx->output_buffer.len > 0)
+			flush_output(false);
+	}
 
-	if (buffer_size_change_request) {
+	return_cells(false);
+	if (ctx->buffer_size_change_request) {
 		update_size();
-		buffer_size_change_request = 0;
+		ctx->buffer_size_change_request = 0;
+	}
+
+	/* not while the frame base may be taken back, it shares the front pool */
+	cluster_pool_compact(&ctx->back_clusters, &ctx->cluster_spare, &ctx->back_buffer);
+	cluster_pool_compact(&ctx->front_clusters, &ctx->cluster_spare, &ctx->front_buffer);
+	if (ctx->output_writer.running)
+		ctx->frame_base.copy_from(ctx->front_buffer);
+
+	const int width = ctx->front_buffer.width;
+	const int height = ctx->front_buffer.height;
+	/* headless, the output only matters if it is captured */
+	const bool to_tty = ctx->inout >= 0 || ctx->capture;
+	/* the viewers and the recorder get the same diff */
+	struct session *session = (ctx->session && (ctx->session->clients_len > 0 || ctx->recorder)) ? ctx->session : 0;
+	if (height > ctx->hashes_cap) {
+		free(ctx->back_hashes);
+		free(ctx->front_hashes);
+		ctx->back_hashes = static_cast<uint64_t*>(malloc(sizeof(uint64_t) * height));
+		ctx->front_hashes = static_cast<uint64_t*>(malloc(sizeof(uint64_t) * height));
+		ctx->hashes_cap = height;
+		ctx->front_hashes_valid = false;
+	}
+	for (y = 0; y < height; ++y)
+		ctx->back_hashes[y] = row_hash(ctx->back_buffer.row(y), width, &ctx->back_clusters);
+	if (!ctx->front_hashes_valid) {
+		for (y = 0; y < height; ++y)
+			ctx->front_hashes[y] = row_hash(ctx->front_buffer.row(y), width, &ctx->front_clusters);
+		ctx->front_hashes_valid = true;
 	}
 
-	for (y = 0; y < front_buffer.height; ++y) {
-		for (x = 0; x < front_buffer.width; ) {
-			back = &CELL(&back_buffer, x, y);
-			front = &CELL(&front_buffer, x, y);
-			w = wcwidth(back->ch);
+	/* rows that only moved are scrolled by the terminal, as long as that's
+	 * cheaper than painting them: the rows it exposes are painted in full */
+	struct row_shift shift;
+	if (height > 1 && detect_row_shift(ctx->front_hashes, ctx->back_hashes, height, &ctx->shift_scratch, &shift)) {
+		int n = (shift.dy > 0) ? shift.dy : -shift.dy;
+		if ((long)shift.gain * width > (long)n * width + 32) {
+			scroll_front(shift.top, shift.height, shift.dy);
+			int top = shift.top, bottom = shift.top + shift.height;
+			if (shift.dy > 0)
+				memmove(ctx->front_hashes + top, ctx->front_hashes + top + n, sizeof(uint64_t) * (shift.height - n));
+			else
+				memmove(ctx->front_hashes + top + n, ctx->front_hashes + top, sizeof(uint64_t) * (shift.height - n));
+			int exposed = (shift.dy > 0) ? bottom - n : top;
+			for (y = exposed; y < exposed + n; ++y)
+				ctx->front_hashes[y] = row_hash(ctx->front_buffer.row(y), width, &ctx->front_clusters);
+		}
+	}
+
+	for (y = 0; y < height; ++y) {
+		if (ctx->back_hashes[y] == ctx->front_hashes[y])
+			continue;
+		struct tb_cell *back_row = ctx->back_buffer.row(y);
+		struct tb_cell *front_row = ctx->front_buffer.row(y);
+		for (x = 0; x < width; ) {
+			back = &back_row[x];
+			front = &front_row[x];
+			bool cluster = is_cluster(back->ch);
+			w = cluster ? cluster_get(&ctx->back_clusters, back->ch)->width : wcwidth(back->ch);
 			if (w < 1) w = 1;
-			if (memcmp(back, front, sizeof(struct tb_cell)) == 0) {
+			if (memcmp(back, front, sizeof(struct tb_cell)) == 0 && !cluster) {
+				x += w;
+				continue;
+			}
+			if (cluster && is_cluster(front->ch) && back->fg == front->fg && back->bg == front->bg &&
+			    cluster_equal(&ctx->back_clusters, back->ch, &ctx->front_clusters, front->ch)) {
 				x += w;
 				continue;
 			}
 			memcpy(front, back, sizeof(struct tb_cell));
-			send_attr(back->fg, back->bg);
-			if (w > 1 && x >= front_buffer.width - (w - 1)) {
+			if (cluster)
+				front->ch = cluster_copy(&ctx->front_clusters, &ctx->back_clusters, back->ch);
+			if (session)
+				session_add_cells(session, x, y, back, (x + w <= width) ? w : width - x, &ctx->back_clusters);
+			if (to_tty)
+				send_attr(back->fg, back->bg);
+			if (w > 1 && x >= width - (w - 1)) {
 				// Not enough room for wide ch, so send spaces
-				for (i = x; i < front_buffer.width; ++i) {
+				for (i = x; to_tty && i < width; ++i) {
 					send_char(i, y, ' ');
 				}
 			} else {
-				send_char(x, y, back->ch);
+				if (to_tty && cluster)
+					send_cluster(x, y, back->ch);
+				else if (to_tty)
+					send_char(x, y, back->ch);
 				for (i = 1; i < w; ++i) {
-					front = &CELL(&front_buffer, x + i, y);
+					front = &front_row[x + i];
 					front->ch = 0;
 					front->fg = back->fg;
 					front->bg = back->bg;
@@ -207,33 +421,106 @@ void tb_present(void)
 			}
 			x += w;
 		}
+		// wide chars may leave the front row different from the back one
+		ctx->front_hashes[y] = row_hash(front_row, width, &ctx->front_clusters);
 	}
-	if (!IS_CURSOR_HIDDEN(cursor_x, cursor_y))
-		write_cursor(cursor_x, cursor_y);
-	bytebuffer_flush(&output_buffer, inout);
+	if (!IS_CURSOR_HIDDEN(ctx->cursor_x, ctx->cursor_y))
+		write_cursor(ctx->cursor_x, ctx->cursor_y);
+	flush_output(true);
+	if (ctx->session) {
+		session_seal_frame(ctx->session, &ctx->front_buffer, ctx->cursor_x, ctx->cursor_y, ctx->outputmode);
+		if (ctx->recorder)
+			recorder_frame(ctx->recorder, &ctx->session->pending, &ctx->front_buffer, &ctx->front_clusters,
+				       ctx->cursor_x, ctx->cursor_y, ctx->outputmode);
+		session_end_frame(ctx->session, &ctx->front_buffer, &ctx->front_clusters,
+				  ctx->cursor_x, ctx->cursor_y, ctx->outputmode);
+	}
+	if (ctx->replay)
+		replay_presented(ctx->replay);
+}
+
+int tb_start_writer(void)
+{
+	if (ctx->output_writer.running)
+		return 0;
+	if (ctx->inout < 0)
+		return -1;
+	flush_output(false);
+	return writer_start(&ctx->output_writer, ctx->inout);
+}
+
+void tb_stop_writer(void)
+{
+	writer_stop(&ctx->output_writer);
+}
+
+int tb_output_pending(void)
+{
+	int queued = 0;
+	/* what the terminal hasn't read yet, if the tty can tell */
+	if (ioctl(ctx->inout, TIOCOUTQ, &queued) < 0)
+		queued = 0;
+	return writer_unwritten(&ctx->output_writer) + queued;
+}
+
+unsigned long tb_superseded_frames(void)
+{
+	return writer_superseded(&ctx->output_writer);
+}
+
+void tb_scroll(int x, int y, int w, int h, int dy)
+{
+	if (x < 0) { w += x; x = 0; }
+	if (y < 0) { h += y; y = 0; }
+	if (x + w > ctx->back_buffer.width) w = ctx->back_buffer.width - x;
+	if (y + h > ctx->back_buffer.height) h = ctx->back_buffer.height - y;
+	if (w <= 0 || h <= 0 || dy == 0)
+		return;
+
+	struct tb_cell blank = {' ', ctx->foreground, ctx->background};
+	return_cells(true);
+	ctx->back_buffer.scroll(x, y, w, h, dy, blank);
+	if (ctx->lent)
+		lend_cells();
+
+	/* the terminal can only scroll whole rows, and only if we know what's
+	 * on them. otherwise the next present repaints whatever changed */
+	int n = (dy > 0) ? dy : -dy;
+	if (x != 0 || w != ctx->front_buffer.width || y + h > ctx->front_buffer.height ||
+	    ctx->buffer_size_change_request || n >= h)
+		return;
+
+	/* the frame the scroll applies to must reach the terminal first */
+	if (ctx->output_writer.running)
+		take_back_frame();
+
+	scroll_front(y, h, dy);
+	ctx->front_hashes_valid = false;
 }
 
 void tb_set_cursor(int cx, int cy)
 {
-	if (IS_CURSOR_HIDDEN(cursor_x, cursor_y) && !IS_CURSOR_HIDDEN(cx, cy))
-		bytebuffer_puts(&output_buffer, funcs[T_SHOW_CURSOR]);
+	if (IS_CURSOR_HIDDEN(ctx->cursor_x, ctx->cursor_y) && !IS_CURSOR_HIDDEN(cx, cy))
+		bytebuffer_puts(&ctx->output_buffer, funcs[T_SHOW_CURSOR]);
 
-	if (!IS_CURSOR_HIDDEN(cursor_x, cursor_y) && IS_CURSOR_HIDDEN(cx, cy))
-		bytebuffer_puts(&output_buffer, funcs[T_HIDE_CURSOR]);
+	if (!IS_CURSOR_HIDDEN(ctx->cursor_x, ctx->cursor_y) && IS_CURSOR_HIDDEN(cx, cy))
+		bytebuffer_puts(&ctx->output_buffer, funcs[T_HIDE_CURSOR]);
 
-	cursor_x = cx;
-	cursor_y = cy;
-	if (!IS_CURSOR_HIDDEN(cursor_x, cursor_y))
-		write_cursor(cursor_x, cursor_y);
+	ctx->cursor_x = cx;
+	ctx->cursor_y = cy;
+	if (!IS_CURSOR_HIDDEN(ctx->cursor_x, ctx->cursor_y))
+		write_cursor(ctx->cursor_x, ctx->cursor_y);
 }
 
 void tb_put_cell(int x, int y, const struct tb_cell *cell)
 {
-	if ((unsigned)x >= (unsigned)back_buffer.width)
+	if ((unsigned)x >= (unsigned)ctx->back_buffer.width)
 		return;
-	if ((unsigned)y >= (unsigned)back_buffer.height)
+	if ((unsigned)y >= (unsigned)ctx->back_buffer.height)
 		return;
-	CELL(&back_buffer, x, y) = *cell;
+	CELL(&ctx->back_buffer, x, y) = *cell;
+	if (ctx->lent)
+		ctx->lent_cells[(size_t)y * ctx->back_buffer.width + x] = *cell;
 }
 
 void tb_change_cell(int x, int y, uint32_t ch, uint16_t fg, uint16_t bg)
@@ -242,11 +529,39 @@ void tb_change_cell(int x, int y, uint32_t ch, uint16_t fg, uint16_t bg)
 	tb_put_cell(x, y, &c);
 }
 
+int tb_change_cluster(int x, int y, const char *utf8, int len, uint16_t fg, uint16_t bg)
+{
+	int width;
+	uint32_t ch;
+	if (len <= 0)
+		return 0;
+	if (tb_utf8_char_length(*utf8) == len && tb_utf8_char_to_unicode(&ch, utf8) == len) {
+		width = wcwidth(ch);
+		tb_change_cell(x, y, ch, fg, bg);
+		return width < 1 ? 1 : width;
+	}
+	tb_utf8_cluster_length(utf8, len, &width);
+	if ((unsigned)x >= (unsigned)ctx->back_buffer.width || (unsigned)y >= (unsigned)ctx->back_buffer.height)
+		return width;
+	if (len > CLUSTER_MAX_LEN)
+		len = CLUSTER_MAX_LEN;
+	struct tb_cell c = {cluster_add(&ctx->back_clusters, utf8, len, width), fg, bg};
+	tb_put_cell(x, y, &c);
+	return width;
+}
+
+const char *tb_cell_cluster(uint32_t ch, int *len)
+{
+	if (!is_cluster(ch) || (int)(ch & ~TB_CLUSTER) >= ctx->back_clusters.bytes.len)
+		return 0;
+	return cluster_data(&ctx->back_clusters, ch, len);
+}
+
 void tb_blit(int x, int y, int w, int h, const struct tb_cell *cells)
 {
-	if (x + w < 0 || x >= back_buffer.width)
+	if (x + w < 0 || x >= ctx->back_buffer.width)
 		return;
-	if (y + h < 0 || y >= back_buffer.height)
+	if (y + h < 0 || y >= ctx->back_buffer.height)
 		return;
 	int xo = 0, yo = 0, ww = w, hh = h;
 	if (x < 0) {
@@ -259,26 +574,61 @@ void tb_blit(int x, int y, int w, int h, const struct tb_cell *cells)
 		hh -= yo;
 		y = 0;
 	}
-	if (ww > back_buffer.width - x)
-		ww = back_buffer.width - x;
-	if (hh > back_buffer.height - y)
-		hh = back_buffer.height - y;
+	if (ww > ctx->back_buffer.width - x)
+		ww = ctx->back_buffer.width - x;
+	if (hh > ctx->back_buffer.height - y)
+		hh = ctx->back_buffer.height - y;
 
 	int sy;
-	struct tb_cell *dst = &CELL(&back_buffer, x, y);
+	struct tb_cell *dst = &CELL(&ctx->back_buffer, x, y);
 	const struct tb_cell *src = cells + yo * w + xo;
 	size_t size = sizeof(struct tb_cell) * ww;
 
+	return_cells(true);
 	for (sy = 0; sy < hh; ++sy) {
 		memcpy(dst, src, size);
-		dst += back_buffer.width;
+		dst += ctx->back_buffer.stride;
 		src += w;
 	}
+	if (ctx->lent)
+		lend_cells();
 }
 
 struct tb_cell *tb_cell_buffer(void)
 {
-	return back_buffer.cells;
+	if (!ctx->lent) {
+		size_t cells = (size_t)ctx->back_buffer.width * ctx->back_buffer.height;
+		if (cells > ctx->lent_cap) {
+			struct tb_cell *lent_cells = (struct tb_cell *)realloc(ctx->lent_cells, sizeof(struct tb_cell) * cells);
+			if (!lent_cells)
+				return 0;
+			ctx->lent_cells = lent_cells;
+			ctx->lent_cap = cells;
+		}
+		lend_cells();
+		ctx->lent = true;
+	}
+	return ctx->lent_cells;
+}
+
+/* copies the back buffer into the cells lent by tb_cell_buffer() */
+static void lend_cells(void)
+{
+	int y, w = ctx->back_buffer.width;
+	for (y = 0; y < ctx->back_buffer.height; ++y)
+		memcpy(ctx->lent_cells + (size_t)y * w, ctx->back_buffer.row(y), sizeof(struct tb_cell) * w);
+}
+
+/* copies whatever was written to the lent cells into the back buffer, and
+ * takes them back unless 'keep' */
+static void return_cells(bool keep)
+{
+	int y, w = ctx->back_buffer.width;
+	if (!ctx->lent)
+		return;
+	for (y = 0; y < ctx->back_buffer.height; ++y)
+		memcpy(ctx->back_buffer.row(y), ctx->lent_cells + (size_t)y * w, sizeof(struct tb_cell) * w);
+	ctx->lent = keep;
 }
 
 int tb_poll_event(struct tb_event *event)
@@ -294,23 +644,530 @@ int tb_peek_event(struct tb_event *event, int timeout)
 	return wait_fill_event(event, &tv);
 }
 
+void tb_interrupt(void)
+{
+	tb_interrupt_context(ctx);
+}
+
+void tb_interrupt_context(struct tb_context *c)
+{
+	int fd = c->wakeup_fds[1];
+	if (fd >= 0) {
+		// a full pipe already has a wakeup pending
+		char zzz = 0;
+		ssize_t r = write(fd, &zzz, 1);
+		(void)r;
+	}
+}
+
+void tb_notify_resize(struct tb_context *c)
+{
+	int fd = c->winch_fds[1];
+	if (fd >= 0) {
+		const int zzz = 1;
+		ssize_t r = write(fd, &zzz, sizeof(int));
+		(void)r;
+	}
+}
+
+struct tb_context *tb_context_new(void)
+{
+	return new tb_context();
+}
+
+void tb_context_free(struct tb_context *c)
+{
+	if (c == &default_context)
+		return;
+	if (c->termw != -1) {
+		fputs("tb_context_free() called before tb_shutdown().", stderr);
+		abort();
+	}
+	if (ctx == c)
+		ctx = &default_context;
+	delete c;
+}
+
+struct tb_context *tb_select_context(struct tb_context *c)
+{
+	struct tb_context *prev = ctx;
+	ctx = c ? c : &default_context;
+	return prev;
+}
+
+struct tb_context *tb_current_context(void)
+{
+	return ctx;
+}
+
+void tb_event_fds(int fds[3])
+{
+	fds[0] = ctx->inout;
+	fds[1] = ctx->winch_fds[0];
+	fds[2] = ctx->wakeup_fds[0];
+}
+
+int tb_input_timeout(void)
+{
+	long left = -1;
+	if (ctx->partial_since >= 0) {
+		left = ctx->partial_since + ESC_SEQ_TIMEOUT_MS - now_ms();
+		if (left < 0) left = 0;
+	}
+	if (ctx->replay) {
+		// the next record, rounded up so that it's due by then
+		int64_t due = replay_due_in(ctx->replay);
+		if (due >= 0 && (left < 0 || (due + 999) / 1000 < left))
+			left = (due + 999) / 1000;
+	}
+	return (int)left;
+}
+
+int tb_input_pending(void)
+{
+	if (ctx->replay && replay_due_in(ctx->replay) == 0)
+		return 1;
+	// buffered bytes count only once they are more than a dangling escape sequence
+	if (inputbuffer_len(&ctx->input_buffer) > 0 && ctx->partial_since < 0)
+		return 1;
+	struct pollfd fds[2] = {{ctx->inout, POLLIN, 0}, {ctx->winch_fds[0], POLLIN, 0}};
+	if (poll(fds, 2, 0) > 0)
+		return 1;
+	if (!ctx->session)
+		return 0;
+	// what the viewers sent, a new one counts too
+	int i;
+	struct session *s = ctx->session;
+	struct pollfd listen_fd = {s->listen_fd, POLLIN, 0};
+	if (poll(&listen_fd, 1, 0) > 0)
+		return 1;
+	for (i = 0; i < s->clients_len; ++i) {
+		if (inputbuffer_len(&s->clients[i].in) > 0)
+			return 1;
+		struct pollfd client = {s->clients[i].fd, POLLIN, 0};
+		if (poll(&client, 1, 0) > 0)
+			return 1;
+	}
+	return 0;
+}
+
+int tb_listen(const char *path)
+{
+	if (ctx->session && ctx->session->listen_fd >= 0)
+		return -EBUSY;
+	if (!ctx->session)
+		ctx->session = session_new();
+	return -session_listen(ctx->session, path);
+}
+
+int tb_capture_input(const char *path)
+{
+	if (ctx->input_log)
+		return -EBUSY;
+	int err = 0;
+	ctx->input_log = inputlog_open(path, &err);
+	return ctx->input_log ? 0 : -err;
+}
+
+void tb_stop_input_capture(void)
+{
+	if (!ctx->input_log)
+		return;
+	inputlog_close(ctx->input_log);
+	ctx->input_log = 0;
+}
+
+int tb_replay_input(const char *path, int flags)
+{
+	if (ctx->replay)
+		return -EBUSY;
+	int err = 0;
+	ctx->replay = replay_open(path, flags, &err);
+	return ctx->replay ? 0 : -err;
+}
+
+int tb_get_replay_stats(struct tb_replay_stats *stats)
+{
+	if (!ctx->replay)
+		return -1;
+	replay_stats(ctx->replay, stats);
+	return 0;
+}
+
+int tb_record(const char *path, int keyframe_interval_ms, int flags)
+{
+	if (ctx->recorder)
+		return -EBUSY;
+	int err = 0;
+	ctx->recorder = recorder_open(path, keyframe_interval_ms, flags, &err);
+	if (!ctx->recorder)
+		return -err;
+	if (!ctx->session)
+		ctx->session = session_new();
+	return 0;
+}
+
+void tb_stop_recording(void)
+{
+	if (!ctx->recorder)
+		return;
+	recorder_close(ctx->recorder);
+	ctx->recorder = 0;
+	// a session that was only there for the recorder
+	if (ctx->session->listen_fd < 0) {
+		session_close(ctx->session);
+		ctx->session = 0;
+	}
+}
+
+static void attach_send_event(int fd, const struct tb_event *event)
+{
+	struct bytebuffer b;
+	bytebuffer_init(&b, sizeof(struct session_msg) + sizeof(struct tb_event));
+	session_queue_msg(&b, SESSION_MSG_EVENT, event, sizeof(struct tb_event));
+	int off = 0;
+	while (off < b.len) {
+		ssize_t r = send(fd, b.buf + off, b.len - off, MSG_NOSIGNAL);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			break;
+		off += r;
+	}
+	bytebuffer_free(&b);
+}
+
+// what the cells the server sends refer to: its styles as made here, by
+// their id there (the ones it never sent are TB_DEFAULT), and the clusters
+// of the frame being applied
+struct attach_state {
+	uint16_t styles[STYLE_MAX + 1];
+	struct cluster_pool clusters;
+};
+
+static void attach_put_cell(const struct attach_state *state, int x, int y, struct tb_cell cell)
+{
+	if (cell.fg & TB_STYLE) {
+		cell.fg = state->styles[cell.fg & STYLE_MAX];
+		cell.bg = TB_DEFAULT;
+	}
+	if (is_cluster(cell.ch)) {
+		uint32_t offset = cell.ch & ~TB_CLUSTER;
+		const struct bytebuffer *pool = &state->clusters.bytes;
+		if (offset + sizeof(struct cluster_head) > (uint32_t)pool->len ||
+		    offset + sizeof(struct cluster_head) + cluster_get(&state->clusters, cell.ch)->len > (uint32_t)pool->len)
+			return;
+		int len;
+		const char *data = cluster_data(&state->clusters, cell.ch, &len);
+		tb_change_cluster(x, y, data, len, cell.fg, cell.bg);
+		return;
+	}
+	tb_put_cell(x, y, &cell);
+}
+
+static struct attach_state *attach_state_new(void)
+{
+	return static_cast<struct attach_state*>(calloc(1, sizeof(struct attach_state)));
+}
+
+static void attach_state_free(struct attach_state *state)
+{
+	cluster_pool_free(&state->clusters);
+	free(state);
+}
+
+// applies what the server sent, the back buffer mirrors its screen
+static void attach_apply(struct attach_state *state, const struct session_msg *msg, const char *data)
+{
+	if (msg->type == SESSION_MSG_CLUSTERS) {
+		cluster_pool_clear(&state->clusters);
+		bytebuffer_append(&state->clusters.bytes, data, msg->len);
+		return;
+	}
+	if (msg->type == SESSION_MSG_STYLES && msg->len >= sizeof(uint32_t)) {
+		uint32_t id;
+		memcpy(&id, data, sizeof(id));
+		const char *p = data + sizeof(id), *end = data + msg->len;
+		for (; p + sizeof(struct session_style) <= end && id <= STYLE_MAX; p += sizeof(struct session_style), ++id) {
+			struct session_style def;
+			memcpy(&def, p, sizeof(def));
+			state->styles[id] = tb_style(def.fg, def.bg, def.attrs);
+		}
+		return;
+	}
+	if (msg->type == SESSION_MSG_SCROLL && msg->len == sizeof(struct session_scroll)) {
+		struct session_scroll scroll;
+		memcpy(&scroll, data, sizeof(scroll));
+		tb_scroll(0, scroll.top, ctx->back_buffer.width, scroll.height, scroll.dy);
+		return;
+	}
+	if (msg->type != SESSION_MSG_FRAME || msg->len < sizeof(struct session_frame))
+		return;
+	struct session_frame frame;
+	memcpy(&frame, data, sizeof(frame));
+	if (frame.keyframe)
+		tb_clear();
+	const char *p = data + sizeof(frame), *end = data + msg->len;
+	uint32_t i;
+	int x;
+	for (i = 0; i < frame.spans && p + sizeof(struct session_span) <= end; ++i) {
+		struct session_span span;
+		memcpy(&span, p, sizeof(span));
+		p += sizeof(span);
+		if (frame.rle && span.runs > 0) {
+			if (p + sizeof(struct session_run) * span.runs > end)
+				break;
+			int j, r, x = span.x;
+			for (r = 0; r < span.runs; ++r) {
+				struct session_run run;
+				memcpy(&run, p + sizeof(struct session_run) * r, sizeof(run));
+				for (j = 0; j < (int)run.count; ++j)
+					attach_put_cell(state, x++, span.y, run.cell);
+			}
+			p += sizeof(struct session_run) * span.runs;
+			continue;
+		}
+		if (p + sizeof(struct tb_cell) * span.n > end)
+			break;
+		for (x = 0; x < span.n; ++x) {
+			struct tb_cell cell;
+			memcpy(&cell, p + sizeof(struct tb_cell) * x, sizeof(cell));
+			attach_put_cell(state, span.x + x, span.y, cell);
+		}
+		p += sizeof(struct tb_cell) * span.n;
+	}
+	cluster_pool_clear(&state->clusters);
+	if (frame.outputmode != ctx->outputmode)
+		tb_select_output_mode(frame.outputmode);
+	tb_set_cursor(frame.cursor_x, frame.cursor_y);
+	tb_present();
+}
+
+int tb_attach(const char *path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		int err = errno;
+		close(fd);
+		return -err;
+	}
+
+	// the server learns our size first, then gets a keyframe for it
+	struct tb_event event;
+	memset(&event, 0, sizeof(event));
+	event.type = TB_EVENT_RESIZE;
+	event.w = tb_width();
+	event.h = tb_height();
+	attach_send_event(fd, &event);
+	tb_clear();
+
+	struct inputbuffer in;
+	inputbuffer_init(&in, 64 * 1024);
+	struct attach_state *state = attach_state_new();
+	int result = 0;
+	bool attached = true;
+	while (attached) {
+		struct pollfd fds[4];
+		int event_fds[3], i;
+		tb_event_fds(event_fds);
+		fds[0] = {fd, POLLIN, 0};
+		for (i = 0; i < 3; ++i)
+			fds[i + 1] = {event_fds[i], POLLIN, 0};
+		if (poll(fds, 4, tb_input_timeout()) < 0) {
+			if (errno == EINTR)
+				continue;
+			result = -errno;
+			break;
+		}
+
+		if (fds[0].revents) {
+			char *tail = inputbuffer_reserve_tail(&in, 64 * 1024);
+			ssize_t r = read(fd, tail, 64 * 1024);
+			if (r == 0 || (r < 0 && errno != EINTR && errno != EAGAIN))
+				break;
+			if (r > 0)
+				inputbuffer_commit(&in, r);
+			struct session_msg msg;
+			while (inputbuffer_len(&in) >= (int)sizeof(msg)) {
+				memcpy(&msg, inputbuffer_data(&in), sizeof(msg));
+				if ((size_t)inputbuffer_len(&in) < sizeof(msg) + msg.len)
+					break;
+				attach_apply(state, &msg, inputbuffer_data(&in) + sizeof(msg));
+				inputbuffer_consume(&in, sizeof(msg) + msg.len);
+			}
+		}
+
+		int type;
+		while (attached && (type = tb_peek_event(&event, 0)) != 0) {
+			if (type < 0) {
+				result = -1;
+				attached = false;
+			} else if (type == TB_EVENT_KEY && event.key == TB_KEY_CTRL_BACKSLASH && event.ch == 0) {
+				// like dtach, the server keeps running
+				attached = false;
+			} else if (type == TB_EVENT_RESIZE) {
+				tb_clear();
+				attach_send_event(fd, &event);
+			} else if (type == TB_EVENT_KEY || type == TB_EVENT_MOUSE) {
+				attach_send_event(fd, &event);
+			}
+		}
+	}
+	attach_state_free(state);
+	inputbuffer_free(&in);
+	close(fd);
+	return result;
+}
+
+static void asciicast_string(FILE *out, const char *data, int len)
+{
+	int i;
+	fputc('"', out);
+	for (i = 0; i < len; ++i) {
+		unsigned char c = data[i];
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20 || c == 0x7f)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+int tb_export_asciicast(const char *recording, const char *path)
+{
+	int fd = open(recording, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	struct inputbuffer in;
+	inputbuffer_init(&in, 64 * 1024);
+	ssize_t r;
+	while ((r = read(fd, inputbuffer_reserve_tail(&in, 64 * 1024), 64 * 1024)) > 0)
+		inputbuffer_commit(&in, r);
+	close(fd);
+
+	const char *data = inputbuffer_data(&in);
+	const char *end = data + inputbuffer_len(&in);
+	struct session_msg msg;
+	struct session_frame frame;
+	const char *p;
+	if (end - data < RECORDER_MAGIC_LEN || memcmp(data, RECORDER_MAGIC, RECORDER_MAGIC_LEN) != 0) {
+		inputbuffer_free(&in);
+		return -EINVAL;
+	}
+	data += RECORDER_MAGIC_LEN;
+
+	// the cast starts with the time and size of the first frame
+	int64_t start = -1;
+	int width = -1, height = -1;
+	for (p = data; end - p >= (long)sizeof(msg); p += sizeof(msg) + msg.len) {
+		memcpy(&msg, p, sizeof(msg));
+		if ((size_t)(end - p) < sizeof(msg) + msg.len)
+			break;
+		if (msg.type == SESSION_MSG_TIME && msg.len == sizeof(start) && start < 0)
+			memcpy(&start, p + sizeof(msg), sizeof(start));
+		if (msg.type == SESSION_MSG_FRAME && msg.len >= sizeof(frame)) {
+			memcpy(&frame, p + sizeof(msg), sizeof(frame));
+			width = frame.width;
+			height = frame.height;
+			break;
+		}
+	}
+	if (start < 0 || width < 0) {
+		inputbuffer_free(&in);
+		return -EINVAL;
+	}
+
+	FILE *out = fopen(path, "w");
+	if (!out) {
+		int err = errno;
+		inputbuffer_free(&in);
+		return -err;
+	}
+	const char *term = getenv("TERM");
+	fprintf(out, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld, \"env\": {\"TERM\": ",
+		width, height, (long long)(start / 1000000));
+	asciicast_string(out, term ? term : "xterm", strlen(term ? term : "xterm"));
+	fputs("}}\n", out);
+
+	// played back in a headless context of its own, which writes what a
+	// terminal would have been sent
+	struct tb_context *player = tb_context_new();
+	struct tb_context *prev = tb_select_context(player);
+	struct bytebuffer capture;
+	bytebuffer_init(&capture, 32 * 1024);
+	struct attach_state *state = attach_state_new();
+	ctx->capture = &capture;
+	tb_init_headless(width, height);
+	int64_t now = start;
+	for (p = data; end - p >= (long)sizeof(msg); p += sizeof(msg) + msg.len) {
+		memcpy(&msg, p, sizeof(msg));
+		if ((size_t)(end - p) < sizeof(msg) + msg.len)
+			break;
+		const char *payload = p + sizeof(msg);
+		double t = (now - start) / 1000000.0;
+		if (msg.type == SESSION_MSG_TIME && msg.len == sizeof(now)) {
+			memcpy(&now, payload, sizeof(now));
+			continue;
+		}
+		if (msg.type == SESSION_MSG_FRAME && msg.len >= sizeof(frame)) {
+			memcpy(&frame, payload, sizeof(frame));
+			if (frame.width != ctx->headless_w || frame.height != ctx->headless_h) {
+				ctx->headless_w = frame.width;
+				ctx->headless_h = frame.height;
+				ctx->buffer_size_change_request = 1;
+				fprintf(out, "[%.6f, \"r\", \"%dx%d\"]\n", t, frame.width, frame.height);
+			}
+		}
+		attach_apply(state, &msg, payload);
+		// what's painted with the styles comes with the next frame
+		if (msg.type == SESSION_MSG_STYLES)
+			continue;
+		if (capture.len > 0) {
+			fprintf(out, "[%.6f, \"o\", ", t);
+			asciicast_string(out, capture.buf, capture.len);
+			fputs("]\n", out);
+			bytebuffer_clear(&capture);
+		}
+	}
+	ctx->capture = 0;
+	tb_shutdown();
+	tb_select_context(prev);
+	tb_context_free(player);
+	attach_state_free(state);
+	bytebuffer_free(&capture);
+	inputbuffer_free(&in);
+	return fclose(out) == 0 ? 0 : -EIO;
+}
+
 int tb_width(void)
 {
-	return termw;
+	return ctx->termw;
 }
 
 int tb_height(void)
 {
-	return termh;
+	return ctx->termh;
 }
 
 void tb_clear(void)
 {
-	if (buffer_size_change_request) {
+	if (ctx->buffer_size_change_request) {
 		update_size();
-		buffer_size_change_request = 0;
+		ctx->buffer_size_change_request = 0;
 	}
-	cellbuf_clear(&back_buffer);
+	ctx->lent = false;
+	cellbuf_clear(&ctx->back_buffer);
+	cluster_pool_clear(&ctx->back_clusters);
 }
 
 int tb_select_input_mode(int mode)
@@ -324,29 +1181,55 @@ int tb_select_input_mode(int mode)
 		if ((mode & (TB_INPUT_ESC | TB_INPUT_ALT)) == (TB_INPUT_ESC | TB_INPUT_ALT))
 			mode &= ~TB_INPUT_ALT;
 
-		inputmode = mode;
+		/* motion tracking is an extension of the mouse mode */
+		if ((mode & TB_INPUT_MOUSE) == 0)
+			mode &= ~TB_INPUT_MOTION;
+
+		if ((ctx->inputmode & TB_INPUT_MOTION) && !(mode & TB_INPUT_MOTION))
+			bytebuffer_puts(&ctx->output_buffer, EXIT_MOUSE_MOTION_SEQ);
+
+		ctx->inputmode = mode;
 		if (mode&TB_INPUT_MOUSE) {
-			bytebuffer_puts(&output_buffer, funcs[T_ENTER_MOUSE]);
-			bytebuffer_flush(&output_buffer, inout);
+			bytebuffer_puts(&ctx->output_buffer, funcs[T_ENTER_MOUSE]);
+			if ((mode & TB_INPUT_MOTION) && funcs[T_ENTER_MOUSE][0])
+				bytebuffer_puts(&ctx->output_buffer, ENTER_MOUSE_MOTION_SEQ);
+			flush_output(false);
 		} else {
-			bytebuffer_puts(&output_buffer, funcs[T_EXIT_MOUSE]);
-			bytebuffer_flush(&output_buffer, inout);
+			bytebuffer_puts(&ctx->output_buffer, funcs[T_EXIT_MOUSE]);
+			flush_output(false);
 		}
 	}
-	return inputmode;
+	return ctx->inputmode;
 }
 
 int tb_select_output_mode(int mode)
 {
 	if (mode)
-		outputmode = mode;
-	return outputmode;
+		ctx->outputmode = mode;
+	return ctx->outputmode;
+}
+
+uint16_t tb_style(uint32_t fg, uint32_t bg, uint16_t attrs)
+{
+	int id = style_intern(fg, bg, attrs);
+	return id < 0 ? TB_DEFAULT : TB_STYLE | id;
+}
+
+int tb_style_info(uint16_t style, uint32_t *fg, uint32_t *bg, uint16_t *attrs)
+{
+	if (!(style & TB_STYLE) || (style & STYLE_MAX) >= style_published())
+		return -1;
+	const struct style *st = style_get(style & STYLE_MAX);
+	if (fg) *fg = st->fg;
+	if (bg) *bg = st->bg;
+	if (attrs) *attrs = st->attrs;
+	return 0;
 }
 
 void tb_set_clear_attributes(uint16_t fg, uint16_t bg)
 {
-	foreground = fg;
-	background = bg;
+	ctx->foreground = fg;
+	ctx->background = bg;
 }
 
 /* -------------------------------------------------------- */
@@ -366,8 +1249,8 @@ static int convertnum(uint32_t num, char* buf) {
 	return l;
 }
 
-#define WRITE_LITERAL(X) bytebuffer_append(&output_buffer, (X), sizeof(X)-1)
-#define WRITE_INT(X) bytebuffer_append(&output_buffer, buf, convertnum((X), buf))
+#define WRITE_LITERAL(X) bytebuffer_append(&ctx->output_buffer, (X), sizeof(X)-1)
+#define WRITE_INT(X) bytebuffer_append(&ctx->output_buffer, buf, convertnum((X), buf))
 
 static void write_cursor(int x, int y) {
 	char buf[32];
@@ -384,10 +1267,11 @@ static void write_sgr(uint16_t fg, uint16_t bg) {
 	if (fg == TB_DEFAULT && bg == TB_DEFAULT)
 		return;
 
-	switch (outputmode) {
+	switch (ctx->outputmode) {
 	case TB_OUTPUT_256:
 	case TB_OUTPUT_216:
 	case TB_OUTPUT_GRAYSCALE:
+	case TB_OUTPUT_TRUECOLOR:
 		WRITE_LITERAL("\033[");
 		if (fg != TB_DEFAULT) {
 			WRITE_LITERAL("38;5;");
@@ -421,54 +1305,10 @@ static void write_sgr(uint16_t fg, uint16_t bg) {
 	}
 }
 
-static void cellbuf_init(struct cellbuf *buf, int width, int height)
-{
-	buf->cells = (struct tb_cell*)malloc(sizeof(struct tb_cell) * width * height);
-	assert(buf->cells);
-	buf->width = width;
-	buf->height = height;
-}
-
-static void cellbuf_resize(struct cellbuf *buf, int width, int height)
-{
-	if (buf->width == width && buf->height == height)
-		return;
-
-	int oldw = buf->width;
-	int oldh = buf->height;
-	struct tb_cell *oldcells = buf->cells;
-
-	cellbuf_init(buf, width, height);
-	cellbuf_clear(buf);
-
-	int minw = (width < oldw) ? width : oldw;
-	int minh = (height < oldh) ? height : oldh;
-	int i;
-
-	for (i = 0; i < minh; ++i) {
-		struct tb_cell *csrc = oldcells + (i * oldw);
-		struct tb_cell *cdst = buf->cells + (i * width);
-		memcpy(cdst, csrc, sizeof(struct tb_cell) * minw);
-	}
-
-	free(oldcells);
-}
-
 static void cellbuf_clear(struct cellbuf *buf)
 {
-	int i;
-	int ncells = buf->width * buf->height;
-
-	for (i = 0; i < ncells; ++i) {
-		buf->cells[i].ch = ' ';
-		buf->cells[i].fg = foreground;
-		buf->cells[i].bg = background;
-	}
-}
-
-static void cellbuf_free(struct cellbuf *buf)
-{
-	free(buf->cells);
+	struct tb_cell blank = {' ', ctx->foreground, ctx->background};
+	buf->fill(0, 0, buf->width, buf->height, blank);
 }
 
 static void get_term_size(int *w, int *h)
@@ -476,7 +1316,12 @@ static void get_term_size(int *w, int *h)
 	struct winsize sz;
 	memset(&sz, 0, sizeof(sz));
 
-	ioctl(inout, TIOCGWINSZ, &sz);
+	if (ctx->inout < 0) {
+		sz.ws_col = ctx->headless_w;
+		sz.ws_row = ctx->headless_h;
+	} else {
+		ioctl(ctx->inout, TIOCGWINSZ, &sz);
+	}
 
 	if (w) *w = sz.ws_col;
 	if (h) *h = sz.ws_row;
@@ -484,27 +1329,36 @@ static void get_term_size(int *w, int *h)
 
 static void update_term_size(void)
 {
-	struct winsize sz;
-	memset(&sz, 0, sizeof(sz));
-
-	ioctl(inout, TIOCGWINSZ, &sz);
-
-	termw = sz.ws_col;
-	termh = sz.ws_row;
+	get_term_size(&ctx->termw, &ctx->termh);
 }
 
 static void send_attr(uint16_t fg, uint16_t bg)
 {
-#define LAST_ATTR_INIT 0xFFFF
-	static uint16_t lastfg = LAST_ATTR_INIT, lastbg = LAST_ATTR_INIT;
-	if (fg != lastfg || bg != lastbg) {
-		bytebuffer_puts(&output_buffer, funcs[T_SGR0]);
+	if (fg & TB_STYLE) {
+		// the whole sequence was made with the style, bg plays no part
+		if (fg != ctx->lastfg) {
+			int id = fg & STYLE_MAX;
+			if (id < style_published()) {
+				const struct style *st = style_get(id);
+				int mode = ctx->outputmode > 0 && ctx->outputmode <= STYLE_MODES ? ctx->outputmode : TB_OUTPUT_NORMAL;
+				bytebuffer_append(&ctx->output_buffer, st->sgr[mode - 1], st->sgr_len[mode - 1]);
+			} else {
+				bytebuffer_puts(&ctx->output_buffer, funcs[T_SGR0]);
+			}
+			ctx->lastfg = fg;
+			ctx->lastbg = bg;
+		}
+		return;
+	}
+	if (fg != ctx->lastfg || bg != ctx->lastbg) {
+		bytebuffer_puts(&ctx->output_buffer, funcs[T_SGR0]);
 
 		uint16_t fgcol;
 		uint16_t bgcol;
 
-		switch (outputmode) {
+		switch (ctx->outputmode) {
 		case TB_OUTPUT_256:
+		case TB_OUTPUT_TRUECOLOR:
 			fgcol = fg & 0xFF;
 			bgcol = bg & 0xFF;
 			break;
@@ -530,76 +1384,271 @@ static void send_attr(uint16_t fg, uint16_t bg)
 		}
 
 		if (fg & TB_BOLD)
-			bytebuffer_puts(&output_buffer, funcs[T_BOLD]);
+			bytebuffer_puts(&ctx->output_buffer, funcs[T_BOLD]);
 		if (bg & TB_BOLD)
-			bytebuffer_puts(&output_buffer, funcs[T_BLINK]);
+			bytebuffer_puts(&ctx->output_buffer, funcs[T_BLINK]);
 		if (fg & TB_UNDERLINE)
-			bytebuffer_puts(&output_buffer, funcs[T_UNDERLINE]);
+			bytebuffer_puts(&ctx->output_buffer, funcs[T_UNDERLINE]);
 		if ((fg & TB_REVERSE) || (bg & TB_REVERSE))
-			bytebuffer_puts(&output_buffer, funcs[T_REVERSE]);
+			bytebuffer_puts(&ctx->output_buffer, funcs[T_REVERSE]);
 
 		write_sgr(fgcol, bgcol);
 
-		lastfg = fg;
-		lastbg = bg;
+		ctx->lastfg = fg;
+		ctx->lastbg = bg;
 	}
 }
 
+static void send_cluster(int x, int y, uint32_t ch)
+{
+	int len;
+	const char *data = cluster_data(&ctx->back_clusters, ch, &len);
+	if (x-1 != ctx->lastx || y != ctx->lasty)
+		write_cursor(x, y);
+	ctx->lastx = x; ctx->lasty = y;
+	bytebuffer_append(&ctx->output_buffer, data, len);
+}
+
 static void send_char(int x, int y, uint32_t c)
 {
 	char buf[7];
 	int bw = tb_utf8_unicode_to_char(buf, c);
-	if (x-1 != lastx || y != lasty)
+	if (x-1 != ctx->lastx || y != ctx->lasty)
 		write_cursor(x, y);
-	lastx = x; lasty = y;
+	ctx->lastx = x; ctx->lasty = y;
 	if(!c) buf[0] = ' '; // replace 0 with whitespace
-	bytebuffer_append(&output_buffer, buf, bw);
+	bytebuffer_append(&ctx->output_buffer, buf, bw);
 }
 
 static void send_clear(void)
 {
-	send_attr(foreground, background);
-	bytebuffer_puts(&output_buffer, funcs[T_CLEAR_SCREEN]);
-	if (!IS_CURSOR_HIDDEN(cursor_x, cursor_y))
-		write_cursor(cursor_x, cursor_y);
-	bytebuffer_flush(&output_buffer, inout);
+	send_attr(ctx->foreground, ctx->background);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_CLEAR_SCREEN]);
+	if (!IS_CURSOR_HIDDEN(ctx->cursor_x, ctx->cursor_y))
+		write_cursor(ctx->cursor_x, ctx->cursor_y);
+	flush_output(false);
 
 	/* we need to invalidate cursor position too and these two vars are
 	 * used only for simple cursor positioning optimization, cursor
 	 * actually may be in the correct place, but we simply discard
 	 * optimization once and it gives us simple solution for the case when
 	 * cursor moved */
-	lastx = LAST_COORD_INIT;
-	lasty = LAST_COORD_INIT;
+	ctx->lastx = LAST_COORD_INIT;
+	ctx->lasty = LAST_COORD_INIT;
+}
+
+/* hand the output to the writer thread if there is one, or write it now */
+static void flush_output(bool frame)
+{
+	if (ctx->output_writer.running)
+		writer_append(&ctx->output_writer, &ctx->output_buffer, frame);
+	else if (ctx->inout >= 0)
+		bytebuffer_flush(&ctx->output_buffer, ctx->inout);
+	else {
+		if (ctx->capture)
+			bytebuffer_append(ctx->capture, ctx->output_buffer.buf, ctx->output_buffer.len);
+		bytebuffer_clear(&ctx->output_buffer);
+	}
+}
+
+/* the screen changed in a way a diff can't tell, the viewers and the
+ * recorder need a keyframe */
+static void resync_session(void)
+{
+	if (ctx->session)
+		session_resync(ctx->session);
+	if (ctx->recorder)
+		ctx->recorder->needs_keyframe = true;
+}
+
+/* if the writer thread hasn't got to the last frame yet, drop it and go
+ * back to the screen as it was before it */
+static void take_back_frame(void)
+{
+	if (ctx->frame_base.width == ctx->front_buffer.width &&
+	    ctx->frame_base.height == ctx->front_buffer.height &&
+	    writer_take_back_frame(&ctx->output_writer)) {
+		ctx->front_buffer.copy_from(ctx->frame_base);
+		ctx->front_hashes_valid = false;
+		resync_session();
+		ctx->lastfg = ctx->lastbg = LAST_ATTR_INIT;
+	}
+}
+
+/* scroll rows [y, y + h) of the screen up by dy rows (down if negative). the
+ * region is limited to the rows, then lines are deleted at the top to scroll
+ * up or inserted to scroll down. the rows exposed are blanked by the
+ * terminal and marked unknown in the front buffer, so only they get painted */
+static void scroll_front(int y, int h, int dy)
+{
+	int n = (dy > 0) ? dy : -dy;
+	ctx->front_buffer.scroll(0, y, ctx->front_buffer.width, h, dy, cellbuf_unknown);
+	char seq[64];
+	int len = snprintf(seq, sizeof(seq), "\033[%d;%dr\033[%d;1H\033[%d%c\033[r",
+			   y + 1, y + h, y + 1, n, dy > 0 ? 'M' : 'L');
+	bytebuffer_append(&ctx->output_buffer, seq, len);
+	if (ctx->session && (ctx->session->clients_len > 0 || ctx->recorder))
+		session_add_scroll(ctx->session, y, h, dy);
+	ctx->lastx = LAST_COORD_INIT;
+	ctx->lasty = LAST_COORD_INIT;
 }
 
 static void sigwinch_handler(int xxx)
 {
 	(void) xxx;
 	const int zzz = 1;
-	write(winch_fds[1], &zzz, sizeof(int));
+	int i;
+	for (i = 0; i < MAX_SIGWINCH_FDS; ++i) {
+		int fd = sigwinch_fds[i];
+		if (fd >= 0) {
+			ssize_t r = write(fd, &zzz, sizeof(int));
+			(void)r;
+		}
+	}
 }
 
-static void update_size(void)
+static void sigwinch_subscribe(int fd)
 {
-	update_term_size();
-	cellbuf_resize(&back_buffer, termw, termh);
-	cellbuf_resize(&front_buffer, termw, termh);
-	cellbuf_clear(&front_buffer);
+	int i;
+	pthread_mutex_lock(&sigwinch_lock);
+	if (!sigwinch_installed) {
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = sigwinch_handler;
+		sa.sa_flags = 0;
+		sigaction(SIGWINCH, &sa, 0);
+		sigwinch_installed = true;
+	}
+	for (i = 0; i < MAX_SIGWINCH_FDS; ++i) {
+		if (sigwinch_fds[i] < 0) {
+			sigwinch_fds[i] = fd;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sigwinch_lock);
+}
+
+static void sigwinch_unsubscribe(int fd)
+{
+	int i;
+	pthread_mutex_lock(&sigwinch_lock);
+	for (i = 0; i < MAX_SIGWINCH_FDS; ++i) {
+		if (sigwinch_fds[i] == fd)
+			sigwinch_fds[i] = -1;
+	}
+	pthread_mutex_unlock(&sigwinch_lock);
+}
+
+/* with fallback, an unknown terminal is taken for an xterm */
+static int acquire_term(bool fallback)
+{
+	int ret = 0;
+	pthread_mutex_lock(&term_lock);
+	if (term_users == 0) {
+		ret = init_term();
+		if (ret < 0 && fallback) {
+			keys = xterm_keys;
+			funcs = xterm_funcs;
+			ret = 0;
+		}
+		if (ret == 0)
+			key_trie_init(keys);
+	}
+	if (ret == 0)
+		term_users++;
+	pthread_mutex_unlock(&term_lock);
+	return ret < 0 ? -1 : 0;
+}
+
+static int open_pipes(void)
+{
+	if (pipe(ctx->winch_fds) < 0)
+		return -1;
+	/* a burst of signals must neither block the handler on a full pipe nor
+	 * make us read more than what's there when draining it */
+	fcntl(ctx->winch_fds[0], F_SETFL, fcntl(ctx->winch_fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(ctx->winch_fds[1], F_SETFL, fcntl(ctx->winch_fds[1], F_GETFL) | O_NONBLOCK);
+
+	if (pipe(ctx->wakeup_fds) < 0) {
+		close(ctx->winch_fds[0]);
+		close(ctx->winch_fds[1]);
+		return -1;
+	}
+	fcntl(ctx->wakeup_fds[0], F_SETFL, fcntl(ctx->wakeup_fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(ctx->wakeup_fds[1], F_SETFL, fcntl(ctx->wakeup_fds[1], F_GETFL) | O_NONBLOCK);
+	return 0;
+}
+
+static int init_buffers(void)
+{
+	inputbuffer_init(&ctx->input_buffer, 4096);
+	bytebuffer_init(&ctx->output_buffer, 32 * 1024);
+
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_ENTER_CA]);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_ENTER_KEYPAD]);
+	bytebuffer_puts(&ctx->output_buffer, funcs[T_HIDE_CURSOR]);
 	send_clear();
+
+	update_term_size();
+	ctx->back_buffer.init(ctx->termw, ctx->termh);
+	ctx->front_buffer.init(ctx->termw, ctx->termh);
+	cellbuf_clear(&ctx->back_buffer);
+	cellbuf_clear(&ctx->front_buffer);
+	cluster_pool_clear(&ctx->back_clusters);
+	cluster_pool_clear(&ctx->front_clusters);
+	ctx->front_hashes_valid = false;
+
+	return 0;
 }
 
-static int read_up_to(int n) {
-	assert(n > 0);
-	const int prevlen = input_buffer.len;
-	bytebuffer_resize(&input_buffer, prevlen + n);
+static void release_term(void)
+{
+	pthread_mutex_lock(&term_lock);
+	if (--term_users == 0) {
+		key_trie_free();
+		shutdown_term();
+	}
+	pthread_mutex_unlock(&term_lock);
+}
 
+static void update_size(void)
+{
+	int oldw = ctx->termw;
+	int oldh = ctx->termh;
+	struct tb_cell blank = {' ', ctx->foreground, ctx->background};
+
+	update_term_size();
+	ctx->back_buffer.resize(ctx->termw, ctx->termh, blank);
+
+	/* the terminal keeps showing what it showed in the overlapping area, so
+	 * instead of clearing the screen only the newly exposed cells are marked
+	 * for repainting */
+	ctx->front_buffer.resize(ctx->termw, ctx->termh, cellbuf_unknown);
+	/* a wide char may have been cut off by the new right edge */
+	if (ctx->termw < oldw && ctx->termw > 0)
+		ctx->front_buffer.fill(ctx->termw - 1, 0, 1, (ctx->termh < oldh) ? ctx->termh : oldh, cellbuf_unknown);
+
+	ctx->front_hashes_valid = false;
+	resync_session();
+	ctx->lastx = LAST_COORD_INIT;
+	ctx->lasty = LAST_COORD_INIT;
+}
+
+// read everything the terminal has for us, in chunks of at least
+// READ_CHUNK bytes. returns the number of bytes read or -1 on error
+#define READ_CHUNK 4096
+static int read_available(void) {
 	int read_n = 0;
-	while (read_n <= n) {
-		ssize_t r = 0;
-		if (read_n < n) {
-			r = read(inout, input_buffer.buf + prevlen + read_n, n - read_n);
-		}
+	if (ctx->inout < 0)
+		return 0;
+	while (1) {
+		int avail = READ_CHUNK;
+		// a paste can be much bigger, take it in one go
+		int queued = 0;
+		if (ioctl(ctx->inout, FIONREAD, &queued) == 0 && queued > avail)
+			avail = queued;
+		char *tail = inputbuffer_reserve_tail(&ctx->input_buffer, avail);
+		ssize_t r = read(ctx->inout, tail, avail);
 #ifdef __CYGWIN__
 		// While linux man for tty says when VMIN == 0 && VTIME == 0, read
 		// should return 0 when there is nothing to read, cygwin's read returns
@@ -608,69 +1657,244 @@ static int read_up_to(int n) {
 		if (r < 0) r = 0;
 #endif
 		if (r < 0) {
-			// EAGAIN / EWOULDBLOCK shouldn't occur here
-			assert(errno != EAGAIN && errno != EWOULDBLOCK);
+			if (errno == EINTR)
+				continue;
+			// the fd was made non-blocking again behind our back, nothing
+			// to read then
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return read_n;
 			return -1;
-		} else if (r > 0) {
-			read_n += r;
-		} else {
-			bytebuffer_resize(&input_buffer, prevlen + read_n);
-			return read_n;
 		}
+		inputbuffer_commit(&ctx->input_buffer, r);
+		if (ctx->input_log && r > 0)
+			inputlog_add(ctx->input_log, INPUTLOG_BYTES, tail, r);
+		read_n += r;
+		if (r < avail)
+			return read_n;
 	}
-	assert(!"unreachable");
-	return 0;
 }
 
-static int wait_fill_event(struct tb_event *event, struct timeval *timeout)
+static long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// extract an event from the input buffer, keeping track of how long an
+// incomplete escape sequence has been waiting for the rest of its bytes
+static bool extract_buffered_event(struct tb_event *event)
 {
-	// ;-)
-#define ENOUGH_DATA_FOR_PARSING 64
-	fd_set events;
+	bool partial;
+	bool timed_out = ctx->partial_since >= 0 && now_ms() - ctx->partial_since >= ESC_SEQ_TIMEOUT_MS;
 	memset(event, 0, sizeof(struct tb_event));
+	event->type = TB_EVENT_KEY;
+	bool extracted = extract_event(event, &ctx->input_buffer, ctx->inputmode, timed_out, &partial);
+	if (!partial)
+		ctx->partial_since = -1;
+	else if (ctx->partial_since < 0)
+		ctx->partial_since = now_ms();
+	return extracted;
+}
+
+// an event a viewer sent. a resize is the size of the viewer's terminal, it
+// only means something to a headless context: the last viewer to resize wins
+static bool extract_session_event(struct tb_event *event)
+{
+	if (!ctx->session)
+		return false;
+	/* a new size means a keyframe with the next present anyway */
+	if (!ctx->buffer_size_change_request)
+		session_catch_up(ctx->session, &ctx->front_buffer, &ctx->front_clusters,
+				 ctx->cursor_x, ctx->cursor_y, ctx->outputmode);
+	while (session_extract_event(ctx->session, event)) {
+		if (event->type != TB_EVENT_RESIZE)
+			return true;
+		if (ctx->inout >= 0 || event->w <= 0 || event->h <= 0)
+			continue;
+		ctx->headless_w = event->w;
+		ctx->headless_h = event->h;
+		ctx->buffer_size_change_request = 1;
+		return true;
+	}
+	return false;
+}
+
+// the next record of the log goes to the input buffer, or makes the screen
+// the size it was. the tty's own input is left alone during a replay
+static int replay_wait_event(struct tb_event *event, long deadline)
+{
+	while (1) {
+		if (extract_buffered_event(event)) {
+			replay_reported(ctx->replay);
+			return event->type;
+		}
+		int64_t due = replay_due_in(ctx->replay);
+		if (due == 0) {
+			const struct inputlog_record *rec = replay_take(ctx->replay);
+			const char *payload = (const char*)(rec + 1);
+			if (rec->type == INPUTLOG_BYTES) {
+				memcpy(inputbuffer_reserve_tail(&ctx->input_buffer, rec->len), payload, rec->len);
+				inputbuffer_commit(&ctx->input_buffer, rec->len);
+			} else if (rec->type == INPUTLOG_RESIZE && rec->len == 2 * sizeof(int32_t)) {
+				int32_t size[2];
+				memcpy(size, payload, sizeof(size));
+				if (ctx->inout >= 0) {
+					struct winsize sz;
+					memset(&sz, 0, sizeof(sz));
+					sz.ws_col = size[0];
+					sz.ws_row = size[1];
+					ioctl(ctx->inout, TIOCSWINSZ, &sz);
+				} else {
+					ctx->headless_w = size[0];
+					ctx->headless_h = size[1];
+				}
+				ctx->buffer_size_change_request = 1;
+				event->type = TB_EVENT_RESIZE;
+				event->w = size[0];
+				event->h = size[1];
+				replay_reported(ctx->replay);
+				return TB_EVENT_RESIZE;
+			}
+			continue;
+		}
+		if (due < 0 && replay_done(ctx->replay))
+			return -1;
+
+		// wait for the next record, the deadline, an incomplete escape
+		// sequence or a wakeup
+		long wait = deadline;
+		if (due > 0 && (wait < 0 || now_ms() + (due + 999) / 1000 < wait))
+			wait = now_ms() + (due + 999) / 1000;
+		if (ctx->partial_since >= 0 && (wait < 0 || ctx->partial_since + ESC_SEQ_TIMEOUT_MS < wait))
+			wait = ctx->partial_since + ESC_SEQ_TIMEOUT_MS;
+		if (wait >= 0) {
+			wait -= now_ms();
+			if (wait < 0) wait = 0;
+		}
+		struct pollfd fd = {ctx->wakeup_fds[0], POLLIN, 0};
+		int result = poll(&fd, 1, wait >= 0 ? (int)wait : -1);
+		if (result < 0 && errno != EINTR)
+			return -1;
+		if (result > 0) {
+			char zzz[64];
+			while (read(ctx->wakeup_fds[0], zzz, sizeof(zzz)) > 0)
+				;
+			event->type = TB_EVENT_WAKEUP;
+			return TB_EVENT_WAKEUP;
+		}
+		if (result == 0 && deadline >= 0 && now_ms() >= deadline)
+			return extract_buffered_event(event) ? event->type : 0;
+	}
+}
 
+static int wait_fill_event(struct tb_event *event, struct timeval *timeout)
+{
+	// a replay stamps the events it reports, buffered ones too
+	if (ctx->replay)
+		return replay_wait_event(event, timeout ? now_ms() + timeout->tv_sec * 1000 + timeout->tv_usec / 1000 : -1);
 	// try to extract event from input buffer, return on success
-	event->type = TB_EVENT_KEY;
-	if (extract_event(event, &input_buffer, inputmode))
+	if (extract_buffered_event(event))
+		return event->type;
+	if (extract_session_event(event))
 		return event->type;
 
-	// it looks like input buffer is incomplete, let's try the short path,
-	// but first make sure there is enough space
-	int n = read_up_to(ENOUGH_DATA_FOR_PARSING);
+	// it looks like input buffer is incomplete, let's try the short path
+	int n = read_available();
 	if (n < 0)
 		return -1;
-	if (n > 0 && extract_event(event, &input_buffer, inputmode))
+	if (n > 0 && extract_buffered_event(event))
 		return event->type;
 
-	// n == 0, or not enough data, let's go to select
+	long deadline = -1;
+	if (timeout)
+		deadline = now_ms() + timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
+
+	// n == 0, or not enough data, let's go to poll. unlike select it
+	// doesn't care how many files the process has open
 	while (1) {
-		FD_ZERO(&events);
-		FD_SET(inout, &events);
-		FD_SET(winch_fds[0], &events);
-		int maxfd = (winch_fds[0] > inout) ? winch_fds[0] : inout;
-		int result = select(maxfd+1, &events, 0, 0, timeout);
-		if (!result)
+		// wake up early if an incomplete escape sequence is due
+		long wait = deadline;
+		bool esc_due = false;
+		if (ctx->partial_since >= 0 &&
+		    (wait < 0 || ctx->partial_since + ESC_SEQ_TIMEOUT_MS < wait)) {
+			wait = ctx->partial_since + ESC_SEQ_TIMEOUT_MS;
+			esc_due = true;
+		}
+		if (wait >= 0) {
+			wait -= now_ms();
+			if (wait < 0) wait = 0;
+		}
+
+		int nfds = 3 + (ctx->session ? ctx->session->clients_len + 1 : 0);
+		if (nfds > ctx->pollfds_cap) {
+			ctx->pollfds_cap = nfds * 2;
+			ctx->pollfds = static_cast<struct pollfd*>(
+				realloc(ctx->pollfds, sizeof(struct pollfd) * ctx->pollfds_cap));
+		}
+		struct pollfd *fds = ctx->pollfds;
+		fds[0] = {ctx->inout, POLLIN, 0};
+		fds[1] = {ctx->winch_fds[0], POLLIN, 0};
+		fds[2] = {ctx->wakeup_fds[0], POLLIN, 0};
+		if (ctx->session)
+			session_pollfds(ctx->session, fds + 3);
+		int result = poll(fds, nfds, wait >= 0 ? (int)wait : -1);
+		if (result < 0) {
+			// SIGWINCH lands here too, the pipe tells us about it
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (!result) {
+			if (esc_due) {
+				if (extract_buffered_event(event))
+					return event->type;
+				continue;
+			}
 			return 0;
+		}
 
-		if (FD_ISSET(inout, &events)) {
-			event->type = TB_EVENT_KEY;
-			n = read_up_to(ENOUGH_DATA_FOR_PARSING);
+		if (fds[0].revents) {
+			n = read_available();
 			if (n < 0)
 				return -1;
 
-			if (n == 0)
+			if (n == 0) {
+				// the other end is gone, nothing will ever come again
+				if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+					return -1;
 				continue;
+			}
 
-			if (extract_event(event, &input_buffer, inputmode))
+			if (extract_buffered_event(event))
 				return event->type;
 		}
-		if (FD_ISSET(winch_fds[0], &events)) {
+		if (fds[1].revents & POLLIN) {
 			event->type = TB_EVENT_RESIZE;
-			int zzz = 0;
-			read(winch_fds[0], &zzz, sizeof(int));
-			buffer_size_change_request = 1;
+			// coalesce every signal received so far into one event
+			// carrying the latest size
+			int zzz[64];
+			while (read(ctx->winch_fds[0], zzz, sizeof(zzz)) > 0)
+				;
+			ctx->buffer_size_change_request = 1;
 			get_term_size(&event->w, &event->h);
+			if (ctx->input_log) {
+				int32_t size[2] = {event->w, event->h};
+				inputlog_add(ctx->input_log, INPUTLOG_RESIZE, size, sizeof(size));
+			}
 			return TB_EVENT_RESIZE;
 		}
+		if (fds[2].revents & POLLIN) {
+			char zzz[64];
+			while (read(ctx->wakeup_fds[0], zzz, sizeof(zzz)) > 0)
+				;
+			event->type = TB_EVENT_WAKEUP;
+			return TB_EVENT_WAKEUP;
+		}
+		if (ctx->session) {
+			session_handle_poll(ctx->session, fds + 3, nfds - 3);
+			if (extract_session_event(event))
+				return event->type;
+		}
 	}
 }
@@ -104,9 +104,14 @@ extern "C" {
 /*
  * Alt modifier constant, see tb_event.mod field and tb_select_input_mode function.
  * Mouse-motion modifier
+ * Shift and Ctrl modifiers, only reported for mouse events and for keys the
+ * terminal sends as extended reports (xterm modified keys, modifyOtherKeys or
+ * CSI-u)
  */
 #define TB_MOD_ALT    0x01
 #define TB_MOD_MOTION 0x02
+#define TB_MOD_SHIFT  0x04
+#define TB_MOD_CTRL   0x08
 
 /* Colors (see struct tb_cell's fg and bg fields). */
 #define TB_DEFAULT 0x00
@@ -127,6 +132,26 @@ extern "C" {
 #define TB_BOLD      0x0100
 #define TB_UNDERLINE 0x0200
 #define TB_REVERSE   0x0400
+/* tb_style() only */
+#define TB_ITALIC    0x0800
+#define TB_STRIKE    0x1000
+
+/* Styles, 24-bit colors and attributes that don't fit in a cell. tb_style()
+ * returns the 'fg' of a cell in that style (TB_STYLE and the style's id, a
+ * cell's 'bg' is ignored then), the same one for the same arguments: styles
+ * are shared by all the contexts and are never freed. 'fg' and 'bg' are
+ * 0xRRGGBB or TB_RGB_DEFAULT, 'attrs' any of TB_BOLD, TB_UNDERLINE,
+ * TB_REVERSE, TB_ITALIC and TB_STRIKE. The colors are sent as they are in
+ * TB_OUTPUT_TRUECOLOR and as the nearest ones in the other output modes.
+ * Returns TB_DEFAULT once 32767 styles have been made.
+ *
+ * tb_style_info() gets them back, returns -1 if 'style' isn't one.
+ */
+#define TB_STYLE       0x8000
+#define TB_RGB_DEFAULT 0xFF000000
+
+SO_IMPORT uint16_t tb_style(uint32_t fg, uint32_t bg, uint16_t attrs);
+SO_IMPORT int tb_style_info(uint16_t style, uint32_t *fg, uint32_t *bg, uint16_t *attrs);
 
 /* A cell, single conceptual entity on the terminal screen. The terminal screen
  * is basically a 2d array of cells. It has the following fields:
@@ -143,13 +168,15 @@ struct tb_cell {
 #define TB_EVENT_KEY    1
 #define TB_EVENT_RESIZE 2
 #define TB_EVENT_MOUSE  3
+#define TB_EVENT_WAKEUP 4
 
 /* An event, single interaction from the user. The 'mod' and 'ch' fields are
- * valid if 'type' is TB_EVENT_KEY. The 'w' and 'h' fields are valid if 'type'
+ * valid if 'type' is TB_EVENT_KEY, 'mod' is valid for TB_EVENT_MOUSE too. The 'w' and 'h' fields are valid if 'type'
  * is TB_EVENT_RESIZE. The 'x' and 'y' fields are valid if 'type' is
  * TB_EVENT_MOUSE. The 'key' field is valid if 'type' is either TB_EVENT_KEY
  * or TB_EVENT_MOUSE. The fields 'key' and 'ch' are mutually exclusive; only
- * one of them can be non-zero at a time.
+ * one of them can be non-zero at a time. All the resizes that happened since
+ * the last TB_EVENT_RESIZE are reported as one event with the latest size.
  */
 struct tb_event {
 	uint8_t type;
@@ -181,6 +208,30 @@ SO_IMPORT int tb_init_file(const char* name);
 SO_IMPORT int tb_init_fd(int inout);
 SO_IMPORT void tb_shutdown(void);
 
+/* Initializes a context without a terminal, of the given size. What it
+ * presents only goes to the viewers attached to it (see tb_listen()), and
+ * the size changes to that of the last viewer that resized.
+ */
+SO_IMPORT int tb_init_headless(int w, int h);
+
+/* All the state of a terminal lives in a context, and all the functions here
+ * work with the current context of the calling thread. Until another one is
+ * selected that's the default context, so a program driving a single terminal
+ * never has to care. One context may only be used by one thread at a time.
+ *
+ * tb_context_free() takes a context that isn't initialized (never was or has
+ * been shut down). tb_select_context() makes 'ctx' current (NULL selects the
+ * default one) and returns the previously current context.
+ *
+ * Terminal capabilities are shared by all the contexts, they are looked up
+ * once for the TERM of the process.
+ */
+struct tb_context;
+SO_IMPORT struct tb_context *tb_context_new(void);
+SO_IMPORT void tb_context_free(struct tb_context *ctx);
+SO_IMPORT struct tb_context *tb_select_context(struct tb_context *ctx);
+SO_IMPORT struct tb_context *tb_current_context(void);
+
 /* Returns the size of the internal back buffer (which is the same as
  * terminal's window size in characters). The internal buffer can be resized
  * after tb_clear() or tb_present() function calls. Both dimensions have an
@@ -199,6 +250,31 @@ SO_IMPORT void tb_set_clear_attributes(uint16_t fg, uint16_t bg);
 /* Synchronizes the internal back buffer with the terminal. */
 SO_IMPORT void tb_present(void);
 
+/* Scrolls the content of the given area of the back buffer up by 'dy' rows
+ * (down if negative), the rows exposed are cleared like tb_clear() does.
+ * When the area spans whole rows, the terminal is told to scroll them too, so
+ * that the next tb_present() only sends the exposed rows.
+ */
+SO_IMPORT void tb_scroll(int x, int y, int w, int h, int dy);
+
+/* Moves all the writes to the terminal to a thread of their own, so that
+ * tb_present() and friends never block on a slow terminal. A frame the
+ * thread hasn't started writing when the next one is presented is dropped in
+ * favor of the new one. Returns 0 on success. tb_stop_writer() (or
+ * tb_shutdown()) waits for everything handed off so far to be written.
+ */
+SO_IMPORT int tb_start_writer(void);
+SO_IMPORT void tb_stop_writer(void);
+
+/* Number of frames dropped by the writer thread in favor of newer ones. */
+SO_IMPORT unsigned long tb_superseded_frames(void);
+
+/* Number of bytes presented but not consumed by the terminal yet: the ones
+ * still waiting for the writer thread plus the tty's output queue. Non-zero
+ * long after a present means the terminal can't keep up.
+ */
+SO_IMPORT int tb_output_pending(void);
+
 #define TB_HIDE_CURSOR -1
 
 /* Sets the position of the cursor. Upper-left character is (0, 0). If you pass
@@ -213,6 +289,22 @@ SO_IMPORT void tb_set_cursor(int cx, int cy);
 SO_IMPORT void tb_put_cell(int x, int y, const struct tb_cell *cell);
 SO_IMPORT void tb_change_cell(int x, int y, uint32_t ch, uint16_t fg, uint16_t bg);
 
+/* Grapheme clusters, what shows as one character but is made of several
+ * codepoints: combining marks, emoji sequences, flags. tb_change_cluster()
+ * puts the cluster in the 'len' bytes of UTF-8 at 'utf8' in a cell, a single
+ * codepoint goes in it as with tb_change_cell(). Returns the number of
+ * columns it takes.
+ *
+ * The cell's 'ch' is then TB_CLUSTER and where the cluster is kept, until
+ * the next tb_clear(): tb_cell_cluster() gets the UTF-8 back, it returns
+ * NULL if 'ch' isn't a cluster. Such a 'ch' is only good for the context
+ * it was made in.
+ */
+#define TB_CLUSTER 0x80000000
+
+SO_IMPORT int tb_change_cluster(int x, int y, const char *utf8, int len, uint16_t fg, uint16_t bg);
+SO_IMPORT const char *tb_cell_cluster(uint32_t ch, int *len);
+
 /* Copies the buffer from 'cells' at the specified position, assuming the
  * buffer is a two-dimensional array of size ('w' x 'h'), represented as a
  * one-dimensional buffer containing lines of cells starting from the top.
@@ -225,6 +317,11 @@ SO_IMPORT void tb_blit(int x, int y, int w, int h, const struct tb_cell *cells);
  * using tb_width() and tb_height() functions. The pointer stays valid as long
  * as no tb_clear() and tb_present() calls are made. The buffer is
  * one-dimensional buffer containing lines of cells starting from the top.
+ *
+ * The back buffer's lines are padded internally, so this is a copy of it
+ * that is written back on the next tb_present(), or before tb_blit() and
+ * tb_scroll(). tb_put_cell() and friends keep updating it. NULL if there's
+ * no memory for it.
  */
 SO_IMPORT struct tb_cell *tb_cell_buffer(void);
 
@@ -232,6 +329,7 @@ SO_IMPORT struct tb_cell *tb_cell_buffer(void);
 #define TB_INPUT_ESC     1 /* 001 */
 #define TB_INPUT_ALT     2 /* 010 */
 #define TB_INPUT_MOUSE   4 /* 100 */
+#define TB_INPUT_MOTION  8 /* 1000 */
 
 /* Sets the termbox input mode. Termbox has two input modes:
  * 1. Esc input mode.
@@ -247,6 +345,17 @@ SO_IMPORT struct tb_cell *tb_cell_buffer(void);
  * reason you've decided to use (TB_INPUT_ESC | TB_INPUT_ALT) combination, it
  * will behave as if only TB_INPUT_ESC was selected.
  *
+ * Mouse events are reported for button presses, releases and drags. Add
+ * TB_INPUT_MOTION as well to also receive plain motion events (the key is
+ * TB_KEY_MOUSE_RELEASE with TB_MOD_MOTION set), which terminals only send in
+ * any-event tracking mode. Coordinates are decoded from the SGR (1006)
+ * extended encoding when the terminal supports it, so they are not limited
+ * to 223 columns.
+ *
+ * An escape sequence split across reads is kept until the rest of it arrives
+ * (for at most a few dozen milliseconds) instead of being reported as ESC
+ * followed by garbage.
+ *
  * If 'mode' is TB_INPUT_CURRENT, it returns the current input mode.
  *
  * Default termbox input mode is TB_INPUT_ESC.
@@ -258,6 +367,7 @@ SO_IMPORT int tb_select_input_mode(int mode);
 #define TB_OUTPUT_256       2
 #define TB_OUTPUT_216       3
 #define TB_OUTPUT_GRAYSCALE 4
+#define TB_OUTPUT_TRUECOLOR 5
 
 /* Sets the termbox output mode. Termbox has three output options:
  * 1. TB_OUTPUT_NORMAL     => [1..8]
@@ -288,6 +398,10 @@ SO_IMPORT int tb_select_input_mode(int mode);
  *    This mode supports the 4th range of the 256 mode only.
  *    But you dont need to provide an offset.
  *
+ * 4. TB_OUTPUT_TRUECOLOR  => [0..256]
+ *    As TB_OUTPUT_256, and the colors of tb_style() are sent as they are
+ *    instead of as the nearest of the 256.
+ *
  * Execute build/src/demo/output to see its impact on your terminal.
  *
  * If 'mode' is TB_OUTPUT_CURRENT, it returns the current output mode.
@@ -309,11 +423,118 @@ SO_IMPORT int tb_peek_event(struct tb_event *event, int timeout);
  */
 SO_IMPORT int tb_poll_event(struct tb_event *event);
 
+/* Returns non-zero if an event is waiting to be read, without blocking or
+ * consuming it. Lets long running work give way to the user's input.
+ */
+SO_IMPORT int tb_input_pending(void);
+
+/* Makes a pending or the next tb_peek_event()/tb_poll_event() call return
+ * TB_EVENT_WAKEUP. Safe to call from other threads (and signal handlers) while
+ * termbox is initialized, several calls before the event is read are reported
+ * as one event.
+ */
+SO_IMPORT void tb_interrupt(void);
+SO_IMPORT void tb_interrupt_context(struct tb_context *ctx);
+
+/* Makes 'ctx' report a TB_EVENT_RESIZE with the current size of its tty.
+ * SIGWINCH is only delivered for the controlling terminal, this is how the
+ * others (say the pty of a remote client) learn about resizes. Safe to call
+ * from other threads while 'ctx' is initialized.
+ */
+SO_IMPORT void tb_notify_resize(struct tb_context *ctx);
+
+/* For event loops of their own: the files tb_peek_event() waits on, the tty
+ * first. Once one of them is readable, tb_peek_event() with a zero timeout
+ * has something to do. tb_input_timeout() is how many milliseconds are left
+ * before buffered input (an incomplete escape sequence) has to be looked at
+ * again even if nothing more arrives, -1 if there is no such input.
+ */
+SO_IMPORT void tb_event_fds(int fds[3]);
+SO_IMPORT int tb_input_timeout(void);
+
+/* Detachable sessions. tb_listen() makes the current context accept viewers
+ * on the unix socket 'path' (a stale socket left there is replaced). Every
+ * tb_present() sends them the cells that changed, and tb_peek_event() /
+ * tb_poll_event() report the keys, mouse and resize events they send back
+ * along with the tty's own. A viewer that attaches or falls behind gets the
+ * whole screen. Only the user owning the process may connect (the socket
+ * is made 0600), and viewers sending anything but well-formed key, mouse
+ * and resize events are dropped. Sizes are capped at 1024x1024. The socket
+ * is removed by tb_shutdown(). Returns 0 or a negative errno.
+ *
+ * tb_attach() is the viewer: it shows the session served on 'path' in the
+ * current context, which must be initialized, and forwards its input until
+ * the server goes away (returns 0) or Ctrl-\ detaches (returns 0 too, the
+ * server keeps running). Returns a negative value on errors.
+ */
+SO_IMPORT int tb_listen(const char *path);
+SO_IMPORT int tb_attach(const char *path);
+
+/* Records what the current context presents, for playing it back later:
+ * the cells each tb_present() changed, with the time, appended to the file
+ * at 'path'. A keyframe with the whole screen is written at least every
+ * 'keyframe_interval_ms' (30s if 0), frames that change nothing are left
+ * out, and writes are batched (at most 64KB or a second's worth of frames
+ * are lost if the process dies). Flags:
+ *
+ * TB_RECORD_COMPRESS => spans are stored as runs of identical cells.
+ *
+ * Returns 0 or a negative errno. tb_stop_recording() (or tb_shutdown())
+ * writes what's left and closes the file.
+ *
+ * tb_export_asciicast() turns a recording into an asciicast v2 file, made
+ * of the output termbox would have sent a terminal for it. Returns 0 or a
+ * negative errno (-EINVAL if 'recording' isn't one).
+ */
+#define TB_RECORD_COMPRESS 1
+
+SO_IMPORT int tb_record(const char *path, int keyframe_interval_ms, int flags);
+SO_IMPORT void tb_stop_recording(void);
+SO_IMPORT int tb_export_asciicast(const char *recording, const char *path);
+
+/* tb_capture_input() logs the input of the current context to the file at
+ * 'path' as it's read, the raw bytes and the resizes, with the time.
+ * tb_stop_input_capture() (or tb_shutdown()) writes what's left and closes
+ * it. Returns 0 or a negative errno.
+ *
+ * tb_replay_input() makes such a log the input of the current context in
+ * place of its terminal: tb_peek_event() and tb_poll_event() report what
+ * was captured at the pace it was captured, or with TB_REPLAY_MAX_SPEED as
+ * soon as what came before it has been presented. Once the whole log has
+ * been presented they return -1, as if the terminal was gone. Returns 0 or
+ * a negative errno (-EINVAL if 'path' isn't a log).
+ *
+ * tb_get_replay_stats() tells how long the events of the log took from
+ * being handed out to the end of the tb_present() after them, returns -1 if
+ * there is no replay. An event is handed out with the record completing it,
+ * a record read in one go may hold several. A log ends at the first record
+ * cut short or claiming more bytes than the file has left.
+ */
+#define TB_REPLAY_MAX_SPEED 1
+
+struct tb_replay_stats {
+	uint32_t events;
+	int64_t p50_us;
+	int64_t p90_us;
+	int64_t p99_us;
+	int64_t max_us;
+};
+
+SO_IMPORT int tb_capture_input(const char *path);
+SO_IMPORT void tb_stop_input_capture(void);
+SO_IMPORT int tb_replay_input(const char *path, int flags);
+SO_IMPORT int tb_get_replay_stats(struct tb_replay_stats *stats);
+
 /* Utility utf8 functions. */
 #define TB_EOF -1
 SO_IMPORT int tb_utf8_char_length(char c);
 SO_IMPORT int tb_utf8_char_to_unicode(uint32_t *out, const char *c);
 SO_IMPORT int tb_utf8_unicode_to_char(char *out, uint32_t c);
+/* the length of the grapheme cluster starting 's', at most 'len': a
+ * codepoint and the combining marks, variation selectors, emoji modifiers
+ * and zero width joined codepoints following it, or a pair of regional
+ * indicators (a flag). 'width' gets the columns it takes if not NULL */
+SO_IMPORT int tb_utf8_cluster_length(const char *s, int len, int *width);
 
 #ifdef __cplusplus
 }
@@ -1,3 +1,4 @@
+#include <wchar.h>
 #include "termbox.h"
 
 static const unsigned char utf8_length[256] = {
@@ -77,3 +78,74 @@ int tb_utf8_unicode_to_char(char *out, uint32_t c)
 
 	return len;
 }
+
+/* like tb_utf8_char_to_unicode(), without going past 'len'. a sequence cut
+ * short is taken as one byte */
+static int utf8_decode(uint32_t *out, const char *s, int len)
+{
+	int i, n = tb_utf8_char_length(*s);
+	if (n > len) {
+		*out = (unsigned char)*s;
+		return 1;
+	}
+	uint32_t result = s[0] & utf8_mask[n-1];
+	for (i = 1; i < n; ++i)
+		result = (result << 6) | (s[i] & 0x3f);
+	*out = result;
+	return n;
+}
+
+static int is_regional_indicator(uint32_t c)
+{
+	return c >= 0x1F1E6 && c <= 0x1F1FF;
+}
+
+/* what attaches to the codepoint before it, the common ones at least */
+static int is_extend(uint32_t c)
+{
+	return (c >= 0x0300 && c <= 0x036F) || (c >= 0x1AB0 && c <= 0x1AFF) ||
+		(c >= 0x1DC0 && c <= 0x1DFF) || (c >= 0x20D0 && c <= 0x20FF) ||
+		(c >= 0xFE00 && c <= 0xFE0F) || (c >= 0xFE20 && c <= 0xFE2F) ||
+		(c >= 0x1F3FB && c <= 0x1F3FF) || (c >= 0xE0020 && c <= 0xE007F) ||
+		(c >= 0xE0100 && c <= 0xE01EF) || c == 0x200C ||
+		(c > 0x7F && c != 0x200D && wcwidth(c) == 0);
+}
+
+int tb_utf8_cluster_length(const char *s, int len, int *width)
+{
+	uint32_t c, next;
+	if (len <= 0) {
+		if (width) *width = 0;
+		return 0;
+	}
+	int n = utf8_decode(&c, s, len);
+	int w = wcwidth(c);
+	if (w < 1) w = 1;
+	/* shown as emoji, two columns whatever the first codepoint says */
+	int emoji = 0;
+
+	if (is_regional_indicator(c) && n < len) {
+		int m = utf8_decode(&next, s + n, len - n);
+		if (is_regional_indicator(next)) {
+			n += m;
+			emoji = 1;
+		}
+	}
+	while (n < len) {
+		int m = utf8_decode(&next, s + n, len - n);
+		if (next == 0x200D && n + m < len) {
+			/* the joiner and whatever it joins */
+			n += m;
+			n += utf8_decode(&next, s + n, len - n);
+			emoji = 1;
+		} else if (is_extend(next)) {
+			n += m;
+			if (next == 0xFE0F || (next >= 0x1F3FB && next <= 0x1F3FF))
+				emoji = 1;
+		} else {
+			break;
+		}
+	}
+	if (width) *width = emoji ? 2 : w;
+	return n;
+}
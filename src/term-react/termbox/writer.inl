@@ -0,0 +1,157 @@
+/* an optional thread doing all the writes to the terminal, so that a slow
+ * terminal never blocks the caller. output is appended to 'pending' and the
+ * thread swaps it with 'writing' whenever it's done with the previous batch.
+ * a frame still waiting in 'pending' when the next one is presented is taken
+ * back and replaced by it. */
+struct writer {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int fd;
+	int running;
+	/* guarded by lock */
+	struct bytebuffer pending;
+	int stopping;
+	/* where the last frame starts in 'pending', -1 if it has been taken
+	 * or other output came after it */
+	int frame_start;
+	unsigned long superseded;
+	/* size of the batch being written */
+	int in_flight;
+	/* only touched by the thread */
+	struct bytebuffer writing;
+};
+
+static void write_all(int fd, const char *buf, int len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				struct pollfd pfd = {fd, POLLOUT, 0};
+				poll(&pfd, 1, -1);
+				continue;
+			}
+			return;
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static void *writer_main(void *arg)
+{
+	struct writer *w = static_cast<struct writer*>(arg);
+	pthread_mutex_lock(&w->lock);
+	while (1) {
+		while (w->pending.len == 0 && !w->stopping)
+			pthread_cond_wait(&w->wake, &w->lock);
+		if (w->pending.len == 0)
+			break;
+
+		struct bytebuffer tmp = w->pending;
+		w->pending = w->writing;
+		w->writing = tmp;
+		w->frame_start = -1;
+		w->in_flight = w->writing.len;
+		pthread_mutex_unlock(&w->lock);
+
+		write_all(w->fd, w->writing.buf, w->writing.len);
+		bytebuffer_clear(&w->writing);
+
+		pthread_mutex_lock(&w->lock);
+		w->in_flight = 0;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+static int writer_start(struct writer *w, int fd)
+{
+	w->fd = fd;
+	w->stopping = 0;
+	w->frame_start = -1;
+	w->superseded = 0;
+	w->in_flight = 0;
+	bytebuffer_init(&w->pending, 32 * 1024);
+	bytebuffer_init(&w->writing, 32 * 1024);
+	pthread_mutex_init(&w->lock, 0);
+	pthread_cond_init(&w->wake, 0);
+	if (pthread_create(&w->thread, 0, writer_main, w) != 0) {
+		pthread_cond_destroy(&w->wake);
+		pthread_mutex_destroy(&w->lock);
+		bytebuffer_free(&w->pending);
+		bytebuffer_free(&w->writing);
+		return -1;
+	}
+	w->running = 1;
+	return 0;
+}
+
+/* writes everything handed off so far before returning */
+static void writer_stop(struct writer *w)
+{
+	if (!w->running)
+		return;
+	pthread_mutex_lock(&w->lock);
+	w->stopping = 1;
+	pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, 0);
+	w->running = 0;
+
+	pthread_cond_destroy(&w->wake);
+	pthread_mutex_destroy(&w->lock);
+	bytebuffer_free(&w->pending);
+	bytebuffer_free(&w->writing);
+}
+
+/* hand off (and clear) 'b', 'frame' tells whether it may be superseded */
+static void writer_append(struct writer *w, struct bytebuffer *b, bool frame)
+{
+	pthread_mutex_lock(&w->lock);
+	w->frame_start = frame ? w->pending.len : -1;
+	bytebuffer_append(&w->pending, b->buf, b->len);
+	pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+	bytebuffer_clear(b);
+}
+
+/* drop the last frame if the thread hasn't taken it yet, returns whether it
+ * did. the terminal is then left as it was before that frame */
+static bool writer_take_back_frame(struct writer *w)
+{
+	bool taken_back = false;
+	pthread_mutex_lock(&w->lock);
+	if (w->frame_start >= 0) {
+		w->pending.len = w->frame_start;
+		w->frame_start = -1;
+		w->superseded++;
+		taken_back = true;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return taken_back;
+}
+
+static unsigned long writer_superseded(struct writer *w)
+{
+	if (!w->running)
+		return w->superseded;
+	pthread_mutex_lock(&w->lock);
+	unsigned long n = w->superseded;
+	pthread_mutex_unlock(&w->lock);
+	return n;
+}
+
+/* bytes handed off and not written yet */
+static int writer_unwritten(struct writer *w)
+{
+	if (!w->running)
+		return 0;
+	pthread_mutex_lock(&w->lock);
+	int n = w->pending.len + w->in_flight;
+	pthread_mutex_unlock(&w->lock);
+	return n;
+}
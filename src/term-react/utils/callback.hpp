@@ -0,0 +1,103 @@
+#pragma once
+#include <cstring>
+#include <typeinfo>
+#include <functional>
+#include <type_traits>
+
+// whether F has no padding, so that equal bytes mean equal values. it's what c++17's
+// std::has_unique_object_representations is made of, without it no bytes are compared
+#if defined(__has_builtin)
+#if __has_builtin(__has_unique_object_representations)
+#define CALLBACK_UNIQUE_REPRESENTATION_(F) __has_unique_object_representations(F)
+#endif
+#endif
+#ifndef CALLBACK_UNIQUE_REPRESENTATION_
+#define CALLBACK_UNIQUE_REPRESENTATION_(F) false
+#endif
+
+namespace termreact {
+
+// a std::function that can be compared, so that passing "the same" handler
+// again doesn't make props look changed.
+// two callbacks are equal when they wrap callables of the same type with the same
+// bytes, which only holds for trivially copyable callables without padding small
+// enough to be remembered: lambdas capturing nothing, `this` or plain values by copy,
+// function pointers, and member callbacks created by memberCallback(). anything
+// else never equals another callback, same as a std::function
+template <typename Sig> class Callback;
+
+template <typename R, typename... Args>
+class Callback<R(Args...)> {
+private:
+  static constexpr std::size_t identity_size_ = 4 * sizeof(void*);
+
+  std::function<R(Args...)> fn_;
+  const std::type_info *type_ = nullptr;
+  std::size_t size_ = 0;
+  alignas(void*) unsigned char identity_[identity_size_];
+
+  template <typename F>
+  void remember_(const F& f, std::true_type) {
+    type_ = &typeid(F);
+    if (std::is_empty<F>::value) return;
+    size_ = sizeof(F);
+    std::memcpy(identity_, &f, sizeof(F));
+  }
+
+  template <typename F>
+  void remember_(const F&, std::false_type) {}
+
+public:
+  Callback() {}
+  Callback(std::nullptr_t) {}
+
+  template <typename F, typename = std::enable_if_t<
+    !std::is_same<std::decay_t<F>, Callback>::value &&
+    std::is_convertible<F, std::function<R(Args...)>>::value
+  >>
+  Callback(F&& f) {
+    using Fn = std::decay_t<F>;
+    // an empty one has a byte that means nothing, any two of them are the same
+    remember_<Fn>(f, std::integral_constant<bool,
+      std::is_trivially_copyable<Fn>::value && sizeof(Fn) <= identity_size_ &&
+      (std::is_empty<Fn>::value || CALLBACK_UNIQUE_REPRESENTATION_(Fn)) &&
+      !std::is_same<Fn, std::function<R(Args...)>>::value>{});
+    fn_ = std::forward<F>(f);
+  }
+
+  R operator()(Args... args) const {
+    return fn_(std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const { return static_cast<bool>(fn_); }
+
+  bool operator==(const Callback& other) const {
+    if (!fn_ || !other.fn_) return !fn_ && !other.fn_;
+    return type_ && other.type_ && *type_ == *other.type_ &&
+      std::memcmp(identity_, other.identity_, size_) == 0;
+  }
+  bool operator!=(const Callback& other) const { return !(*this == other); }
+};
+
+namespace details {
+
+template <typename T, typename M>
+struct MemberCallback {
+  T *obj;
+  M method;
+
+  template <typename... Args>
+  decltype(auto) operator()(Args&&... args) const {
+    return (obj->*method)(std::forward<Args>(args)...);
+  }
+};
+
+}
+
+// a callback calling obj->method(...), equal to any other one made from the same pair
+template <typename T, typename M>
+details::MemberCallback<T, M> memberCallback(T *obj, M method) {
+  return details::MemberCallback<T, M>{obj, method};
+}
+
+}
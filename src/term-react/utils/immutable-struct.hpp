@@ -150,6 +150,17 @@ struct TrivalConstruction_t {};
       constexpr std::size_t I = static_cast<std::size_t>(F); \
       return std::get<I>(*pt_); \
     } \
+    /* mutable access to a field, copying the tuple first if it's shared with other structs, */ \
+    /* a copy of the struct taken before included. it's only changed in place once the struct */ \
+    /* is its sole owner. the struct counts as changed afterwards even if the field is left as it was */ \
+    template <Field F> \
+    std::tuple_element_t<static_cast<std::size_t>(F), Tuple>& mutate() { \
+      constexpr std::size_t I = static_cast<std::size_t>(F); \
+      if (!pt_.unique()) { \
+        pt_ = std::make_shared<Tuple>(*pt_); \
+      } \
+      return std::get<I>(*pt_); \
+    } \
     bool operator == (const class_name& other) const { \
       return other.pt_ == pt_; \
     } \
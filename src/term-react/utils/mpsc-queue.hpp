@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+namespace termreact {
+namespace details {
+
+// unbounded lock-free queue, any thread may push but only one thread may pop.
+// a push is a single atomic exchange, so producers never wait for each other or the consumer.
+// pop() may miss an element whose push is still in progress, it is seen by the next pop()
+template <typename T>
+class MpscQueue {
+private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    T value;
+
+    Node() : value{} {}
+    explicit Node(T v) : value{std::move(v)} {}
+  };
+
+  // the last pushed node, shared by producers
+  std::atomic<Node*> head_;
+  // a stub whose next is the oldest element, only touched by the consumer
+  Node *tail_;
+
+public:
+  MpscQueue() : head_{new Node{}}, tail_{head_.load(std::memory_order_relaxed)} {}
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  ~MpscQueue() {
+    while (tail_) {
+      Node *next = tail_->next.load(std::memory_order_relaxed);
+      delete tail_;
+      tail_ = next;
+    }
+  }
+
+  void push(T value) {
+    Node *node = new Node{std::move(value)};
+    Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  bool pop(T &value) {
+    Node *next = tail_->next.load(std::memory_order_acquire);
+    if (!next) return false;
+    value = std::move(next->value);
+    delete tail_;
+    // next becomes the stub
+    tail_ = next;
+    return true;
+  }
+
+  bool empty() const {
+    return !tail_->next.load(std::memory_order_acquire);
+  }
+};
+
+}
+}
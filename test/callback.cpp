@@ -0,0 +1,87 @@
+#include "gtest/gtest.h"
+#include <string>
+#include "../src/term-react/utils/callback.hpp"
+
+using namespace termreact;
+
+struct Counter {
+  int count = 0;
+  void add(int n) { count += n; }
+  void sub(int n) { count -= n; }
+};
+
+static int twice(int n) { return n * 2; }
+static int thrice(int n) { return n * 3; }
+
+TEST(CallbackTest, empty) {
+  Callback<void()> a, b{nullptr};
+  EXPECT_FALSE(a);
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, Callback<void()>{[] () {}});
+}
+
+TEST(CallbackTest, same_lambda_same_captures) {
+  Counter c, d;
+  auto make = [] (Counter *p) { return Callback<void(int)>{[p] (int n) { p->add(n); }}; };
+  auto a = make(&c);
+  EXPECT_EQ(a, make(&c));
+  EXPECT_NE(a, make(&d));
+  a(3);
+  EXPECT_EQ(c.count, 3);
+}
+
+TEST(CallbackTest, captured_values) {
+  auto make = [] (int k) { return Callback<int()>{[k] () { return k; }}; };
+  EXPECT_EQ(make(1), make(1));
+  EXPECT_NE(make(1), make(2));
+  EXPECT_EQ(make(2)(), 2);
+}
+
+TEST(CallbackTest, different_lambdas) {
+  Callback<int()> a{[] () { return 1; }};
+  Callback<int()> b{[] () { return 1; }};
+  EXPECT_EQ(a, a);
+  EXPECT_NE(a, b);
+}
+
+TEST(CallbackTest, function_pointers) {
+  Callback<int(int)> a{twice}, b{&twice}, c{thrice};
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(c(2), 6);
+}
+
+TEST(CallbackTest, member_callbacks) {
+  Counter c, d;
+  Callback<void(int)> add{memberCallback(&c, &Counter::add)};
+  EXPECT_EQ(add, Callback<void(int)>{memberCallback(&c, &Counter::add)});
+  EXPECT_NE(add, Callback<void(int)>{memberCallback(&c, &Counter::sub)});
+  EXPECT_NE(add, Callback<void(int)>{memberCallback(&d, &Counter::add)});
+  add(5);
+  EXPECT_EQ(c.count, 5);
+}
+
+TEST(CallbackTest, non_trivial_captures_never_equal) {
+  std::string s = "abc";
+  auto make = [&s] () { return Callback<std::string()>{[s] () { return s; }}; };
+  auto a = make();
+  EXPECT_NE(a, make());
+  EXPECT_EQ(a(), "abc");
+
+  // padding or references, the same bytes needn't be the same callable
+  auto padded = [] (char c, int n) { return Callback<int()>{[c, n] () { return c + n; }}; };
+  EXPECT_NE(padded('a', 1), padded('a', 1));
+  Counter c;
+  auto by_reference = [&c] () { return Callback<void(int)>{[&c] (int n) { c.add(n); }}; };
+  EXPECT_NE(by_reference(), by_reference());
+
+  std::function<int(int)> f = twice;
+  EXPECT_NE(Callback<int(int)>{f}, Callback<int(int)>{f});
+}
+
+TEST(CallbackTest, copies_are_equal) {
+  Counter c;
+  Callback<void(int)> a{[p = &c] (int n) { p->add(n); }};
+  auto b = a;
+  EXPECT_EQ(a, b);
+}
@@ -0,0 +1,145 @@
+#include "gtest/gtest.h"
+#include <string>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/term-react/termbox/termbox.h"
+#include "../src/term-react/termbox/cellbuf.inl"
+#include "pty.hpp"
+
+static bool same(const tb_cell &a, const tb_cell &b) {
+  return memcmp(&a, &b, sizeof(tb_cell)) == 0;
+}
+
+class CellbufTest : public ::testing::Test {
+protected:
+  cellbuf buf;
+  const tb_cell blank{' ', 0, 0};
+  const tb_cell exposed{'x', 1, 1};
+
+  void SetUp() override {
+    buf.init(10, 4);
+    buf.fill(0, 0, 10, 4, blank);
+  }
+
+  void TearDown() override {
+    buf.free_cells();
+  }
+};
+
+TEST_F(CellbufTest, aligned_rows) {
+  EXPECT_GE(buf.stride, 10);
+  EXPECT_GE(buf.cap_height, 4);
+  EXPECT_EQ(buf.stride * sizeof(tb_cell) % CELLBUF_ALIGN, 0u);
+  for (int y = 0; y < buf.height; y++) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(buf.row(y)) % CELLBUF_ALIGN, 0u);
+  }
+}
+
+TEST_F(CellbufTest, grow_within_capacity_in_place) {
+  buf.at(3, 2) = tb_cell{'a', 2, 3};
+  auto cells = buf.cells;
+  int w = buf.stride, h = buf.cap_height;
+
+  buf.resize(w, h, exposed);
+  EXPECT_EQ(buf.cells, cells);
+  EXPECT_TRUE(same(buf.at(3, 2), tb_cell{'a', 2, 3}));
+  EXPECT_TRUE(same(buf.at(9, 3), blank));
+  EXPECT_TRUE(same(buf.at(10, 0), exposed));
+  EXPECT_TRUE(same(buf.at(w - 1, 3), exposed));
+  EXPECT_TRUE(same(buf.at(0, 4), exposed));
+  EXPECT_TRUE(same(buf.at(w - 1, h - 1), exposed));
+}
+
+TEST_F(CellbufTest, shrink_then_grow_refills_exposed) {
+  buf.at(8, 3) = tb_cell{'a', 2, 3};
+  buf.resize(5, 2, exposed);
+  EXPECT_EQ(buf.width, 5);
+  EXPECT_EQ(buf.height, 2);
+  buf.resize(10, 4, exposed);
+  // cells hidden by shrinking are not resurrected
+  EXPECT_TRUE(same(buf.at(8, 3), exposed));
+  EXPECT_TRUE(same(buf.at(4, 1), blank));
+  EXPECT_TRUE(same(buf.at(5, 1), exposed));
+}
+
+TEST_F(CellbufTest, grow_past_capacity_keeps_content) {
+  buf.at(9, 3) = tb_cell{'a', 2, 3};
+  int w = buf.stride + 1, h = buf.cap_height + 1;
+  buf.resize(w, h, exposed);
+  EXPECT_GE(buf.stride, w);
+  EXPECT_GE(buf.cap_height, h);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(buf.cells) % CELLBUF_ALIGN, 0u);
+  EXPECT_TRUE(same(buf.at(9, 3), tb_cell{'a', 2, 3}));
+  EXPECT_TRUE(same(buf.at(0, 0), blank));
+  EXPECT_TRUE(same(buf.at(10, 3), exposed));
+  EXPECT_TRUE(same(buf.at(w - 1, h - 1), exposed));
+}
+
+TEST_F(CellbufTest, copy_from) {
+  buf.at(9, 3) = tb_cell{'a', 2, 3};
+  cellbuf copy;
+  copy.init(2, 2);
+  copy.copy_from(buf);
+  EXPECT_EQ(copy.width, 10);
+  EXPECT_EQ(copy.height, 4);
+  EXPECT_TRUE(same(copy.at(9, 3), tb_cell{'a', 2, 3}));
+  EXPECT_TRUE(same(copy.at(0, 0), blank));
+
+  // fits, so the cells stay where they are
+  auto cells = copy.cells;
+  buf.at(9, 3) = blank;
+  copy.copy_from(buf);
+  EXPECT_EQ(copy.cells, cells);
+  EXPECT_TRUE(same(copy.at(9, 3), blank));
+  copy.free_cells();
+}
+
+TEST_F(CellbufTest, scroll_area) {
+  for (int y = 0; y < 4; y++) buf.at(2, y) = tb_cell{uint32_t('0' + y), 0, 0};
+  buf.at(0, 1) = tb_cell{'o', 0, 0};
+
+  buf.scroll(1, 0, 3, 4, 1, exposed);
+  EXPECT_TRUE(same(buf.at(2, 0), tb_cell{'1', 0, 0}));
+  EXPECT_TRUE(same(buf.at(2, 2), tb_cell{'3', 0, 0}));
+  EXPECT_TRUE(same(buf.at(2, 3), exposed));
+  // outside the area
+  EXPECT_TRUE(same(buf.at(0, 1), tb_cell{'o', 0, 0}));
+
+  buf.scroll(1, 0, 3, 4, -2, exposed);
+  EXPECT_TRUE(same(buf.at(2, 0), exposed));
+  EXPECT_TRUE(same(buf.at(2, 1), exposed));
+  EXPECT_TRUE(same(buf.at(2, 2), tb_cell{'1', 0, 0}));
+  EXPECT_TRUE(same(buf.at(2, 3), tb_cell{'2', 0, 0}));
+
+  buf.scroll(1, 0, 3, 4, 4, blank);
+  EXPECT_TRUE(same(buf.at(2, 2), blank));
+}
+
+// the back buffer's rows are padded, the one handed out isn't
+class CellBufferTest : public PtyContextTest {
+protected:
+  CellBufferTest() : PtyContextTest{13, 3} {}
+};
+
+TEST_F(CellBufferTest, rows_are_contiguous) {
+  tb_change_cell(12, 0, 'a', TB_DEFAULT, TB_DEFAULT);
+  tb_change_cell(0, 1, 'b', TB_DEFAULT, TB_DEFAULT);
+  tb_cell *cells = tb_cell_buffer();
+  ASSERT_NE(cells, nullptr);
+  EXPECT_EQ(cells[12].ch, 'a');
+  EXPECT_EQ(cells[13].ch, 'b');
+
+  // written both ways, and kept across a scroll
+  cells[2 * 13 + 12].ch = 'c';
+  tb_change_cell(1, 1, 'd', TB_DEFAULT, TB_DEFAULT);
+  EXPECT_EQ(cells[14].ch, 'd');
+  tb_scroll(0, 0, 13, 3, 1);
+  EXPECT_EQ(cells[0].ch, 'b');
+  EXPECT_EQ(cells[13 + 12].ch, 'c');
+  tb_present();
+  std::string out = drain();
+  EXPECT_NE(out.find('c'), std::string::npos);
+  EXPECT_NE(out.find("bd"), std::string::npos);
+}
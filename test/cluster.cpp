@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include <fstream>
+#include <string>
+#include "pty.hpp"
+
+// grapheme clusters and what they send a pty
+
+static const std::string e_acute = "e\xcc\x81";
+static const std::string flag = "\xf0\x9f\x87\xab\xf0\x9f\x87\xb7";
+static const std::string family = "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7";
+static const std::string thumbs_up = "\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd";
+
+class ClusterTest : public PtyContextTest {
+protected:
+  static int length(const std::string& s, int *width) {
+    return tb_utf8_cluster_length(s.data(), s.size(), width);
+  }
+};
+
+TEST_F(ClusterTest, cluster_boundaries) {
+  int width;
+  EXPECT_EQ(length("ab", &width), 1);
+  EXPECT_EQ(width, 1);
+  EXPECT_EQ(length(e_acute + "x", &width), 3);
+  EXPECT_EQ(width, 1);
+  EXPECT_EQ(length(flag + flag, &width), 8);
+  EXPECT_EQ(width, 2);
+  EXPECT_EQ(length(family + "x", &width), int(family.size()));
+  EXPECT_EQ(width, 2);
+  EXPECT_EQ(length(thumbs_up, &width), 8);
+  EXPECT_EQ(width, 2);
+  // cut short, the bytes there are taken one by one
+  EXPECT_EQ(length(flag.substr(0, 2), &width), 1);
+  EXPECT_EQ(length("", &width), 0);
+}
+
+TEST_F(ClusterTest, clusters_are_diffed_by_what_they_are) {
+  EXPECT_EQ(tb_change_cluster(0, 0, e_acute.data(), e_acute.size(), TB_DEFAULT, TB_DEFAULT), 1);
+  EXPECT_EQ(tb_change_cluster(1, 0, flag.data(), flag.size(), TB_DEFAULT, TB_DEFAULT), 2);
+  // a single codepoint stays in the cell
+  EXPECT_EQ(tb_change_cluster(3, 0, "z", 1, TB_DEFAULT, TB_DEFAULT), 1);
+  EXPECT_EQ(tb_cell_buffer()[3].ch, uint32_t('z'));
+  int len;
+  const char *data = tb_cell_cluster(tb_cell_buffer()[1].ch, &len);
+  ASSERT_NE(data, nullptr);
+  EXPECT_EQ(std::string(data, len), flag);
+  EXPECT_EQ(tb_cell_cluster('z', &len), nullptr);
+  tb_present();
+  std::string out = drain();
+  // the cursor is moved past the wide flag before the z
+  EXPECT_NE(out.find(e_acute + flag + "\033[1;4Hz"), std::string::npos);
+
+  // drawn again from scratch, nothing changed
+  tb_clear();
+  tb_change_cluster(0, 0, e_acute.data(), e_acute.size(), TB_DEFAULT, TB_DEFAULT);
+  tb_change_cluster(1, 0, flag.data(), flag.size(), TB_DEFAULT, TB_DEFAULT);
+  tb_change_cell(3, 0, 'z', TB_DEFAULT, TB_DEFAULT);
+  tb_present();
+  out = drain();
+  EXPECT_EQ(out.find(e_acute), std::string::npos);
+  EXPECT_EQ(out.find(flag), std::string::npos);
+
+  tb_change_cluster(0, 0, thumbs_up.data(), thumbs_up.size(), TB_DEFAULT, TB_DEFAULT);
+  tb_present();
+  out = drain();
+  EXPECT_NE(out.find(thumbs_up), std::string::npos);
+  EXPECT_EQ(out.find(flag), std::string::npos);
+}
+
+TEST_F(ClusterTest, pools_stay_small_without_clearing) {
+  for (int i = 0; i < 20000; i++) {
+    const std::string& cluster = (i % 2) ? e_acute : family;
+    tb_change_cluster(i % 20, i % 4, cluster.data(), cluster.size(), TB_DEFAULT, TB_DEFAULT);
+    tb_present();
+  }
+  drain();
+  uint32_t highest = 0;
+  // rows are padded up to the stride with cells that aren't shown
+  for (int y = 0; y < tb_height(); y++) {
+    for (int x = 0; x < tb_width(); x++) {
+      uint32_t ch = tb_cell_buffer()[y * tb_width() + x].ch;
+      if (ch & TB_CLUSTER) highest = std::max(highest, ch & ~TB_CLUSTER);
+    }
+  }
+  EXPECT_LT(highest, 256u * 1024);
+}
+
+TEST_F(ClusterTest, recordings_carry_their_clusters) {
+  std::string recording = "/tmp/term-react-cluster-" + std::to_string(getpid()) + ".rec";
+  std::string cast = recording + ".cast";
+  unlink(recording.c_str());
+  tb_shutdown();
+  ASSERT_EQ(tb_init_headless(20, 4), 0);
+  ASSERT_EQ(tb_record(recording.c_str(), 0, TB_RECORD_COMPRESS), 0);
+  tb_change_cluster(0, 0, e_acute.data(), e_acute.size(), TB_DEFAULT, TB_DEFAULT);
+  tb_present();
+  tb_change_cluster(5, 1, family.data(), family.size(), TB_DEFAULT, TB_DEFAULT);
+  tb_present();
+  tb_stop_recording();
+  ASSERT_EQ(tb_export_asciicast(recording.c_str(), cast.c_str()), 0);
+
+  std::ifstream in{cast};
+  std::string contents{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+  EXPECT_NE(contents.find(e_acute), std::string::npos);
+  EXPECT_NE(contents.find(family), std::string::npos);
+  unlink(recording.c_str());
+  unlink(cast.c_str());
+}
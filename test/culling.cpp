@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/components/box.hpp"
+#include "../src/term-react/termbox.hpp"
+
+// a scrolled list only paying for the rows in sight, presented headless. termbox itself comes from
+// termbox-input.cpp
+
+using namespace termreact;
+
+enum class ScrollAction { Scroll };
+
+INIT_REDUCER(offsetReducer, () { return 0; });
+REDUCER(offsetReducer, (ScrollAction::Scroll), (int prev, int rows) { return prev + rows; });
+
+DECL_STORE(ScrollStore, (int, offset, offsetReducer));
+
+static int row_mounts = 0;
+static int row_draws = 0;
+
+CREATE_END_COMPONENT_CLASS(Row) {
+  DECL_END_PROPS((int, index));
+  MAP_STATE_TO_END_PROPS();
+public:
+  END_COMPONENT_WILL_MOUNT(Row) { row_mounts++; }
+  END_COMPONENT_WILL_UNMOUNT(Row) {}
+  END_COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+  CanvasSlice present(CanvasSlice canvas) {
+    row_draws++;
+    canvas.writeString(0, 0, "row " + std::to_string(PROPS(index)));
+    return canvas;
+  }
+};
+
+constexpr int rows = 1000;
+
+// rows in lazy boxes of their own, scrolled by moving them up in a box 4 rows high
+CREATE_COMPONENT_CLASS(ScrollApp) {
+  DECL_PROPS((int, offset));
+  MAP_STATE_TO_PROPS((offset, STATE_FIELD(offset)));
+  void render_() override {
+    RENDER_COMPONENT(Box, ATTRIBUTES((left, 2)(top, 1)(width, 8)(height, 4))) {
+      // the attributes macros only capture this, the loop needs i too
+      auto& store = details::ComponentAccessor<StoreT>{this}.getStore();
+      for (int i = 0; i < rows; i++) {
+        details::renderChildComponent<Box<StoreT>>(std::to_string(i), next_children, store, [this, i] (auto props) {
+          props.template update<decltype(props)::Field::lazy>(true);
+          props.template update<decltype(props)::Field::top>(i - PROPS(offset));
+          props.template update<decltype(props)::Field::height>(1);
+          return props;
+        }) << [&store, i] (details::Children& next_children) {
+          details::renderChildComponent<Row<StoreT>>("row", next_children, store, [i] (auto props) {
+            props.template update<decltype(props)::Field::index>(i);
+            return props;
+          }) << [] (details::Children&) {};
+        };
+      }
+    };
+  }
+public:
+  COMPONENT_WILL_MOUNT(ScrollApp) {}
+  COMPONENT_WILL_UNMOUNT(ScrollApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+class CullingTest : public ::testing::Test {
+protected:
+  tb_context *context;
+
+  void SetUp() override {
+    row_mounts = row_draws = 0;
+    context = tb_context_new();
+    tb_select_context(context);
+  }
+
+  void TearDown() override {
+    tb_select_context(nullptr);
+    tb_context_free(context);
+  }
+
+  static std::string row(int y, int x = 0, int width = 12) {
+    std::string chars;
+    for (int i = x; i < x + width; i++) {
+      chars += static_cast<char>(tb_cell_buffer()[y * tb_width() + i].ch);
+    }
+    return chars;
+  }
+};
+
+// remembers what's drawn on it, one byte per cell
+class GridCanvas : public Canvas {
+public:
+  std::vector<std::string> rows;
+
+  GridCanvas(int width, int height) : rows(height, std::string(width, ' ')) {}
+  int getWidth() const override { return static_cast<int>(rows[0].size()); }
+  int getHeight() const override { return static_cast<int>(rows.size()); }
+  void clear(uint16_t = 0, uint16_t = 0) override {}
+  void setCell(int x, int y, uint32_t ch, uint16_t = 0, uint16_t = 0) override {
+    rows.at(y).at(x) = static_cast<char>(ch);
+  }
+  void present() override {}
+};
+
+TEST(CanvasSliceTest, slices_clip_to_their_parent) {
+  GridCanvas grid{10, 3};
+  auto outer = grid.slice(2, 0, 4, 2);
+  auto inner = outer.slice(-1, 1, 10, 5);
+  EXPECT_EQ(inner.getVisibleRect(), (Rect{2, 1, 4, 1}));
+  inner.writeString(0, 0, "abcdefgh");
+  inner.setCell(0, 1, 'z');
+  inner.setCell(2, 0, 'y');
+  EXPECT_EQ(grid.rows[0], std::string(10, ' '));
+  EXPECT_EQ(grid.rows[1], "  byde    ");
+  EXPECT_EQ(grid.rows[2], std::string(10, ' '));
+  EXPECT_TRUE(outer.slice(0, 2, 4, 2).getVisibleRect().empty());
+}
+
+TEST_F(CullingTest, only_rows_in_sight_are_mounted_and_drawn) {
+  ScrollStore store;
+  Termbox termbox{store, context, Termbox::Headless{12, 6}};
+  termbox.render<ScrollApp>(store, [] (const ScrollStore::StateType&) { return false; });
+  EXPECT_EQ(row_mounts, 0);
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(row_mounts, 4);
+  EXPECT_EQ(row_draws, 4);
+  EXPECT_EQ(row(1), "  row 0     ");
+  EXPECT_EQ(row(4), "  row 3     ");
+  // the box is 8 wide, the rest of the screen stays clear
+  EXPECT_EQ(row(5), std::string(12, ' '));
+
+  store.dispatch<ACTION(ScrollAction::Scroll)>(998);
+  row_draws = 0;
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(row_mounts, 6);
+  EXPECT_EQ(row_draws, 2);
+  EXPECT_EQ(row(1), "  row 998   ");
+  EXPECT_EQ(row(2), "  row 999   ");
+  EXPECT_EQ(row(3), std::string(12, ' '));
+}
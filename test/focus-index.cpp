@@ -0,0 +1,199 @@
+#include "gtest/gtest.h"
+#include "../src/term-react/event.hpp"
+
+using namespace termreact;
+using namespace termreact::details;
+
+struct F : Focusable {
+  void onFocus() override {}
+  void onLostFocus() override {}
+  void onKeyPress(Event) override {}
+};
+
+TEST(FocusIndexTest, empty) {
+  FocusIndex index;
+  F a;
+  EXPECT_EQ(index.first(), nullptr);
+  EXPECT_EQ(index.next(&a), nullptr);
+  EXPECT_EQ(index.prev(&a), nullptr);
+  EXPECT_EQ(index.move(&a, FocusDirection::Left), nullptr);
+}
+
+TEST(FocusIndexTest, mount_order_before_present) {
+  FocusIndex index;
+  F a, b, c;
+  index.insert(&a);
+  index.insert(&b);
+  index.insert(&c);
+  index.insert(&b);
+  EXPECT_EQ(index.size(), 3u);
+
+  EXPECT_EQ(index.first(), &a);
+  EXPECT_EQ(index.next(&a), &b);
+  EXPECT_EQ(index.next(&b), &c);
+  EXPECT_EQ(index.next(&c), &a);
+  EXPECT_EQ(index.prev(&a), &c);
+  EXPECT_EQ(index.prev(&b), &a);
+  EXPECT_EQ(index.next(nullptr), &a);
+  EXPECT_EQ(index.prev(nullptr), &c);
+}
+
+TEST(FocusIndexTest, present_order_wins) {
+  FocusIndex index;
+  F a, b, c;
+  index.insert(&a);
+  index.insert(&b);
+  index.insert(&c);
+
+  index.beginPresent();
+  index.place(&c, Rect{0, 0, 1, 1});
+  index.place(&a, Rect{0, 1, 1, 1});
+  index.place(&b, Rect{0, 2, 1, 1});
+  EXPECT_EQ(index.first(), &c);
+  EXPECT_EQ(index.next(&c), &a);
+  EXPECT_EQ(index.next(&a), &b);
+
+  // freshly mounted ones go last until they get presented
+  F d;
+  index.insert(&d);
+  EXPECT_EQ(index.next(&b), &d);
+  EXPECT_EQ(index.next(&d), &c);
+
+  index.beginPresent();
+  index.place(&d, Rect{0, 0, 1, 1});
+  index.place(&c, Rect{0, 1, 1, 1});
+  index.place(&a, Rect{0, 2, 1, 1});
+  index.place(&b, Rect{0, 3, 1, 1});
+  EXPECT_EQ(index.first(), &d);
+  EXPECT_EQ(index.prev(&d), &b);
+}
+
+TEST(FocusIndexTest, remove) {
+  FocusIndex index;
+  F a, b, c;
+  index.insert(&a);
+  index.insert(&b);
+  index.insert(&c);
+  index.beginPresent();
+  index.place(&a, Rect{0, 0, 1, 1});
+  index.place(&b, Rect{1, 0, 1, 1});
+  index.place(&c, Rect{2, 0, 1, 1});
+
+  index.remove(&b);
+  EXPECT_FALSE(index.contains(&b));
+  EXPECT_EQ(index.next(&a), &c);
+  EXPECT_EQ(index.move(&a, FocusDirection::Right), &c);
+  index.remove(&b);
+  EXPECT_EQ(index.size(), 2u);
+}
+
+TEST(FocusIndexTest, unknown_focusables_are_not_placed) {
+  FocusIndex index;
+  F a, b;
+  index.insert(&a);
+  index.beginPresent();
+  index.place(&b, Rect{0, 0, 1, 1});
+  index.place(&a, Rect{0, 1, 1, 1});
+  EXPECT_FALSE(index.contains(&b));
+  EXPECT_EQ(index.first(), &a);
+}
+
+TEST(FocusIndexTest, move) {
+  // a b
+  // c   d
+  FocusIndex index;
+  F a, b, c, d;
+  index.insert(&a);
+  index.insert(&b);
+  index.insert(&c);
+  index.insert(&d);
+  index.beginPresent();
+  index.place(&a, Rect{0, 0, 4, 2});
+  index.place(&b, Rect{5, 0, 4, 2});
+  index.place(&c, Rect{0, 3, 4, 2});
+  index.place(&d, Rect{10, 3, 4, 2});
+
+  EXPECT_EQ(index.move(&a, FocusDirection::Right), &b);
+  EXPECT_EQ(index.move(&a, FocusDirection::Down), &c);
+  EXPECT_EQ(index.move(&a, FocusDirection::Left), nullptr);
+  EXPECT_EQ(index.move(&a, FocusDirection::Up), nullptr);
+  EXPECT_EQ(index.move(&b, FocusDirection::Left), &a);
+  EXPECT_EQ(index.move(&c, FocusDirection::Right), &d);
+  EXPECT_EQ(index.move(&c, FocusDirection::Up), &a);
+  EXPECT_EQ(index.move(&d, FocusDirection::Up), &b);
+  EXPECT_EQ(index.move(&d, FocusDirection::Left), &c);
+
+  // moving a rect re-indexes it
+  index.beginPresent();
+  index.place(&a, Rect{0, 0, 4, 2});
+  index.place(&b, Rect{5, 0, 4, 2});
+  index.place(&c, Rect{20, 3, 4, 2});
+  index.place(&d, Rect{10, 3, 4, 2});
+  EXPECT_EQ(index.move(&d, FocusDirection::Right), &c);
+  EXPECT_EQ(index.move(&d, FocusDirection::Left), &b);
+}
+
+TEST(FocusIndexTest, not_presented_cannot_move) {
+  FocusIndex index;
+  F a, b;
+  index.insert(&a);
+  index.insert(&b);
+  index.beginPresent();
+  index.place(&a, Rect{0, 0, 1, 1});
+  EXPECT_EQ(index.move(&a, FocusDirection::Right), nullptr);
+  EXPECT_EQ(index.move(&b, FocusDirection::Left), nullptr);
+}
+
+TEST(FocusIndexTest, skipped_ones_go_last) {
+  FocusIndex index;
+  F a, b, c, d;
+  index.insert(&a);
+  index.insert(&b);
+  index.insert(&c);
+  index.insert(&d);
+  index.beginPresent();
+  index.place(&a, Rect{0, 0, 1, 1});
+  index.place(&b, Rect{1, 0, 1, 1});
+  index.place(&c, Rect{2, 0, 1, 1});
+  index.place(&d, Rect{3, 0, 1, 1});
+  index.endPresent();
+
+  // a and b in a subtree out of sight, c and d get the orders they had
+  index.beginPresent();
+  index.place(&c, Rect{2, 0, 1, 1});
+  index.place(&d, Rect{3, 0, 1, 1});
+  index.endPresent();
+  EXPECT_EQ(index.first(), &c);
+  EXPECT_EQ(index.next(&c), &d);
+  EXPECT_EQ(index.next(&d), &a);
+  EXPECT_EQ(index.next(&a), &b);
+  EXPECT_EQ(index.next(&b), &c);
+  EXPECT_EQ(index.move(&c, FocusDirection::Left), nullptr);
+  EXPECT_EQ(index.move(&a, FocusDirection::Right), nullptr);
+
+  // back in sight
+  index.beginPresent();
+  index.place(&a, Rect{0, 0, 1, 1});
+  index.place(&b, Rect{1, 0, 1, 1});
+  index.place(&c, Rect{2, 0, 1, 1});
+  index.place(&d, Rect{3, 0, 1, 1});
+  index.endPresent();
+  EXPECT_EQ(index.first(), &a);
+  EXPECT_EQ(index.next(&b), &c);
+  EXPECT_EQ(index.move(&c, FocusDirection::Left), &b);
+}
+
+TEST(FocusReducerTest, reducers_leave_the_index_alone) {
+  FocusIndex index;
+  F a, b;
+  index.insert(&a);
+  index.insert(&b);
+  const FocusableStore prev{&a};
+  EXPECT_EQ(focusableReducer<ACTION(BuiltinAction::nextFocus)>::reduce(prev, index).focus, &b);
+  EXPECT_EQ(focusableReducer<ACTION(BuiltinAction::nextFocus)>::reduce(prev, index).focus, &b);
+  EXPECT_EQ(focusableReducer<ACTION(BuiltinAction::unregisterFocusable)>::reduce(prev, &a, &b).focus, &b);
+  EXPECT_EQ(focusableReducer<ACTION(BuiltinAction::unregisterFocusable)>::reduce(prev, &b, &a).focus, &a);
+  EXPECT_EQ(focusableReducer<ACTION(BuiltinAction::unregisterFocusable)>::reduce(prev, &a, &a).focus, nullptr);
+  EXPECT_EQ(index.size(), 2u);
+  EXPECT_EQ(index.first(), &a);
+}
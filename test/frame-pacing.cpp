@@ -0,0 +1,92 @@
+#include "gtest/gtest.h"
+#include <chrono>
+#include <thread>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/components/box.hpp"
+#include "../src/term-react/termbox.hpp"
+#include "pty.hpp"
+
+// frames paced by how fast a pty is read, first not at all and then right away
+
+using namespace termreact;
+
+enum class PacingAction { Fill };
+
+INIT_REDUCER(pacingFillReducer, () { return 'a'; });
+REDUCER(pacingFillReducer, (PacingAction::Fill), (char prev) { return prev == 'z' ? 'a' : prev + 1; });
+
+DECL_STORE(PacingStore, (char, fill, pacingFillReducer));
+
+// every cell changes with every frame
+CREATE_END_COMPONENT_CLASS(Fill) {
+  DECL_END_PROPS((char, fill));
+  MAP_STATE_TO_END_PROPS();
+public:
+  END_COMPONENT_WILL_MOUNT(Fill) {}
+  END_COMPONENT_WILL_UNMOUNT(Fill) {}
+  END_COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+  CanvasSlice present(CanvasSlice canvas) {
+    for (int y = 0; y < canvas.getHeight(); y++) {
+      for (int x = 0; x < canvas.getWidth(); x++) canvas.setCell(x, y, PROPS(fill));
+    }
+    return canvas;
+  }
+};
+
+CREATE_COMPONENT_CLASS(PacingApp) {
+  DECL_PROPS((char, fill));
+  MAP_STATE_TO_PROPS((fill, STATE_FIELD(fill)));
+  void render_() override {
+    RENDER_COMPONENT(Fill, ATTRIBUTES((fill, PROPS(fill)))) { NO_CHILDREN };
+  }
+public:
+  COMPONENT_WILL_MOUNT(PacingApp) {}
+  COMPONENT_WILL_UNMOUNT(PacingApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+class FramePacingTest : public PtyContextTest {
+protected:
+  // a frame is far more than a pty buffers
+  FramePacingTest() : PtyContextTest{200, 50, false} {}
+};
+
+TEST_F(FramePacingTest, interval_backs_off_while_the_terminal_lags_and_recovers) {
+  using namespace std::chrono;
+  const microseconds floor{1000}, ceiling{32000};
+  PacingStore store;
+  Termbox termbox{store, context, pty.openSlave()};
+  // presents never block then, only the pacing holds frames back
+  ASSERT_TRUE(termbox.setThreadedOutput(true));
+  termbox.setFramePacing(floor, ceiling);
+  termbox.render<PacingApp>(store, [] (const PacingStore::StateType&) { return false; });
+  auto& stats = termbox.getFrameStats();
+
+  // nobody reads, the output queue stays full
+  microseconds widest{0};
+  auto deadline = steady_clock::now() + seconds{5};
+  while ((stats.dropped < 4 || widest < ceiling) && steady_clock::now() < deadline) {
+    store.dispatch<ACTION(PacingAction::Fill)>();
+    termbox.step();
+    widest = std::max(widest, stats.frame_interval);
+    std::this_thread::sleep_for(termbox.nextStepIn());
+  }
+  EXPECT_GE(stats.dropped, 4u);
+  EXPECT_EQ(widest, ceiling);
+  // the screen doesn't freeze, a frame still goes out once the ceiling has passed
+  EXPECT_GT(stats.presented, 1u);
+  EXPECT_GT(tb_output_pending(), 0);
+
+  // read as fast as it comes, frames go back to the floor
+  deadline = steady_clock::now() + seconds{5};
+  while (stats.frame_interval > floor && steady_clock::now() < deadline) {
+    drain();
+    store.dispatch<ACTION(PacingAction::Fill)>();
+    termbox.step();
+    std::this_thread::sleep_for(termbox.nextStepIn());
+  }
+  EXPECT_EQ(stats.frame_interval, floor);
+
+  // the writer is done before the terminal is shut down
+  while (tb_output_pending() > 0 && steady_clock::now() < deadline) drain();
+}
@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+#include <memory>
+#include "../src/term-react/hit-test.hpp"
+
+using namespace termreact;
+using namespace termreact::details;
+
+struct T : MouseTarget {
+  int clicks = 0;
+  void onMouse(MouseEvent) override { clicks++; }
+};
+
+TEST(HitTestIndexTest, empty) {
+  HitTestIndex index;
+  EXPECT_EQ(index.hitTest(0, 0), nullptr);
+  EXPECT_EQ(index.hitTest(-1, 10), nullptr);
+}
+
+TEST(HitTestIndexTest, single_target) {
+  HitTestIndex index;
+  T t;
+  index.paint(Rect{2, 3, 4, 2}, &t);
+
+  Rect rect;
+  EXPECT_EQ(index.hitTest(2, 3, &rect), &t);
+  EXPECT_EQ(rect.x, 2);
+  EXPECT_EQ(rect.y, 3);
+  EXPECT_EQ(index.hitTest(5, 4), &t);
+  EXPECT_EQ(index.hitTest(6, 4), nullptr);
+  EXPECT_EQ(index.hitTest(2, 5), nullptr);
+  EXPECT_EQ(index.hitTest(1, 3), nullptr);
+}
+
+TEST(HitTestIndexTest, later_targets_on_top) {
+  HitTestIndex index;
+  T parent, child;
+  index.paint(Rect{0, 0, 10, 10}, &parent);
+  index.paint(Rect{3, 3, 2, 2}, &child);
+
+  EXPECT_EQ(index.hitTest(0, 3), &parent);
+  EXPECT_EQ(index.hitTest(3, 3), &child);
+  EXPECT_EQ(index.hitTest(4, 4), &child);
+  EXPECT_EQ(index.hitTest(5, 4), &parent);
+  EXPECT_EQ(index.hitTest(9, 9), &parent);
+}
+
+TEST(HitTestIndexTest, remove) {
+  HitTestIndex index;
+  T parent, child;
+  index.paint(Rect{0, 0, 10, 1}, &parent);
+  index.paint(Rect{3, 0, 2, 1}, &child);
+  index.remove(&child);
+
+  EXPECT_EQ(index.hitTest(3, 0), nullptr);
+  EXPECT_EQ(index.hitTest(2, 0), &parent);
+  EXPECT_EQ(index.hitTest(5, 0), &parent);
+}
+
+TEST(HitTestIndexTest, repaint_moves_target) {
+  HitTestIndex index;
+  T t;
+  index.paint(Rect{0, 0, 2, 1}, &t);
+  index.paint(Rect{5, 0, 2, 1}, &t);
+
+  EXPECT_EQ(index.hitTest(0, 0), nullptr);
+  EXPECT_EQ(index.hitTest(6, 0), &t);
+}
+
+TEST(HitTestIndexTest, destroyed_target_leaves) {
+  HitTestIndex index;
+  auto t = std::make_unique<T>();
+  index.paint(Rect{0, 0, 2, 2}, t.get());
+  t.reset();
+  EXPECT_EQ(index.hitTest(0, 0), nullptr);
+}
+
+TEST(HitTestIndexTest, clear) {
+  HitTestIndex index;
+  T t;
+  index.paint(Rect{0, 0, 2, 2}, &t);
+  index.clear();
+  EXPECT_EQ(index.hitTest(1, 1), nullptr);
+}
+
+TEST(HitTestIndexTest, clipped_target_keeps_its_rect) {
+  HitTestIndex index;
+  T header, row;
+  index.paint(Rect{0, 0, 10, 1}, &header);
+  // scrolled half out of the area below the header
+  index.paint(Rect{0, -1, 10, 3}, Rect{0, 1, 10, 5}, &row);
+
+  Rect rect;
+  EXPECT_EQ(index.hitTest(4, 0), &header);
+  EXPECT_EQ(index.hitTest(4, 1, &rect), &row);
+  EXPECT_EQ(rect.y, -1);
+}
+
+TEST(HitTestIndexTest, removals_are_counted) {
+  HitTestIndex index;
+  T t;
+  index.paint(Rect{0, 0, 2, 2}, &t);
+  index.clear();
+  EXPECT_EQ(index.removals(), 0u);
+  index.paint(Rect{0, 0, 2, 2}, &t);
+  index.remove(&t);
+  index.remove(&t);
+  EXPECT_EQ(index.removals(), 1u);
+}
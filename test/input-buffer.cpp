@@ -0,0 +1,54 @@
+#include "gtest/gtest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "../src/term-react/termbox/inputbuffer.inl"
+
+static void append(struct inputbuffer *b, const std::string& s) {
+  memcpy(inputbuffer_reserve_tail(b, s.size()), s.data(), s.size());
+  inputbuffer_commit(b, s.size());
+}
+
+static std::string contents(const struct inputbuffer *b) {
+  return std::string(inputbuffer_data(b), inputbuffer_len(b));
+}
+
+class InputBufferTest : public ::testing::Test {
+protected:
+  inputbuffer buf;
+
+  void SetUp() override { inputbuffer_init(&buf, 16); }
+  void TearDown() override { inputbuffer_free(&buf); }
+};
+
+TEST_F(InputBufferTest, consume_advances_without_moving) {
+  append(&buf, "abc\033[");
+  const char *data = inputbuffer_data(&buf);
+  inputbuffer_consume(&buf, 1);
+  EXPECT_EQ(inputbuffer_data(&buf), data + 1);
+  inputbuffer_consume(&buf, 2);
+  EXPECT_EQ(contents(&buf), "\033[");
+
+  // consuming everything starts over at the front
+  inputbuffer_consume(&buf, 5);
+  EXPECT_EQ(inputbuffer_len(&buf), 0);
+  EXPECT_EQ(buf.start, 0);
+}
+
+TEST_F(InputBufferTest, partial_sequence_survives_compaction) {
+  append(&buf, "0123456789ab\033[1");
+  inputbuffer_consume(&buf, 12);
+  // no room left at the back, only the unparsed bytes are moved to the front
+  append(&buf, ";5A");
+  EXPECT_EQ(buf.start, 0);
+  EXPECT_EQ(buf.cap, 16);
+  EXPECT_EQ(contents(&buf), "\033[1;5A");
+}
+
+TEST_F(InputBufferTest, grows_for_big_reads) {
+  std::string paste(1000, 'x');
+  append(&buf, "a");
+  append(&buf, paste);
+  EXPECT_GE(buf.cap, 1001);
+  EXPECT_EQ(contents(&buf), "a" + paste);
+}
@@ -0,0 +1,158 @@
+#include "gtest/gtest.h"
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/components/box.hpp"
+#include "../src/term-react/termbox.hpp"
+#include "pty.hpp"
+
+// input captured from a pty and replayed into headless contexts
+
+using namespace termreact;
+
+enum class ReplayAction { Key };
+
+INIT_REDUCER(replayKeysReducer, () { return std::string{}; });
+REDUCER(replayKeysReducer, (ReplayAction::Key), (std::string prev, char key) { return prev + key; });
+
+DECL_STORE(ReplayStore, (std::string, keys, replayKeysReducer));
+
+CREATE_COMPONENT_CLASS(ReplayApp) {
+  DECL_PROPS((std::string, keys));
+  MAP_STATE_TO_PROPS((keys, STATE_FIELD(keys)));
+  void render_() override {
+    RENDER_COMPONENT(Box, ATTRIBUTES(
+      (text, "keys " + PROPS(keys))
+      (focusable, true)
+      (onKeyPress, [this] (Event event) { DISPATCH(ReplayAction::Key)(static_cast<char>(event.ch)); })
+    )) { NO_CHILDREN };
+  }
+public:
+  COMPONENT_WILL_MOUNT(ReplayApp) {}
+  COMPONENT_WILL_UNMOUNT(ReplayApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+class InputLogTest : public PtyContextTest {
+protected:
+  std::string log;
+
+  // each test starts termbox its own way
+  InputLogTest() : PtyContextTest{80, 24, false} {}
+
+  void SetUp() override {
+    PtyContextTest::SetUp();
+    log = "/tmp/term-react-input-" + std::to_string(getpid()) + ".log";
+  }
+
+  void TearDown() override {
+    PtyContextTest::TearDown();
+    unlink(log.c_str());
+  }
+
+  tb_event next() {
+    tb_event event{};
+    EXPECT_GT(tb_peek_event(&event, 5000), 0);
+    return event;
+  }
+
+  // a session typing keys one at a time, resized halfway
+  void capture(const std::string& keys) {
+    ASSERT_EQ(tb_init_fd(pty.openSlave()), 0);
+    ASSERT_EQ(tb_capture_input(log.c_str()), 0);
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      if (i == keys.size() / 2) {
+        pty.resize(100, 30);
+        tb_notify_resize(context);
+        EXPECT_EQ(next().type, TB_EVENT_RESIZE);
+      }
+      pty.type(keys.substr(i, 1));
+      EXPECT_EQ(next().ch, uint32_t(keys[i]));
+    }
+    tb_shutdown();
+  }
+};
+
+TEST_F(InputLogTest, replay_reports_what_was_captured) {
+  capture("abcd");
+
+  ASSERT_EQ(tb_init_headless(80, 24), 0);
+  ASSERT_EQ(tb_replay_input(log.c_str(), TB_REPLAY_MAX_SPEED), 0);
+  std::string keys;
+  tb_event event;
+  int type;
+  while ((type = tb_peek_event(&event, 1000)) > 0) {
+    if (type == TB_EVENT_KEY) keys += static_cast<char>(event.ch);
+    if (type == TB_EVENT_RESIZE) {
+      EXPECT_EQ(event.w, 100);
+      EXPECT_EQ(event.h, 30);
+      tb_clear();
+      EXPECT_EQ(tb_width(), 100);
+    }
+    tb_present();
+  }
+  // over once everything got presented
+  EXPECT_EQ(type, -1);
+  EXPECT_EQ(keys, "abcd");
+
+  tb_replay_stats stats;
+  ASSERT_EQ(tb_get_replay_stats(&stats), 0);
+  EXPECT_EQ(stats.events, 5u);
+  EXPECT_LE(stats.p50_us, stats.p90_us);
+  EXPECT_LE(stats.p99_us, stats.max_us);
+}
+
+TEST_F(InputLogTest, keys_read_at_once_are_events_of_their_own) {
+  ASSERT_EQ(tb_init_fd(pty.openSlave()), 0);
+  ASSERT_EQ(tb_capture_input(log.c_str()), 0);
+  pty.type("xyz");
+  for (char key : std::string{"xyz"}) EXPECT_EQ(next().ch, uint32_t(key));
+  tb_shutdown();
+
+  ASSERT_EQ(tb_init_headless(80, 24), 0);
+  ASSERT_EQ(tb_replay_input(log.c_str(), TB_REPLAY_MAX_SPEED), 0);
+  tb_event event;
+  while (tb_peek_event(&event, 1000) > 0) tb_present();
+  tb_replay_stats stats;
+  ASSERT_EQ(tb_get_replay_stats(&stats), 0);
+  EXPECT_EQ(stats.events, 3u);
+}
+
+TEST_F(InputLogTest, records_claiming_more_than_is_left_end_the_log) {
+  {
+    std::ofstream out{log, std::ios::binary};
+    out.write("TBINP\0\1\0", 8);
+    // padded to 8 bytes, this length wraps to 0 in 32 bits
+    const uint32_t header[] = {1, 0xFFFFFFF9u, 0, 0};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write("abcdefgh", 8);
+  }
+  ASSERT_EQ(tb_init_headless(80, 24), 0);
+  ASSERT_EQ(tb_replay_input(log.c_str(), TB_REPLAY_MAX_SPEED), 0);
+  tb_event event;
+  EXPECT_EQ(tb_peek_event(&event, 1000), -1);
+  tb_replay_stats stats;
+  ASSERT_EQ(tb_get_replay_stats(&stats), 0);
+  EXPECT_EQ(stats.events, 0u);
+}
+
+TEST_F(InputLogTest, not_a_log) {
+  ASSERT_EQ(tb_init_headless(80, 24), 0);
+  EXPECT_EQ(tb_replay_input("/nonexistent/input.log", 0), -ENOENT);
+  EXPECT_EQ(tb_get_replay_stats(nullptr), -1);
+}
+
+TEST_F(InputLogTest, app_replay_at_recorded_speed_and_max_speed) {
+  capture("hello");
+  for (bool max_speed : {false, true}) {
+    ReplayStore store;
+    Termbox termbox{store, context, Termbox::Headless{80, 24}};
+    termbox.render<ReplayApp>(store, [] (const ReplayStore::StateType&) { return false; });
+    auto stats = termbox.replay(log, max_speed);
+    EXPECT_EQ(store.get<ReplayStore::Field::keys>(), "hello");
+    EXPECT_EQ(stats.events, 6u);
+    EXPECT_EQ(store.get<ReplayStore::Field::window_width>(), 100);
+  }
+}
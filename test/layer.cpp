@@ -0,0 +1,186 @@
+#include "gtest/gtest.h"
+#include <string>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/components/box.hpp"
+#include "../src/term-react/termbox.hpp"
+
+// a busy area and popups in layers of their own, presented headless. termbox itself comes from
+// termbox-input.cpp
+
+using namespace termreact;
+
+enum class LayerAction { TogglePopup, ToggleModal, Fill };
+
+INIT_REDUCER(popupReducer, () { return false; });
+REDUCER(popupReducer, (LayerAction::TogglePopup), (bool prev) { return !prev; });
+INIT_REDUCER(modalReducer, () { return false; });
+REDUCER(modalReducer, (LayerAction::ToggleModal), (bool prev) { return !prev; });
+INIT_REDUCER(fillReducer, () { return 'x'; });
+REDUCER(fillReducer, (LayerAction::Fill), (char, char next) { return next; });
+
+DECL_STORE(LayerStore, (bool, popup, popupReducer)(bool, modal, modalReducer)(char, fill, fillReducer));
+
+static int dense_draws = 0;
+
+// stands for a table with a cell in every position
+CREATE_END_COMPONENT_CLASS(Dense) {
+  DECL_END_PROPS((char, fill));
+  MAP_STATE_TO_END_PROPS();
+public:
+  END_COMPONENT_WILL_MOUNT(Dense) {}
+  END_COMPONENT_WILL_UNMOUNT(Dense) {}
+  END_COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+  CanvasSlice present(CanvasSlice canvas) {
+    dense_draws++;
+    for (int y = 0; y < canvas.getHeight(); y++) {
+      for (int x = 0; x < canvas.getWidth(); x++) {
+        canvas.setCell(x, y, PROPS(fill));
+      }
+    }
+    return canvas;
+  }
+};
+
+CREATE_COMPONENT_CLASS(LayerApp) {
+  DECL_PROPS((bool, popup)(bool, modal)(char, fill));
+  MAP_STATE_TO_PROPS((popup, STATE_FIELD(popup))(modal, STATE_FIELD(modal))(fill, STATE_FIELD(fill)));
+  void render_() override {
+    RENDER_COMPONENT(Box, ATTRIBUTES()) {
+      RENDER_COMPONENT(Dense, "table", ATTRIBUTES((layer, 1)(fill, PROPS(fill)))) { NO_CHILDREN };
+      if (PROPS(popup)) {
+        RENDER_COMPONENT(Box, "popup", ATTRIBUTES(
+          (layer, 2)(left, 10)(top, 5)(width, 20)(height, 3)(border, '#')(text, "popup")
+        )) { NO_CHILDREN };
+      }
+      if (PROPS(modal)) {
+        RENDER_COMPONENT(Box, "modal", ATTRIBUTES((layer, 3)(text, "modal"))) { NO_CHILDREN };
+      }
+    };
+  }
+public:
+  COMPONENT_WILL_MOUNT(LayerApp) {}
+  COMPONENT_WILL_UNMOUNT(LayerApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+static std::string focused;
+
+// focusables in a layer, one beside it and a modal that can take the focus too
+CREATE_COMPONENT_CLASS(FocusLayerApp) {
+  DECL_PROPS((bool, modal));
+  MAP_STATE_TO_PROPS((modal, STATE_FIELD(modal)));
+  void render_() override {
+    RENDER_COMPONENT(Box, ATTRIBUTES()) {
+      RENDER_COMPONENT(Box, "panel", ATTRIBUTES((layer, 1)(height, 2))) {
+        RENDER_COMPONENT(Box, "a", ATTRIBUTES(
+          (height, 1)(text, "a")(focusable, true)(onFocus, [] () { focused += "a"; })
+        )) { NO_CHILDREN };
+        RENDER_COMPONENT(Box, "b", ATTRIBUTES(
+          (top, 1)(height, 1)(text, "b")(focusable, true)(onFocus, [] () { focused += "b"; })
+        )) { NO_CHILDREN };
+      };
+      RENDER_COMPONENT(Box, "c", ATTRIBUTES(
+        (top, 2)(height, 1)(text, "c")(focusable, true)(onFocus, [] () { focused += "c"; })
+      )) { NO_CHILDREN };
+      if (PROPS(modal)) {
+        RENDER_COMPONENT(Box, "modal", ATTRIBUTES(
+          (layer, 3)(text, "modal")(focusable, true)(onFocus, [] () { focused += "m"; })
+        )) { NO_CHILDREN };
+      }
+    };
+  }
+public:
+  COMPONENT_WILL_MOUNT(FocusLayerApp) {}
+  COMPONENT_WILL_UNMOUNT(FocusLayerApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+class LayerTest : public ::testing::Test {
+protected:
+  tb_context *context;
+
+  void SetUp() override {
+    dense_draws = 0;
+    context = tb_context_new();
+    tb_select_context(context);
+  }
+
+  void TearDown() override {
+    tb_select_context(nullptr);
+    tb_context_free(context);
+  }
+
+  // the characters of a row of the back buffer
+  static std::string row(int y, int x = 0, int width = 40) {
+    std::string chars;
+    for (int i = x; i < x + width; i++) {
+      chars += static_cast<char>(tb_cell_buffer()[y * tb_width() + i].ch);
+    }
+    return chars;
+  }
+};
+
+TEST_F(LayerTest, popup_over_a_layer_does_not_redraw_it) {
+  LayerStore store;
+  Termbox termbox{store, context, Termbox::Headless{40, 12}};
+  termbox.render<LayerApp>(store, [] (const LayerStore::StateType&) { return false; });
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(dense_draws, 1);
+  EXPECT_EQ(row(6), std::string(40, 'x'));
+
+  store.dispatch<ACTION(LayerAction::TogglePopup)>();
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(dense_draws, 1);
+  EXPECT_EQ(row(5, 8, 24), "xx####################xx");
+  EXPECT_EQ(row(6, 8, 24), "xx#      popup       #xx");
+
+  store.dispatch<ACTION(LayerAction::TogglePopup)>();
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(dense_draws, 1);
+  EXPECT_EQ(row(6), std::string(40, 'x'));
+
+  store.dispatch<ACTION(LayerAction::Fill)>('o');
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(dense_draws, 2);
+  EXPECT_EQ(row(6), std::string(40, 'o'));
+}
+
+TEST_F(LayerTest, layer_under_a_full_screen_one_is_culled) {
+  LayerStore store;
+  Termbox termbox{store, context, Termbox::Headless{40, 12}};
+  termbox.render<LayerApp>(store, [] (const LayerStore::StateType&) { return false; });
+  termbox.step(std::chrono::microseconds{0});
+  store.dispatch<ACTION(LayerAction::ToggleModal)>();
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(row(5), std::string(17, ' ') + "modal" + std::string(18, ' '));
+
+  // hidden, so changing it costs nothing until the modal goes
+  store.dispatch<ACTION(LayerAction::Fill)>('o');
+  termbox.step(std::chrono::microseconds{0});
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(dense_draws, 1);
+  EXPECT_EQ(row(5), std::string(17, ' ') + "modal" + std::string(18, ' '));
+
+  store.dispatch<ACTION(LayerAction::ToggleModal)>();
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(dense_draws, 2);
+  EXPECT_EQ(row(5), std::string(40, 'o'));
+}
+
+TEST_F(LayerTest, focusables_in_a_hidden_layer_go_last) {
+  LayerStore store;
+  Termbox termbox{store, context, Termbox::Headless{40, 12}};
+  termbox.render<FocusLayerApp>(store, [] (const LayerStore::StateType&) { return false; });
+  termbox.step(std::chrono::microseconds{0});
+  focused.clear();
+  for (int i = 0; i < 3; i++) store.dispatch<ACTION(details::BuiltinAction::nextFocus)>(std::cref(store.focusIndex()));
+  EXPECT_EQ(focused, "bca");
+
+  // the modal and c are presented, the panel's focusables are not once it's known to be hidden
+  store.dispatch<ACTION(LayerAction::ToggleModal)>();
+  termbox.step(std::chrono::microseconds{0});
+  termbox.step(std::chrono::microseconds{0});
+  focused.clear();
+  for (int i = 0; i < 4; i++) store.dispatch<ACTION(details::BuiltinAction::nextFocus)>(std::cref(store.focusIndex()));
+  EXPECT_EQ(focused, "bcma");
+}
@@ -0,0 +1,46 @@
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+#include "../src/term-react/utils/mpsc-queue.hpp"
+
+using namespace termreact;
+
+constexpr int producers = 8;
+constexpr int per_producer = 20000;
+
+TEST(MpscQueueTest, fifo) {
+  details::MpscQueue<int> q;
+  int v;
+  EXPECT_TRUE(q.empty());
+  EXPECT_FALSE(q.pop(v));
+  for (int i = 0; i < 3; i++) q.push(i);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(q.pop(v));
+    EXPECT_EQ(v, i);
+  }
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(MpscQueueTest, concurrent_producers) {
+  // producer id and sequence number
+  details::MpscQueue<std::pair<int, int>> q;
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&q, p] () {
+      for (int i = 0; i < per_producer; i++) q.push({p, i});
+    });
+  }
+
+  // consume while producing, each producer's elements must come out in order
+  std::vector<int> next(producers, 0);
+  int received = 0;
+  std::pair<int, int> v;
+  while (received < producers * per_producer) {
+    if (!q.pop(v)) continue;
+    ASSERT_EQ(v.second, next[v.first]);
+    next[v.first]++;
+    received++;
+  }
+  for (auto& t : threads) t.join();
+  EXPECT_FALSE(q.pop(v));
+}
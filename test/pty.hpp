@@ -0,0 +1,95 @@
+#ifndef TERM_REACT_TEST_PTY_HPP
+#define TERM_REACT_TEST_PTY_HPP
+
+#include "gtest/gtest.h"
+#include <string>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../src/term-react/termbox/termbox.h"
+
+// ptys for termbox to draw to, termbox itself comes from termbox-input.cpp
+
+// the master side, what's sent to the slave side is read back from it without blocking
+class Pty {
+public:
+  int master;
+
+  Pty(int width, int height) : master{posix_openpt(O_RDWR | O_NOCTTY)} {
+    grantpt(master);
+    unlockpt(master);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    resize(width, height);
+  }
+  Pty(Pty&& other) noexcept : master{other.master} { other.master = -1; }
+  Pty(const Pty&) = delete;
+  Pty& operator=(const Pty&) = delete;
+  ~Pty() { hangUp(); }
+
+  // a new fd of the slave side, whoever it's given to closes it
+  int openSlave(int flags = 0) const {
+    return open(ptsname(master), O_RDWR | O_NOCTTY | flags);
+  }
+
+  void resize(int width, int height) {
+    winsize ws{};
+    ws.ws_col = width;
+    ws.ws_row = height;
+    ioctl(master, TIOCSWINSZ, &ws);
+  }
+
+  void type(const std::string& keys) {
+    ssize_t r = write(master, keys.data(), keys.size());
+    (void)r;
+  }
+
+  // what was sent so far
+  std::string drain() {
+    std::string result;
+    char buf[4096];
+    ssize_t r;
+    while ((r = read(master, buf, sizeof(buf))) > 0) result.append(buf, r);
+    return result;
+  }
+
+  // the client going away
+  void hangUp() {
+    if (master >= 0) close(master);
+    master = -1;
+  }
+};
+
+// a context of its own, selected for the test and drawing to a pty unless told otherwise
+class PtyContextTest : public ::testing::Test {
+protected:
+  Pty pty;
+  tb_context *context;
+
+  PtyContextTest(int width = 20, int height = 4, bool init = true) : pty{width, height}, init_{init} {}
+
+  void SetUp() override {
+    setenv("TERM", "xterm", 1);
+    context = tb_context_new();
+    tb_select_context(context);
+    if (init_) {
+      ASSERT_EQ(tb_init_fd(pty.openSlave()), 0);
+      drain();
+    }
+  }
+
+  void TearDown() override {
+    if (tb_width() >= 0) tb_shutdown();
+    tb_select_context(nullptr);
+    tb_context_free(context);
+  }
+
+  std::string drain() {
+    return pty.drain();
+  }
+
+private:
+  bool init_;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/components/box.hpp"
+#include "../src/term-react/reactor.hpp"
+#include "pty.hpp"
+
+// a few sessions served on ptys
+
+using namespace termreact;
+
+enum class ReactorAction { Key };
+
+INIT_REDUCER(reactorKeysReducer, () { return 0; });
+REDUCER(reactorKeysReducer, (ReactorAction::Key), (int prev) { return prev + 1; });
+
+DECL_STORE(ReactorStore, (int, keys, reactorKeysReducer));
+
+CREATE_COMPONENT_CLASS(ReactorApp) {
+  DECL_PROPS((int, keys));
+  MAP_STATE_TO_PROPS((keys, STATE_FIELD(keys)));
+  void render_() override {
+    RENDER_COMPONENT(Box, ATTRIBUTES(
+      (text, "keys " + std::to_string(PROPS(keys)))
+      (focusable, true)
+      (onKeyPress, [this] (Event) { DISPATCH(ReactorAction::Key)(); })
+    )) { NO_CHILDREN };
+  }
+public:
+  COMPONENT_WILL_MOUNT(ReactorApp) {}
+  COMPONENT_WILL_UNMOUNT(ReactorApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+static bool waitFor(Reactor& reactor, std::vector<Pty>& ptys, std::size_t sessions, std::size_t *output) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  while (std::chrono::steady_clock::now() < deadline) {
+    for (auto& pty : ptys) {
+      if (pty.master >= 0) *output += pty.drain().size();
+    }
+    if (reactor.sessions() == sessions) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  }
+  return false;
+}
+
+TEST(ReactorTest, sessions_are_independent) {
+  setenv("TERM", "xterm", 1);
+  Reactor reactor{2};
+  std::vector<Pty> ptys;
+  std::vector<Reactor::SessionId> ids;
+  for (int i = 0; i < 8; i++) {
+    ptys.emplace_back(80, 24);
+    ids.push_back(reactor.open<ReactorApp, ReactorStore>(ptys.back().openSlave(), nullptr,
+      [] (const ReactorStore::StateType& state) {
+        return state.get<ReactorStore::Field::keys>() >= 3 ||
+          state.get<ReactorStore::Field::window_width>() == 100;
+      }));
+  }
+  EXPECT_EQ(reactor.sessions(), 8u);
+  std::size_t output = 0;
+  ASSERT_TRUE(waitFor(reactor, ptys, 8, &output));
+
+  // half of them get enough keys to exit, one short of it for the others
+  for (int i = 0; i < 8; i++) {
+    ptys[i].type(i < 4 ? "abc" : "ab");
+  }
+  ASSERT_TRUE(waitFor(reactor, ptys, 4, &output));
+
+  // ptys we don't control get no SIGWINCH
+  for (int i = 4; i < 6; i++) {
+    ptys[i].resize(100, 24);
+    EXPECT_TRUE(reactor.notifyResize(ids[i]));
+  }
+  ASSERT_TRUE(waitFor(reactor, ptys, 2, &output));
+  EXPECT_FALSE(reactor.notifyResize(ids[0]));
+
+  // the client going away ends its session
+  for (int i = 6; i < 8; i++) {
+    ptys[i].hangUp();
+  }
+  ASSERT_TRUE(waitFor(reactor, ptys, 0, &output));
+  EXPECT_GT(output, 0u);
+}
+
+TEST(ReactorTest, non_blocking_ttys_are_served) {
+  setenv("TERM", "xterm", 1);
+  Reactor reactor{1};
+  std::vector<Pty> ptys;
+  ptys.emplace_back(80, 24);
+  int slave = ptys[0].openSlave(O_NONBLOCK);
+  const int typed = 3 * 4096;
+  std::atomic<int> keys{0};
+  reactor.open<ReactorApp, ReactorStore>(slave, nullptr, [&keys] (const ReactorStore::StateType& state) {
+    keys = state.get<ReactorStore::Field::keys>();
+    return keys == typed;
+  });
+  // frames are written whole
+  EXPECT_EQ(fcntl(slave, F_GETFL) & O_NONBLOCK, 0);
+
+  // reads of a whole chunk go on until there's nothing left to read
+  std::string chunk(4096, 'a');
+  std::size_t output = 0;
+  for (int sent = 0; sent < typed; ) {
+    ssize_t r = write(ptys[0].master, chunk.data(), std::min<std::size_t>(chunk.size(), typed - sent));
+    if (r > 0) sent += r;
+    else std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    output += ptys[0].drain().size();
+  }
+  ASSERT_TRUE(waitFor(reactor, ptys, 0, &output));
+  // the app exited, the session wasn't dropped for a read that would block
+  EXPECT_EQ(keys, typed);
+}
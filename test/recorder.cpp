@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+#include "../src/term-react/termbox/termbox.h"
+
+// recordings of a headless context, termbox itself comes from termbox-input.cpp
+
+class RecorderTest : public ::testing::Test {
+protected:
+  std::string recording, cast;
+  tb_context *context;
+
+  void SetUp() override {
+    setenv("TERM", "xterm", 1);
+    std::string prefix = "/tmp/term-react-recorder-" + std::to_string(getpid());
+    recording = prefix + ".rec";
+    cast = prefix + ".cast";
+    unlink(recording.c_str());
+    context = tb_context_new();
+    tb_select_context(context);
+    ASSERT_EQ(tb_init_headless(20, 4), 0);
+  }
+
+  void TearDown() override {
+    if (tb_width() >= 0) tb_shutdown();
+    tb_select_context(nullptr);
+    tb_context_free(context);
+    unlink(recording.c_str());
+    unlink(cast.c_str());
+  }
+
+  void print(int x, int y, const std::string& text) {
+    for (char c : text) tb_change_cell(x++, y, c, TB_DEFAULT, TB_DEFAULT);
+  }
+
+  // a few frames, one of which changes nothing
+  void play() {
+    tb_clear();
+    print(0, 0, "hello");
+    tb_present();
+    tb_present();
+    print(0, 3, "world");
+    tb_present();
+    tb_scroll(0, 0, 20, 4, 1);
+    tb_present();
+  }
+
+  static std::vector<std::string> lines(const std::string& path) {
+    std::ifstream in{path};
+    std::vector<std::string> result;
+    std::string line;
+    while (std::getline(in, line)) result.push_back(line);
+    return result;
+  }
+
+  static long size(const std::string& path) {
+    std::ifstream in{path, std::ios::ate | std::ios::binary};
+    return static_cast<long>(in.tellg());
+  }
+
+  // what the cast sends the terminal, without the times
+  static std::string output(const std::vector<std::string>& cast) {
+    std::string result;
+    for (std::size_t i = 1; i < cast.size(); i++) {
+      result += cast[i].substr(cast[i].find(','));
+    }
+    return result;
+  }
+};
+
+TEST_F(RecorderTest, exported_cast_replays_the_frames) {
+  ASSERT_EQ(tb_record(recording.c_str(), 0, 0), 0);
+  EXPECT_EQ(tb_record(recording.c_str(), 0, 0), -EBUSY);
+  play();
+  tb_stop_recording();
+
+  ASSERT_EQ(tb_export_asciicast(recording.c_str(), cast.c_str()), 0);
+  auto events = lines(cast);
+  ASSERT_EQ(events.size(), 4u);
+  EXPECT_EQ(events[0].find("{\"version\": 2, \"width\": 20, \"height\": 4"), 0u);
+  EXPECT_NE(events[1].find("hello"), std::string::npos);
+  EXPECT_NE(events[2].find("world"), std::string::npos);
+  // scrolled by the terminal, the exposed row is all that's painted
+  EXPECT_NE(events[3].find("\\u001b[1;4r"), std::string::npos);
+  EXPECT_EQ(events[3].find("hello"), std::string::npos);
+}
+
+TEST_F(RecorderTest, compressed_recording_is_smaller) {
+  ASSERT_EQ(tb_record(recording.c_str(), 0, 0), 0);
+  play();
+  tb_stop_recording();
+  ASSERT_EQ(tb_export_asciicast(recording.c_str(), cast.c_str()), 0);
+  auto plain = lines(cast);
+  long plain_size = size(recording);
+
+  unlink(recording.c_str());
+  ASSERT_EQ(tb_record(recording.c_str(), 0, TB_RECORD_COMPRESS), 0);
+  play();
+  tb_stop_recording();
+  ASSERT_EQ(tb_export_asciicast(recording.c_str(), cast.c_str()), 0);
+  EXPECT_LT(size(recording) * 2, plain_size);
+  EXPECT_EQ(output(lines(cast)), output(plain));
+}
+
+TEST_F(RecorderTest, not_a_recording) {
+  FILE *f = fopen(recording.c_str(), "w");
+  fputs("nothing to see", f);
+  fclose(f);
+  EXPECT_EQ(tb_export_asciicast(recording.c_str(), cast.c_str()), -EINVAL);
+}
@@ -0,0 +1,100 @@
+#include "gtest/gtest.h"
+#include <string>
+#include <functional>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/end-component.hpp"
+
+// counts how many times children get re-rendered when their parent re-renders
+// with handlers that didn't really change
+
+using namespace termreact;
+
+enum class Tick { Tick };
+
+INIT_REDUCER(tickReducer, () { return 0; });
+REDUCER(tickReducer, (Tick::Tick), (int prev) { return prev + 1; });
+
+DECL_STORE(RenderCountStore, (int, ticks, tickReducer));
+
+static int std_function_renders = 0;
+static int callback_renders = 0;
+static int creator_calls = 0;
+
+CREATE_END_COMPONENT_CLASS(StdFunctionLeaf) {
+  DECL_END_PROPS((std::function<void()>, onTick));
+  MAP_STATE_TO_END_PROPS();
+public:
+  END_COMPONENT_WILL_MOUNT(StdFunctionLeaf) {}
+  END_COMPONENT_WILL_UNMOUNT(StdFunctionLeaf) {}
+  END_COMPONENT_WILL_UPDATE(next_props) { (void)next_props; std_function_renders++; }
+  CanvasSlice present(CanvasSlice canvas) { return canvas; }
+};
+
+CREATE_END_COMPONENT_CLASS(CallbackLeaf) {
+  DECL_END_PROPS((Callback<void()>, onTick));
+  MAP_STATE_TO_END_PROPS();
+public:
+  END_COMPONENT_WILL_MOUNT(CallbackLeaf) {}
+  END_COMPONENT_WILL_UNMOUNT(CallbackLeaf) {}
+  END_COMPONENT_WILL_UPDATE(next_props) { (void)next_props; callback_renders++; }
+  CanvasSlice present(CanvasSlice canvas) { return canvas; }
+};
+
+constexpr int leaves = 100;
+constexpr int ticks = 50;
+
+#define RENDER_COUNT_APP(name, Leaf) \
+  CREATE_COMPONENT_CLASS(name) { \
+    DECL_PROPS((int, ticks)); \
+    MAP_STATE_TO_PROPS((ticks, STATE_FIELD(ticks))); \
+    void handler() {} \
+    void render_() override { \
+      RENDER_COMPONENT(Leaf, ATTRIBUTES()) { \
+        creator_calls++; \
+        for (int i = 0; i < leaves; i++) { \
+          RENDER_COMPONENT(Leaf, std::to_string(i), ATTRIBUTES( \
+            (onTick, [this] () { this->handler(); }) \
+          )) { NO_CHILDREN }; \
+        } \
+      }; \
+    } \
+  public: \
+    COMPONENT_WILL_MOUNT(name) {} \
+    COMPONENT_WILL_UNMOUNT(name) {} \
+    COMPONENT_WILL_UPDATE(next_props) { (void)next_props; } \
+  }
+
+RENDER_COUNT_APP(StdFunctionApp, StdFunctionLeaf);
+RENDER_COUNT_APP(CallbackApp, CallbackLeaf);
+
+template <template <typename> class C>
+static void run() {
+  RenderCountStore store;
+  store.startChunkDispatch();
+  auto root = details::createComponent<C<RenderCountStore>>(typename C<RenderCountStore>::Properties{}, store);
+  store.endChunkDispatch();
+  store.addListener([&root] (const RenderCountStore::StateType&, const RenderCountStore::StateType& next_state) {
+    root->onStoreUpdate(static_cast<const void*>(&next_state));
+  }, false);
+
+  for (int i = 0; i < ticks; i++) {
+    store.dispatch<ACTION(Tick::Tick)>();
+  }
+}
+
+TEST(RenderCountTest, stable_callbacks_skip_rerenders) {
+  std_function_renders = callback_renders = 0;
+  run<StdFunctionApp>();
+  run<CallbackApp>();
+
+  // every std::function looks new, and so do the children of the wrapping leaf
+  EXPECT_EQ(std_function_renders, ticks * (leaves + 1));
+  EXPECT_EQ(callback_renders, 0);
+}
+
+TEST(RenderCountTest, children_creator_runs_once_per_render) {
+  creator_calls = 0;
+  run<CallbackApp>();
+  // the first render plus one per tick
+  EXPECT_EQ(creator_calls, ticks + 1);
+}
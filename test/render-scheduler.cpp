@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include <memory>
+#include <vector>
+#include "../src/term-react/component.hpp"
+
+using namespace termreact;
+using details::RenderScheduler;
+
+// renders the components given to it, the way nodes render their children
+class CountingComponent : public details::ComponentBase {
+protected:
+  void render_() override {
+    renders++;
+    for (auto child : children) child->render();
+  }
+  void present_(CanvasSlice, bool) override {}
+
+public:
+  int renders = 0;
+  std::vector<CountingComponent*> children;
+
+  void onStoreUpdate(const void*) override {}
+};
+
+class RenderSchedulerTest : public ::testing::Test {
+protected:
+  RenderScheduler scheduler;
+
+  void SetUp() override { scheduler.activate(); }
+  void TearDown() override { scheduler.deactivate(); }
+};
+
+TEST_F(RenderSchedulerTest, renders_synchronously_when_inactive) {
+  scheduler.deactivate();
+  CountingComponent c;
+  c.render();
+  EXPECT_EQ(c.renders, 1);
+  EXPECT_EQ(RenderScheduler::current(), nullptr);
+}
+
+TEST_F(RenderSchedulerTest, defers_and_dedupes) {
+  CountingComponent c;
+  c.render();
+  c.render();
+  EXPECT_EQ(c.renders, 0);
+  EXPECT_FALSE(scheduler.idle());
+  EXPECT_TRUE(scheduler.run([] () { return false; }));
+  EXPECT_EQ(c.renders, 1);
+}
+
+TEST_F(RenderSchedulerTest, yields_and_resumes_children) {
+  CountingComponent root, a, b;
+  root.children = {&a, &b};
+  root.render();
+
+  // one unit per slice
+  EXPECT_FALSE(scheduler.run([] () { return true; }));
+  EXPECT_EQ(root.renders, 1);
+  EXPECT_EQ(a.renders, 0);
+  EXPECT_FALSE(scheduler.run([] () { return true; }));
+  EXPECT_EQ(a.renders, 1);
+  EXPECT_EQ(b.renders, 0);
+  EXPECT_TRUE(scheduler.run([] () { return true; }));
+  EXPECT_EQ(b.renders, 1);
+}
+
+TEST_F(RenderSchedulerTest, unmounted_components_are_dropped) {
+  auto c = std::make_unique<CountingComponent>();
+  c->render();
+  c.reset();
+  EXPECT_TRUE(scheduler.idle());
+  EXPECT_TRUE(scheduler.run([] () { return false; }));
+}
+
+TEST_F(RenderSchedulerTest, unmounted_components_are_dropped_without_a_current_scheduler) {
+  auto c = std::make_unique<CountingComponent>();
+  c->render();
+  // the app unmounting it between two frames
+  auto previous = RenderScheduler::select(nullptr);
+  c.reset();
+  RenderScheduler::select(previous);
+  EXPECT_TRUE(scheduler.idle());
+  EXPECT_TRUE(scheduler.run([] () { return false; }));
+}
+
+TEST(DeferredMountsTest, unmounted_components_are_not_mounted) {
+  details::DeferredMounts mounts;
+  auto c = std::make_unique<CountingComponent>();
+  CountingComponent d;
+  // none of them current
+  mounts.add(c.get());
+  mounts.add(&d);
+  mounts.add(&d);
+  c.reset();
+  EXPECT_TRUE(mounts.mount());
+  EXPECT_EQ(d.renders, 1);
+  EXPECT_FALSE(mounts.mount());
+}
@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../src/term-react/store.hpp"
+#include "../src/term-react/components/box.hpp"
+#include "../src/term-react/termbox.hpp"
+#include "pty.hpp"
+
+// a pty resized a few times in a row, laid out for once
+
+using namespace termreact;
+
+DECL_STORE(ResizeStore, );
+
+CREATE_COMPONENT_CLASS(ResizeApp) {
+  DECL_PROPS((int, width));
+  MAP_STATE_TO_PROPS((width, STATE_FIELD(window_width)));
+  void render_() override {
+    RENDER_COMPONENT(Box, ATTRIBUTES((text, "width " + std::to_string(PROPS(width))))) { NO_CHILDREN };
+  }
+public:
+  COMPONENT_WILL_MOUNT(ResizeApp) {}
+  COMPONENT_WILL_UNMOUNT(ResizeApp) {}
+  COMPONENT_WILL_UPDATE(next_props) { (void)next_props; }
+};
+
+class ResizeTest : public PtyContextTest {
+protected:
+  ResizeTest() : PtyContextTest{20, 4, false} {}
+};
+
+TEST_F(ResizeTest, resizes_in_the_debounce_window_are_laid_out_for_once) {
+  ResizeStore store;
+  Termbox termbox{store, context, pty.openSlave()};
+  termbox.setResizeDebounce(std::chrono::milliseconds{100});
+  termbox.render<ResizeApp>(store, [] (const ResizeStore::StateType&) { return false; });
+  std::vector<std::pair<int, int>> sizes;
+  store.addListener([&sizes] (const ResizeStore::StateType& state, const ResizeStore::StateType& next_state) {
+    int width = next_state.get<ResizeStore::Field::window_width>();
+    int height = next_state.get<ResizeStore::Field::window_height>();
+    if (width != state.get<ResizeStore::Field::window_width>() ||
+        height != state.get<ResizeStore::Field::window_height>()) {
+      sizes.emplace_back(width, height);
+    }
+  }, false);
+  termbox.step(std::chrono::microseconds{0});
+  EXPECT_EQ(store.get<ResizeStore::Field::window_width>(), 20);
+
+  // a step in between each, and several notifications for the last one
+  for (int width : {30, 40, 50}) {
+    pty.resize(width, width / 10);
+    tb_notify_resize(context);
+    if (width == 50) tb_notify_resize(context);
+    termbox.step(std::chrono::microseconds{0});
+  }
+  EXPECT_TRUE(sizes.empty());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds{150});
+  termbox.step(std::chrono::microseconds{0});
+  ASSERT_EQ(sizes.size(), 1u);
+  EXPECT_EQ(sizes[0], std::make_pair(50, 5));
+
+  // the notifications left nothing behind in the pipe
+  std::this_thread::sleep_for(std::chrono::milliseconds{150});
+  termbox.step(std::chrono::microseconds{0});
+  tb_event event;
+  EXPECT_EQ(tb_peek_event(&event, 0), 0);
+  EXPECT_EQ(sizes.size(), 1u);
+}
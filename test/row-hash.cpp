@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+#include <string>
+#include "pty.hpp"
+
+// rows skipped or scrolled by tb_present() as told by their hashes, and what that sends a pty
+
+static const std::string e_acute = "e\xcc\x81";
+
+class RowHashTest : public PtyContextTest {
+protected:
+  RowHashTest() : PtyContextTest{20, 8} {}
+
+  static void print(int x, int y, const std::string& text) {
+    for (char c : text) tb_change_cell(x++, y, c, TB_DEFAULT, TB_DEFAULT);
+  }
+
+  // the rows [top, bottom) showing items from 'first' on, each after a cluster that is added to
+  // the pool again on every frame
+  static void items(int top, int bottom, int first) {
+    for (int y = top; y < bottom; y++) {
+      tb_change_cluster(0, y, e_acute.data(), e_acute.size(), TB_DEFAULT, TB_DEFAULT);
+      print(2, y, "item " + std::to_string(first + y - top));
+    }
+  }
+
+  std::string present() {
+    tb_present();
+    return drain();
+  }
+};
+
+TEST_F(RowHashTest, unchanged_rows_are_skipped_and_changed_fields_are_not) {
+  print(0, 0, "abc");
+  present();
+  tb_clear();
+  print(0, 0, "abc");
+  EXPECT_EQ(present().find("abc"), std::string::npos);
+
+  tb_change_cell(1, 0, 'b', TB_DEFAULT, TB_BLUE);
+  EXPECT_NE(present().find("b"), std::string::npos);
+  tb_change_cell(1, 0, 'b', TB_RED, TB_BLUE);
+  EXPECT_NE(present().find("b"), std::string::npos);
+}
+
+TEST_F(RowHashTest, rows_moving_up_between_fixed_ones_are_scrolled) {
+  print(0, 0, "header");
+  items(1, 7, 10);
+  print(0, 7, "footer");
+  present();
+
+  tb_clear();
+  print(0, 0, "header");
+  items(1, 7, 12);
+  print(0, 7, "footer");
+  std::string out = present();
+  // rows 2 to 7 go up by 2, the 2 they expose are painted
+  EXPECT_EQ(out.find("\033[2;7r\033[2;1H\033[2M\033[r"), 0u);
+  EXPECT_NE(out.find("item 16"), std::string::npos);
+  EXPECT_NE(out.find("item 17"), std::string::npos);
+  EXPECT_EQ(out.find("item 12"), std::string::npos);
+  EXPECT_EQ(out.find("header"), std::string::npos);
+  EXPECT_EQ(out.find("footer"), std::string::npos);
+}
+
+TEST_F(RowHashTest, rows_moving_down_are_scrolled) {
+  items(0, 8, 10);
+  present();
+  tb_clear();
+  items(0, 8, 9);
+  std::string out = present();
+  EXPECT_EQ(out.find("\033[1;8r\033[1;1H\033[1L\033[r"), 0u);
+  EXPECT_NE(out.find("item 9"), std::string::npos);
+  EXPECT_EQ(out.find("item 10"), std::string::npos);
+}
+
+TEST_F(RowHashTest, repeated_rows_dont_vote) {
+  // blank rows look the same wherever they are
+  print(0, 7, "x");
+  present();
+  tb_clear();
+  print(0, 0, "y");
+  std::string out = present();
+  EXPECT_EQ(out.find("\033[r"), std::string::npos);
+  EXPECT_NE(out.find("y"), std::string::npos);
+}
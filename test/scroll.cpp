@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include <string>
+#include "../src/term-react/canvas.hpp"
+#include "pty.hpp"
+
+// areas scrolled with tb_scroll() and what that sends a pty
+
+using namespace termreact;
+
+class ScrollTest : public PtyContextTest {
+protected:
+  ScrollTest() : PtyContextTest{20, 6} {}
+
+  static void print(int x, int y, const std::string& text) {
+    for (char c : text) tb_change_cell(x++, y, c, TB_DEFAULT, TB_DEFAULT);
+  }
+
+  // row y showing "row y" everywhere
+  static void rows() {
+    for (int y = 0; y < tb_height(); y++) print(0, y, "row " + std::to_string(y));
+  }
+
+  static std::string row(int y, int width = 5) {
+    std::string chars;
+    for (int x = 0; x < width; x++) chars += static_cast<char>(tb_cell_buffer()[y * tb_width() + x].ch);
+    return chars;
+  }
+
+  std::string present() {
+    tb_present();
+    return drain();
+  }
+};
+
+// the screen, like TermboxCanvas
+class ScreenCanvas : public Canvas {
+public:
+  int getWidth() const override { return tb_width(); }
+  int getHeight() const override { return tb_height(); }
+  void clear(uint16_t = 0, uint16_t = 0) override {}
+  void setCell(int x, int y, uint32_t ch, uint16_t fg = 0, uint16_t bg = 0) override {
+    tb_change_cell(x, y, ch, fg, bg);
+  }
+  void present() override {}
+  void scroll(int x, int y, int w, int h, int dy) override { tb_scroll(x, y, w, h, dy); }
+};
+
+TEST_F(ScrollTest, whole_rows_are_scrolled_by_the_terminal) {
+  rows();
+  present();
+  tb_scroll(0, 1, 20, 4, 2);
+  EXPECT_EQ(row(1), "row 3");
+  EXPECT_EQ(row(2), "row 4");
+  EXPECT_EQ(row(3), "     ");
+  EXPECT_EQ(row(5), "row 5");
+  std::string out = present();
+  EXPECT_EQ(out.find("\033[2;5r\033[2;1H\033[2M\033[r"), 0u);
+  // the rows moved were shifted in the front buffer too, only the exposed ones are painted
+  EXPECT_EQ(out.find("row"), std::string::npos);
+  EXPECT_NE(out.find("     "), std::string::npos);
+  EXPECT_EQ(present(), "");
+
+  tb_scroll(0, 0, 20, 3, -1);
+  out = present();
+  EXPECT_EQ(out.find("\033[1;3r\033[1;1H\033[1L\033[r"), 0u);
+  EXPECT_EQ(row(0), "     ");
+  EXPECT_EQ(row(1), "row 0");
+  EXPECT_EQ(out.find("row"), std::string::npos);
+  EXPECT_EQ(present(), "");
+}
+
+TEST_F(ScrollTest, part_of_a_row_is_repainted) {
+  rows();
+  // the rows don't just move as a whole
+  for (int y = 0; y < tb_height(); y++) tb_change_cell(15, y, '0' + y, TB_DEFAULT, TB_DEFAULT);
+  present();
+  tb_scroll(0, 0, 10, 6, 1);
+  EXPECT_EQ(row(0), "row 1");
+  std::string out = present();
+  EXPECT_EQ(out.find("\033[r"), std::string::npos);
+  EXPECT_NE(out.find("1"), std::string::npos);
+  EXPECT_EQ(present(), "");
+}
+
+TEST_F(ScrollTest, slices_only_scroll_what_is_in_them) {
+  rows();
+  present();
+  ScreenCanvas screen;
+  auto slice = screen.slice(0, 2, 20, 3).slice(0, -1, 20, 10);
+  // asked for rows 1 to 10, only gets rows 2 to 4
+  slice.scroll(0, 0, 20, 10, 1);
+  EXPECT_EQ(row(1), "row 1");
+  EXPECT_EQ(row(2), "row 3");
+  EXPECT_EQ(row(3), "row 4");
+  EXPECT_EQ(row(4), "     ");
+  EXPECT_EQ(row(5), "row 5");
+  EXPECT_EQ(present().find("\033[3;5r\033[3;1H\033[1M\033[r"), 0u);
+}
@@ -0,0 +1,199 @@
+#include "gtest/gtest.h"
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "pty.hpp"
+
+// a headless context served to a viewer attached from a pty
+
+class SessionTest : public ::testing::Test {
+protected:
+  std::string path;
+  tb_context *server;
+  tb_context *viewer;
+  Pty pty{30, 6};
+  std::thread viewer_thread;
+  int attach_result;
+  // the viewer's screen once it's detached
+  std::vector<tb_cell> viewer_cells;
+
+  void SetUp() override {
+    setenv("TERM", "xterm", 1);
+    path = "/tmp/term-react-session-" + std::to_string(getpid()) + ".sock";
+    server = tb_context_new();
+    tb_select_context(server);
+    ASSERT_EQ(tb_init_headless(20, 5), 0);
+    ASSERT_EQ(tb_listen(path.c_str()), 0);
+    viewer = tb_context_new();
+  }
+
+  void TearDown() override {
+    if (viewer_thread.joinable()) viewer_thread.join();
+    tb_context_free(viewer);
+    if (tb_width() >= 0) tb_shutdown();
+    tb_select_context(nullptr);
+    tb_context_free(server);
+  }
+
+  void attach() {
+    // the viewer closes it when it's done
+    int slave = pty.openSlave();
+    viewer_thread = std::thread{[this, slave] () {
+      tb_select_context(viewer);
+      tb_init_fd(slave);
+      attach_result = tb_attach(path.c_str());
+      viewer_cells.assign(tb_cell_buffer(), tb_cell_buffer() + tb_width() * tb_height());
+      tb_shutdown();
+    }};
+  }
+
+  // the next event the server gets, skipping the wakeups
+  tb_event next() {
+    tb_event event{};
+    int type;
+    while ((type = tb_peek_event(&event, 5000)) == TB_EVENT_WAKEUP) {}
+    EXPECT_GT(type, 0);
+    return event;
+  }
+
+  // a viewer speaking the protocol by hand
+  int connectRaw() {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    EXPECT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    return fd;
+  }
+
+  // a header saying 'len' bytes follow, and 'data' if given
+  static std::string message(uint32_t type, uint32_t len, const void *data = nullptr) {
+    const uint32_t header[] = {type, len};
+    std::string bytes(reinterpret_cast<const char*>(header), sizeof(header));
+    if (data) bytes.append(static_cast<const char*>(data), len);
+    return bytes;
+  }
+
+  const tb_cell& viewerCell(int x, int y) {
+    return viewer_cells[y * (viewer_cells.size() / 6) + x];
+  }
+};
+
+TEST_F(SessionTest, viewer_mirrors_the_screen) {
+  // one server per socket
+  tb_context *other = tb_context_new();
+  tb_select_context(other);
+  ASSERT_EQ(tb_init_headless(10, 2), 0);
+  EXPECT_EQ(tb_listen(path.c_str()), -EADDRINUSE);
+  tb_shutdown();
+  tb_select_context(server);
+  tb_context_free(other);
+
+  attach();
+  // the headless screen takes the size of the viewer
+  tb_event event = next();
+  ASSERT_EQ(event.type, TB_EVENT_RESIZE);
+  EXPECT_EQ(event.w, 30);
+  EXPECT_EQ(event.h, 6);
+  tb_clear();
+  EXPECT_EQ(tb_width(), 30);
+  tb_change_cell(0, 0, 'a', TB_RED, TB_DEFAULT);
+  tb_present();
+
+  pty.type("x");
+  event = next();
+  EXPECT_EQ(event.type, TB_EVENT_KEY);
+  EXPECT_EQ(event.ch, uint32_t('x'));
+
+  tb_change_cell(29, 5, 'b', TB_DEFAULT, TB_BLUE);
+  uint16_t style = tb_style(0x123456, TB_RGB_DEFAULT, TB_ITALIC);
+  tb_change_cell(1, 0, 'c', style, TB_DEFAULT);
+  tb_present();
+  // the viewer reads everything sent before the server went away
+  tb_shutdown();
+  viewer_thread.join();
+  EXPECT_EQ(attach_result, 0);
+  EXPECT_EQ(viewerCell(0, 0).ch, uint32_t('a'));
+  EXPECT_EQ(viewerCell(0, 0).fg, TB_RED);
+  EXPECT_EQ(viewerCell(29, 5).ch, uint32_t('b'));
+  EXPECT_EQ(viewerCell(29, 5).bg, TB_BLUE);
+  // the same process, the style is the same one on both ends
+  EXPECT_EQ(viewerCell(1, 0).fg, style);
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+}
+
+TEST_F(SessionTest, detaching_leaves_the_server_running) {
+  attach();
+  ASSERT_EQ(next().type, TB_EVENT_RESIZE);
+  pty.type("\x1c");
+  viewer_thread.join();
+  EXPECT_EQ(attach_result, 0);
+
+  // a new viewer gets the screen as it is now
+  tb_clear();
+  tb_change_cell(1, 1, 'c', TB_DEFAULT, TB_DEFAULT);
+  tb_present();
+  attach();
+  ASSERT_EQ(next().type, TB_EVENT_RESIZE);
+  pty.type("\x1c");
+  viewer_thread.join();
+  EXPECT_EQ(attach_result, 0);
+  EXPECT_EQ(viewerCell(1, 1).ch, uint32_t('c'));
+}
+
+TEST_F(SessionTest, viewers_sending_garbage_are_dropped) {
+  tb_event bogus{};
+  bogus.type = 9;
+  // a length that overflows an int when the header is added, a message no viewer sends and an
+  // event of no type there is
+  const std::vector<std::string> garbage = {
+    message(3, 0xFFFFFFF8u), message(1, 1u << 20), message(3, sizeof(bogus), &bogus)
+  };
+  for (auto& bytes : garbage) {
+    int fd = connectRaw();
+    ASSERT_EQ(write(fd, bytes.data(), bytes.size()), ssize_t(bytes.size()));
+    tb_event event;
+    EXPECT_EQ(tb_peek_event(&event, 100), 0);
+    // hung up on, after the keyframe it was sent
+    char buf[4096];
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof(buf))) > 0) {}
+    EXPECT_EQ(r, 0);
+    close(fd);
+  }
+
+  // the others are still served
+  attach();
+  ASSERT_EQ(next().type, TB_EVENT_RESIZE);
+  pty.type("\x1c");
+  viewer_thread.join();
+  EXPECT_EQ(attach_result, 0);
+}
+
+TEST_F(SessionTest, viewer_sizes_are_clamped) {
+  int fd = connectRaw();
+  tb_event resize{};
+  resize.type = TB_EVENT_RESIZE;
+  resize.w = 1 << 30;
+  resize.h = 3;
+  std::string bytes = message(3, sizeof(resize), &resize);
+  ASSERT_EQ(write(fd, bytes.data(), bytes.size()), ssize_t(bytes.size()));
+  tb_event event = next();
+  EXPECT_EQ(event.type, TB_EVENT_RESIZE);
+  EXPECT_EQ(event.w, 1024);
+  tb_clear();
+  EXPECT_EQ(tb_width(), 1024);
+  EXPECT_EQ(tb_height(), 3);
+  close(fd);
+}
+
+TEST_F(SessionTest, only_the_owner_may_attach) {
+  struct stat st;
+  ASSERT_EQ(stat(path.c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0777, 0600u);
+}
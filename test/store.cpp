@@ -0,0 +1,243 @@
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "../src/term-react/store.hpp"
+
+using namespace termreact;
+
+// counts the copies made of a payload on its way to the reducers
+struct Rows {
+  static int copies;
+  std::vector<int> rows;
+
+  Rows(std::vector<int> r) : rows(std::move(r)) {}
+  Rows(const Rows& other) : rows(other.rows) { copies++; }
+  Rows(Rows&&) = default;
+  Rows& operator=(const Rows& other) { rows = other.rows; copies++; return *this; }
+  Rows& operator=(Rows&&) = default;
+};
+int Rows::copies = 0;
+
+enum class StoreTestAction { Load, Append };
+
+INIT_REDUCER(rowCountReducer, () { return std::size_t{0}; });
+REDUCER(rowCountReducer, (StoreTestAction::Load), (std::size_t, const Rows& rows) {
+  return rows.rows.size();
+});
+REDUCER(rowCountReducer, (StoreTestAction::Append), (std::size_t prev, const Rows& rows) {
+  return prev + rows.rows.size();
+});
+
+INIT_REDUCER(rowSumReducer, () { return 0; });
+REDUCER(rowSumReducer, (StoreTestAction::Load), (int, const Rows& rows) {
+  int sum = 0;
+  for (auto r : rows.rows) sum += r;
+  return sum;
+});
+
+// takes its payload by value, so it gets its own copy
+INIT_REDUCER(lastRowsReducer, () { return std::vector<int>{}; });
+REDUCER(lastRowsReducer, (StoreTestAction::Append), (std::vector<int>, Rows rows) {
+  return std::move(rows.rows);
+});
+
+DECL_STORE(PayloadStore,
+  (std::size_t, row_count, rowCountReducer)
+  (int, row_sum, rowSumReducer)
+  (std::vector<int>, last_rows, lastRowsReducer)
+);
+
+TEST(StoreTest, rvalue_payload_is_never_copied) {
+  PayloadStore store;
+  Rows::copies = 0;
+  store.dispatch<ACTION(StoreTestAction::Load)>(Rows{std::vector<int>(10000, 1)});
+  EXPECT_EQ(Rows::copies, 0);
+  EXPECT_EQ(store.get<PayloadStore::Field::row_count>(), 10000u);
+  EXPECT_EQ(store.get<PayloadStore::Field::row_sum>(), 10000);
+}
+
+TEST(StoreTest, lvalue_payload_is_copied_once) {
+  PayloadStore store;
+  Rows rows{std::vector<int>(10, 2)};
+  Rows::copies = 0;
+  store.dispatch<ACTION(StoreTestAction::Load)>(rows);
+  EXPECT_EQ(Rows::copies, 1);
+
+  Rows::copies = 0;
+  store.dispatch<ACTION(StoreTestAction::Load)>(std::cref(rows));
+  EXPECT_EQ(Rows::copies, 0);
+  EXPECT_EQ(store.get<PayloadStore::Field::row_sum>(), 20);
+}
+
+TEST(StoreTest, by_value_reducers_still_work) {
+  PayloadStore store;
+  Rows::copies = 0;
+  store.dispatch<ACTION(StoreTestAction::Append)>(Rows{std::vector<int>{1, 2, 3}});
+  store.dispatch<ACTION(StoreTestAction::Append)>(Rows{std::vector<int>{4, 5}});
+  // one copy per dispatch for the reducer taking it by value only
+  EXPECT_EQ(Rows::copies, 2);
+  EXPECT_EQ(store.get<PayloadStore::Field::row_count>(), 5u);
+  EXPECT_EQ(store.get<PayloadStore::Field::last_rows>(), (std::vector<int>{4, 5}));
+}
+
+enum class InPlaceAction { Append };
+
+INIT_REDUCER(copyRowsReducer, () { return Rows{{}}; });
+REDUCER(copyRowsReducer, (InPlaceAction::Append), (Rows prev, const Rows& more) {
+  prev.rows.insert(prev.rows.end(), more.rows.begin(), more.rows.end());
+  return prev;
+});
+
+INIT_REDUCER(moveRowsReducer, () { return Rows{{}}; });
+REDUCER(moveRowsReducer, (InPlaceAction::Append), (Rows&& prev, const Rows& more) {
+  prev.rows.insert(prev.rows.end(), more.rows.begin(), more.rows.end());
+  return std::move(prev);
+});
+
+INIT_REDUCER(inPlaceRowsReducer, () { return Rows{{}}; });
+REDUCER(inPlaceRowsReducer, (InPlaceAction::Append), (Rows& rows, const Rows& more) {
+  rows.rows.insert(rows.rows.end(), more.rows.begin(), more.rows.end());
+});
+
+DECL_STORE(CopyRowsStore, (Rows, rows, copyRowsReducer));
+DECL_STORE(MoveRowsStore, (Rows, rows, moveRowsReducer));
+DECL_STORE(InPlaceRowsStore, (Rows, rows, inPlaceRowsReducer));
+
+template <typename StoreT>
+static int appendCopies(StoreT& store) {
+  int changes = 0;
+  store.addListener([&changes] (const typename StoreT::StateType& prev, const typename StoreT::StateType& next) {
+    // the previous state is left untouched for listeners
+    EXPECT_EQ(prev.template get<StoreT::Field::rows>().rows.size() + 2,
+              next.template get<StoreT::Field::rows>().rows.size());
+    changes++;
+  }, false);
+
+  Rows::copies = 0;
+  for (int i = 0; i < 10; i++) {
+    store.template dispatch<ACTION(InPlaceAction::Append)>(Rows{std::vector<int>{i, i}});
+  }
+  int copies = Rows::copies;
+  EXPECT_EQ(changes, 10);
+  EXPECT_EQ(store.template get<StoreT::Field::rows>().rows.size(), 20u);
+  return copies;
+}
+
+TEST(StoreTest, reducers_consuming_prev) {
+  CopyRowsStore copy_store;
+  MoveRowsStore move_store;
+  InPlaceRowsStore in_place_store;
+  // by value: the copy handed to the reducer plus the copy-on-write of the state
+  EXPECT_EQ(appendCopies(copy_store), 20);
+  // otherwise only the state is copied, since the listener keeps the previous one
+  EXPECT_EQ(appendCopies(move_store), 10);
+  EXPECT_EQ(appendCopies(in_place_store), 10);
+}
+
+TEST(StoreTest, reducers_consuming_prev_without_listeners) {
+  CopyRowsStore copy_store;
+  MoveRowsStore move_store;
+  InPlaceRowsStore in_place_store;
+  auto append = [] (auto& store) {
+    Rows::copies = 0;
+    for (int i = 0; i < 10; i++) {
+      store.template dispatch<ACTION(InPlaceAction::Append)>(Rows{std::vector<int>{i, i}});
+    }
+    return Rows::copies;
+  };
+  // the state is owned by the store alone, only the by value reducer copies
+  EXPECT_EQ(append(copy_store), 10);
+  EXPECT_EQ(append(move_store), 0);
+  EXPECT_EQ(append(in_place_store), 0);
+  EXPECT_EQ(in_place_store.get<InPlaceRowsStore::Field::rows>().rows.size(), 20u);
+}
+
+enum class LaneAction { Log };
+
+INIT_REDUCER(laneLogReducer, () { return std::vector<int>{}; });
+REDUCER(laneLogReducer, (LaneAction::Log), (std::vector<int>& log, int v) {
+  log.push_back(v);
+});
+
+DECL_STORE(LaneStore, (std::vector<int>, log, laneLogReducer));
+
+TEST(StoreTest, higher_lanes_go_first) {
+  LaneStore store;
+  store.startChunkDispatch();
+  store.dispatch<ACTION(LaneAction::Log)>(1);
+  store.dispatchAt<ACTION(LaneAction::Log)>(DispatchPriority::Background, 2);
+  store.dispatch<ACTION(LaneAction::Log)>(3);
+  store.dispatchAt<ACTION(LaneAction::Log)>(DispatchPriority::Immediate, 4);
+  store.endChunkDispatch();
+  EXPECT_EQ(store.get<LaneStore::Field::log>(), (std::vector<int>{4, 1, 3}));
+  EXPECT_EQ(store.pendingDispatches(DispatchPriority::Background), 1u);
+}
+
+TEST(StoreTest, background_dispatches_are_coalesced) {
+  LaneStore store;
+  int updates = 0;
+  store.addListener([&updates] (const LaneStore::StateType& prev, const LaneStore::StateType& next) {
+    EXPECT_EQ(prev.get<LaneStore::Field::log>().size() + 1000, next.get<LaneStore::Field::log>().size());
+    updates++;
+  }, false);
+
+  for (int i = 0; i < 1000; i++) {
+    store.dispatchAt<ACTION(LaneAction::Log)>(DispatchPriority::Background, i);
+  }
+  EXPECT_EQ(updates, 0);
+  store.flushBackground();
+  EXPECT_EQ(updates, 1);
+  EXPECT_EQ(store.pendingDispatches(DispatchPriority::Background), 0u);
+  EXPECT_EQ(store.get<LaneStore::Field::log>().back(), 999);
+
+  // nothing to flush, nothing to update
+  store.flushBackground();
+  EXPECT_EQ(updates, 1);
+}
+
+enum class PostAction { Add };
+
+INIT_REDUCER(postSumReducer, () { return 0l; });
+REDUCER(postSumReducer, (PostAction::Add), (long prev, int v) { return prev + v; });
+
+INIT_REDUCER(postCountReducer, () { return 0; });
+REDUCER(postCountReducer, (PostAction::Add), (int prev, int) { return prev + 1; });
+
+DECL_STORE(PostStore,
+  (long, sum, postSumReducer)
+  (int, count, postCountReducer)
+);
+
+TEST(StoreTest, post_dispatch_from_8_producers) {
+  constexpr int producers = 8;
+  constexpr int per_producer = 20000;
+  PostStore store;
+  std::atomic<int> wakeups{0};
+  store.setPostWakeup([&wakeups] () { wakeups++; });
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&store] () {
+      for (int i = 1; i <= per_producer; i++) {
+        store.postDispatch<ACTION(PostAction::Add)>(i);
+      }
+    });
+  }
+
+  // the ui thread, draining in batches while the producers are running
+  int drains = 0;
+  while (store.get<PostStore::Field::count>() < producers * per_producer) {
+    store.drainPosted(256);
+    drains++;
+  }
+  for (auto& t : threads) t.join();
+
+  EXPECT_EQ(store.drainPosted(), 0u);
+  drains++;
+  EXPECT_EQ(store.get<PostStore::Field::sum>(), long{producers} * per_producer * (per_producer + 1) / 2);
+  // wakeups are coalesced until the next drain
+  EXPECT_LE(wakeups.load(), drains + 1);
+  EXPECT_GT(wakeups.load(), 0);
+}
@@ -0,0 +1,82 @@
+#include "gtest/gtest.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include "pty.hpp"
+
+// styles and what they send a pty in each output mode
+
+class StyleTest : public PtyContextTest {
+protected:
+  // what painting a cell in 'style' sends the terminal
+  std::string paint(int mode, uint16_t style) {
+    tb_select_output_mode(mode);
+    tb_clear();
+    tb_present();
+    drain();
+    tb_change_cell(0, 0, 'x', style, TB_DEFAULT);
+    tb_present();
+    return drain();
+  }
+};
+
+TEST_F(StyleTest, styles_are_interned) {
+  uint16_t orange = tb_style(0xff8000, TB_RGB_DEFAULT, TB_BOLD);
+  EXPECT_TRUE(orange & TB_STYLE);
+  EXPECT_EQ(tb_style(0xff8000, TB_RGB_DEFAULT, TB_BOLD), orange);
+  EXPECT_NE(tb_style(0xff8000, TB_RGB_DEFAULT, 0), orange);
+  EXPECT_NE(tb_style(0xff8000, 0x000000, TB_BOLD), orange);
+
+  uint32_t fg, bg;
+  uint16_t attrs;
+  ASSERT_EQ(tb_style_info(orange, &fg, &bg, &attrs), 0);
+  EXPECT_EQ(fg, 0xff8000u);
+  EXPECT_EQ(bg, uint32_t(TB_RGB_DEFAULT));
+  EXPECT_EQ(attrs, TB_BOLD);
+  EXPECT_EQ(tb_style_info(TB_RED | TB_BOLD, &fg, &bg, &attrs), -1);
+}
+
+TEST_F(StyleTest, colors_are_downsampled_to_the_output_mode) {
+  uint16_t orange = tb_style(0xff8000, 0x808080, TB_BOLD | TB_STRIKE);
+  EXPECT_NE(paint(TB_OUTPUT_TRUECOLOR, orange).find("\033[0;1;9;38;2;255;128;0;48;2;128;128;128m"),
+            std::string::npos);
+  EXPECT_NE(paint(TB_OUTPUT_256, orange).find("\033[0;1;9;38;5;208;48;5;244m"), std::string::npos);
+  EXPECT_NE(paint(TB_OUTPUT_GRAYSCALE, orange).find("\033[0;1;9;38;5;246;48;5;244m"), std::string::npos);
+  EXPECT_NE(paint(TB_OUTPUT_NORMAL, orange).find("\033[0;1;9;33;47m"), std::string::npos);
+}
+
+TEST_F(StyleTest, unchanged_style_is_not_sent_again) {
+  uint16_t style = tb_style(0x00ff00, TB_RGB_DEFAULT, TB_ITALIC);
+  tb_select_output_mode(TB_OUTPUT_TRUECOLOR);
+  tb_change_cell(0, 0, 'a', style, TB_DEFAULT);
+  tb_change_cell(1, 0, 'b', style, TB_DEFAULT);
+  tb_change_cell(2, 0, 'c', TB_RED, TB_DEFAULT);
+  tb_present();
+  std::string out = drain();
+  const std::string sgr = "\033[0;3;38;2;0;255;0m";
+  auto first = out.find(sgr);
+  ASSERT_NE(first, std::string::npos);
+  EXPECT_EQ(out.find(sgr, first + 1), std::string::npos);
+  // the plain cell after it still gets its own colors
+  EXPECT_NE(out.find("\033[38;5;2m", first), std::string::npos);
+}
+
+TEST_F(StyleTest, recordings_carry_their_styles) {
+  std::string recording = "/tmp/term-react-style-" + std::to_string(getpid()) + ".rec";
+  std::string cast = recording + ".cast";
+  unlink(recording.c_str());
+  tb_shutdown();
+  ASSERT_EQ(tb_init_headless(20, 4), 0);
+  tb_select_output_mode(TB_OUTPUT_TRUECOLOR);
+  ASSERT_EQ(tb_record(recording.c_str(), 0, TB_RECORD_COMPRESS), 0);
+  tb_change_cell(0, 0, 'x', tb_style(0x0a0b0c, TB_RGB_DEFAULT, TB_UNDERLINE), TB_DEFAULT);
+  tb_present();
+  tb_stop_recording();
+  ASSERT_EQ(tb_export_asciicast(recording.c_str(), cast.c_str()), 0);
+
+  std::ifstream in{cast};
+  std::string contents{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+  EXPECT_NE(contents.find("\\u001b[0;4;38;2;10;11;12m\\u001b[1;1Hx"), std::string::npos);
+  unlink(recording.c_str());
+  unlink(cast.c_str());
+}
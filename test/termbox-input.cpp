@@ -0,0 +1,156 @@
+#include "gtest/gtest.h"
+#include <string>
+#include "../src/term-react/termbox/termbox.cpp"
+#include "../src/term-react/termbox/utf8.cpp"
+
+class TermboxInputTest: public ::testing::Test {
+protected:
+  tb_event event;
+  bool partial;
+
+  virtual void SetUp() {
+    key_trie_init(xterm_keys);
+  }
+
+  virtual void TearDown() {
+    key_trie_free();
+  }
+
+  int parse(const std::string& seq, bool timed_out = false) {
+    memset(&event, 0, sizeof(event));
+    event.type = TB_EVENT_KEY;
+    return parse_escape_seq(&event, seq.data(), seq.size(), timed_out, &partial);
+  }
+};
+
+TEST_F(TermboxInputTest, terminfo_keys) {
+  EXPECT_EQ(parse("\033OA"), 3);
+  EXPECT_EQ(event.key, TB_KEY_ARROW_UP);
+  EXPECT_EQ(parse("\033[15~"), 5);
+  EXPECT_EQ(event.key, TB_KEY_F5);
+  // trailing input is left alone
+  EXPECT_EQ(parse("\033[3~abc"), 4);
+  EXPECT_EQ(event.key, TB_KEY_DELETE);
+}
+
+TEST_F(TermboxInputTest, partial_sequences_wait) {
+  EXPECT_EQ(parse("\033"), 0);
+  EXPECT_TRUE(partial);
+  EXPECT_EQ(parse("\033O"), 0);
+  EXPECT_TRUE(partial);
+  EXPECT_EQ(parse("\033[1;5"), 0);
+  EXPECT_TRUE(partial);
+  EXPECT_EQ(parse("\033[<0;12"), 0);
+  EXPECT_TRUE(partial);
+  EXPECT_EQ(parse("\033[M !"), 0);
+  EXPECT_TRUE(partial);
+}
+
+TEST_F(TermboxInputTest, timed_out_partial_sequences_fall_back) {
+  EXPECT_EQ(parse("\033", true), 0);
+  EXPECT_FALSE(partial);
+  EXPECT_EQ(parse("\033O", true), 0);
+  EXPECT_FALSE(partial);
+}
+
+TEST_F(TermboxInputTest, alt_prefix_is_not_partial) {
+  EXPECT_EQ(parse("\033a"), 0);
+  EXPECT_FALSE(partial);
+  EXPECT_EQ(parse("\033\033OA"), 0);
+  EXPECT_FALSE(partial);
+}
+
+TEST_F(TermboxInputTest, prefix_of_longer_key) {
+  key_trie_free();
+  key_trie_init(linux_keys);
+  // '[' is a valid CSI final byte, but the linux F1 key goes on
+  EXPECT_EQ(parse("\033[["), 0);
+  EXPECT_TRUE(partial);
+  EXPECT_EQ(parse("\033[[A"), 4);
+  EXPECT_EQ(event.key, TB_KEY_F1);
+}
+
+TEST_F(TermboxInputTest, modified_keys) {
+  EXPECT_EQ(parse("\033[1;5A"), 6);
+  EXPECT_EQ(event.key, TB_KEY_ARROW_UP);
+  EXPECT_EQ(event.mod, TB_MOD_CTRL);
+  EXPECT_EQ(parse("\033[15;2~"), 7);
+  EXPECT_EQ(event.key, TB_KEY_F5);
+  EXPECT_EQ(event.mod, TB_MOD_SHIFT);
+  EXPECT_EQ(parse("\033[Z"), 3);
+  EXPECT_EQ(event.key, TB_KEY_TAB);
+  EXPECT_EQ(event.mod, TB_MOD_SHIFT);
+}
+
+TEST_F(TermboxInputTest, csi_u) {
+  EXPECT_EQ(parse("\033[97;5u"), 7);
+  EXPECT_EQ(event.key, TB_KEY_CTRL_A);
+  EXPECT_EQ(event.mod, TB_MOD_CTRL);
+  EXPECT_EQ(parse("\033[233;3u"), 8);
+  EXPECT_EQ(event.key, 0);
+  EXPECT_EQ(event.ch, 233u);
+  EXPECT_EQ(event.mod, TB_MOD_ALT);
+  EXPECT_EQ(parse("\033[13u"), 5);
+  EXPECT_EQ(event.key, TB_KEY_ENTER);
+}
+
+TEST_F(TermboxInputTest, modify_other_keys) {
+  EXPECT_EQ(parse("\033[27;6;73~"), 10);
+  EXPECT_EQ(event.key, TB_KEY_CTRL_I);
+  EXPECT_EQ(event.mod, TB_MOD_CTRL | TB_MOD_SHIFT);
+}
+
+TEST_F(TermboxInputTest, unknown_csi_is_dropped) {
+  // focus-in report
+  EXPECT_EQ(parse("\033[I"), -3);
+}
+
+TEST_F(TermboxInputTest, x10_mouse) {
+  EXPECT_EQ(parse("\033[M !\""), 6);
+  EXPECT_EQ(event.type, TB_EVENT_MOUSE);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_LEFT);
+  EXPECT_EQ(event.x, 0);
+  EXPECT_EQ(event.y, 1);
+}
+
+TEST_F(TermboxInputTest, sgr_mouse_past_column_223) {
+  EXPECT_EQ(parse("\033[<0;300;40M"), 12);
+  EXPECT_EQ(event.type, TB_EVENT_MOUSE);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_LEFT);
+  EXPECT_EQ(event.x, 299);
+  EXPECT_EQ(event.y, 39);
+}
+
+TEST_F(TermboxInputTest, sgr_mouse_release) {
+  EXPECT_EQ(parse("\033[<2;1;1m"), 9);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_RELEASE);
+}
+
+TEST_F(TermboxInputTest, sgr_mouse_modifiers_and_motion) {
+  // ctrl + shift drag with the left button
+  EXPECT_EQ(parse("\033[<52;5;6M"), 10);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_LEFT);
+  EXPECT_EQ(event.mod, TB_MOD_CTRL | TB_MOD_SHIFT | TB_MOD_MOTION);
+
+  // plain motion without any button pressed
+  EXPECT_EQ(parse("\033[<35;5;6M"), 10);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_RELEASE);
+  EXPECT_EQ(event.mod, TB_MOD_MOTION);
+
+  // meta + wheel down
+  EXPECT_EQ(parse("\033[<73;5;6M"), 10);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_WHEEL_DOWN);
+  EXPECT_EQ(event.mod, TB_MOD_ALT);
+}
+
+TEST_F(TermboxInputTest, urxvt_mouse) {
+  EXPECT_EQ(parse("\033[32;10;20M"), 11);
+  EXPECT_EQ(event.key, TB_KEY_MOUSE_LEFT);
+  EXPECT_EQ(event.x, 9);
+  EXPECT_EQ(event.y, 19);
+}
+
+TEST_F(TermboxInputTest, unsupported_mouse_button_is_dropped) {
+  // horizontal wheel
+  EXPECT_EQ(parse("\033[<66;1;1M"), -10);
+}
@@ -0,0 +1,60 @@
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "pty.hpp"
+
+// frames handed to the writer thread while nobody reads the pty
+
+class WriterTest : public PtyContextTest {
+protected:
+  // a frame is far more than a pty buffers
+  WriterTest() : PtyContextTest{200, 50} {}
+
+  static void fill(char ch) {
+    for (int y = 0; y < tb_height(); y++) {
+      for (int x = 0; x < tb_width(); x++) tb_change_cell(x, y, ch, TB_DEFAULT, TB_DEFAULT);
+    }
+  }
+
+  // reads until the writer and the tty are done with everything
+  std::string drainAll() {
+    std::string out;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (std::chrono::steady_clock::now() < deadline) {
+      std::string more = drain();
+      out += more;
+      if (more.empty() && tb_output_pending() == 0) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    return out;
+  }
+};
+
+TEST_F(WriterTest, stalled_reader_gets_the_last_frame) {
+  ASSERT_EQ(tb_start_writer(), 0);
+  // none of these show up in escape sequences
+  const std::string frames = "abcdefgijknopqstuvwxyz";
+  for (char ch : frames) {
+    fill(ch);
+    tb_present();
+  }
+  EXPECT_GT(tb_output_pending(), 0);
+  unsigned long superseded = tb_superseded_frames();
+  EXPECT_GT(superseded, 0u);
+
+  std::string out = drainAll();
+  EXPECT_EQ(tb_output_pending(), 0);
+  // a frame taken back is never written, not even in part
+  std::size_t written = 0;
+  for (char ch : frames) {
+    if (out.find(ch) != std::string::npos) written++;
+  }
+  EXPECT_EQ(written + superseded, frames.size());
+  // everything after the last frame began is the last frame
+  auto last = out.find(frames.back());
+  ASSERT_NE(last, std::string::npos);
+  EXPECT_EQ(out.find(frames[frames.size() - 2], last), std::string::npos);
+  EXPECT_EQ(std::count(out.begin() + last, out.end(), frames.back()), 200 * 50);
+}